@@ -73,6 +73,9 @@ public:
         this->loadModel(path);
     }
 
+    // constructor from meshes already created (e.g., loaded in background and uploaded to the GPU later)
+    Model(vector<Mesh>&& meshes) : meshes(std::move(meshes)) {}
+
     //////////////////////////////////////////
 
     // model rendering: calls rendering methods of each instance of Mesh class in the vector
@@ -29,6 +29,9 @@ public:
 
     //////////////////////////////////////////
 
+    // constructor from an already created Shader Program (e.g., loaded from a program binary)
+    Shader(GLuint program) : Program(program) {}
+
     //constructor
     Shader(const GLchar* vertexPath, const GLchar* fragmentPath)
     {
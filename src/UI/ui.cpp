@@ -6,9 +6,15 @@
 
 #include "ui.h"
 
+// we load the parameters of the obstacle volumes
+#include "../fluid-sim.h"
+
 //////////////////////////
 // parameters definition
 
+// size of the simulation grid
+glm::uvec3 gridSize = glm::uvec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH);
+
 // parameters for simulation time step
 GLfloat timeStep;
 GLfloat simulationFramerate;
@@ -30,6 +36,11 @@ GLfloat levelSetInitialHeight;
 GLfloat gravityAcceleration;
 GLfloat gravityLevelSetThreshold;
 
+// Liquid shading parameters
+bool packedGradients;
+bool gradientBenchmarkRequested = false;
+glm::vec3 gradientTimes = glm::vec3(0.0f);
+
 // Jacobi pressure solver iterations
 GLuint pressureIterations;
 
@@ -42,6 +53,8 @@ GLfloat ambientWeight;
 GLfloat velocityDissipation;
 GLfloat densityDissipation;
 GLfloat temperatureDissipation;
+bool gasSelfShadowing;
+GLfloat gasShadowExtinction;
 
 // Fluid Volume parameters
 glm::vec3 fluidTranslation;
@@ -55,9 +68,35 @@ GLfloat deNoiseSigma;
 GLfloat deNoiseThreshold;
 GLfloat deNoiseKSigma;
 
+// A-trous denoise filter parameters
+GLint aTrousIterations;
+GLfloat aTrousColorSigma;
+GLfloat aTrousDepthSigma;
+
+GLfloat liquidEffectTimes[LIQUID_EFFECT_COUNT] = {0.0f};
+
 // rotation speed on Y axis
 GLfloat spin_speed;
 
+// Scene parameters
+bool shadowMapCaching;
+glm::uvec2 shadowMapUpdates = glm::uvec2(0);
+bool depthPrePass;
+bool fluidStencil;
+glm::vec2 scenePassTimes = glm::vec2(0.0f);
+
+// Raymarching parameters
+bool emptySpaceSkipping;
+bool raymarchingStatistics;
+bool tightRayBounds;
+GLint raymarchingResolution;
+GLfloat raymarchingStepQuality;
+bool adaptiveStepping;
+bool stepCountView;
+bool temporalAccumulation;
+GLfloat temporalHistoryWeight;
+glm::vec3 raymarchingSteps = glm::vec3(0.0f);
+
 // Custom fluid interaction
 vector<Force*> externalForces = vector<Force*>();
 vector<FluidEmitter*> fluidQuantities = vector<FluidEmitter*>();
@@ -65,6 +104,20 @@ vector<FluidEmitter*> fluidQuantities = vector<FluidEmitter*>();
 // data structure for obstacle objects interaction
 vector<ObstacleObject*> obstacleObjects = vector<ObstacleObject*>();
 
+// obstacle object whose models are loaded in background
+struct PendingObstacleObject
+{
+    PendingModel* highPoly;
+    PendingModel* lowPoly; // given low poly model or generated voxelization proxy
+    string name;
+    glm::vec3 position;
+    glm::vec3 scale;
+    ObstacleShape shape;
+};
+
+// obstacle objects waiting for their models, in creation order
+vector<PendingObstacleObject> pendingObstacleObjects = vector<PendingObstacleObject>();
+
 //////////////////////////
 
 // Reset parameters to default values
@@ -91,6 +144,9 @@ void ResetParameters()
     gravityAcceleration = 9.0f;
     gravityLevelSetThreshold = 1.0f;
 
+    // Liquid shading parameters
+    packedGradients = true;
+
     // Jacobi pressure solver iterations
     pressureIterations = 40; // 40
 
@@ -103,6 +159,8 @@ void ResetParameters()
     velocityDissipation = 0.99f; // 0.8f
     densityDissipation = targetFluid == GAS ? 0.99f : 1.0f; // 0.9f
     temperatureDissipation = 0.9f; // 0.9f
+    gasSelfShadowing = true;
+    gasShadowExtinction = 2.0f;
 
     // Fluid Volume parameters
     fluidTranslation = glm::vec3(0.0f, 2.0f, 1.0f);
@@ -116,8 +174,29 @@ void ResetParameters()
     deNoiseThreshold = 0.23f;
     deNoiseKSigma = 3.0f;
 
+    // A-trous denoise filter parameters
+    aTrousIterations = 3;
+    aTrousColorSigma = 0.3f;
+    aTrousDepthSigma = 2.0f;
+
     // rotation speed on Y axis
     spin_speed = 60.0f;
+
+    // Scene parameters
+    shadowMapCaching = true;
+    depthPrePass = true;
+    fluidStencil = true;
+
+    // Raymarching parameters
+    emptySpaceSkipping = true;
+    raymarchingStatistics = false;
+    tightRayBounds = true;
+    raymarchingResolution = 0;
+    raymarchingStepQuality = 1.0f;
+    adaptiveStepping = true;
+    stepCountView = false;
+    temporalAccumulation = true;
+    temporalHistoryWeight = 0.9f;
 }
 
 // Reset the forces and fluid quantities
@@ -131,19 +210,19 @@ void ResetForcesAndEmitters(TargetFluid target)
     if (target == GAS)
     {
         // we add the forces for gas simulation
-        externalForces.push_back(new Force {glm::vec3(GRID_WIDTH / 2.0f, GRID_HEIGHT * 0.4f, GRID_DEPTH * 0.7f), 
+        externalForces.push_back(new Force {glm::vec3(gridSize.x / 2.0f, gridSize.y * 0.4f, gridSize.z * 0.7f), 
                                         glm::vec3(0,0,-1), 
                                         20.0f,
                                         2.0f});
 
         // we add the fluid for gas simulation
-        fluidQuantities.push_back(new FluidEmitter {glm::vec3(GRID_WIDTH / 2.0f, GRID_HEIGHT * 0.4f, GRID_DEPTH * 0.7f), 
+        fluidQuantities.push_back(new FluidEmitter {glm::vec3(gridSize.x / 2.0f, gridSize.y * 0.4f, gridSize.z * 0.7f), 
                                         5.0f});
     }
     else
     {
         // we add the forces for liquid simulation
-        glm::vec3 v = glm::vec3(GRID_WIDTH / 2.0f, GRID_HEIGHT * 0.8f, GRID_DEPTH / 2.0f);
+        glm::vec3 v = glm::vec3(gridSize.x / 2.0f, gridSize.y * 0.8f, gridSize.z / 2.0f);
         v.x += v.x * 0.1f;
         externalForces.push_back(new Force {v,
                                         glm::vec3(1,0,0), 
@@ -156,7 +235,7 @@ void ResetForcesAndEmitters(TargetFluid target)
                                         2.0f});
 
         // we add the fluid for liquid simulation
-        fluidQuantities.push_back(new FluidEmitter {glm::vec3(GRID_WIDTH / 2.0f, GRID_HEIGHT * 0.8f, GRID_DEPTH / 2.0f), 
+        fluidQuantities.push_back(new FluidEmitter {glm::vec3(gridSize.x / 2.0f, gridSize.y * 0.8f, gridSize.z / 2.0f), 
                                         3.0f});
     }
 }
@@ -227,7 +306,26 @@ void ShowLiquidParameters()
         ImGui::SliderFloat("Acceleration Factor", &gravityAcceleration, 0.0f, 15.0f);
 
         // gravity level set threshold
-        ImGui::SliderFloat("Level Set Threshold", &gravityLevelSetThreshold, 0.0f, GRID_DEPTH * 0.5f);
+        ImGui::SliderFloat("Level Set Threshold", &gravityLevelSetThreshold, 0.0f, gridSize.z * 0.5f);
+
+        ImGui::TreePop();
+    }
+
+    // shading tree
+    if (ImGui::TreeNode("Shading"))
+    {
+        // the raymarcher reads the level set and its gradient from the packed gradient volume
+        ImGui::Checkbox("Packed gradients", &packedGradients);
+
+        // the benchmark renders the liquid with both paths and measures the raymarching on the GPU
+        if (ImGui::Button("Benchmark gradients"))
+            gradientBenchmarkRequested = true;
+
+        if (gradientTimes.x > 0.0f && gradientTimes.y > 0.0f)
+        {
+            ImGui::Text("Raymarching: %.3f ms tricubic, %.3f ms packed", gradientTimes.x, gradientTimes.y);
+            ImGui::Text("Gradient volume: %.3f ms per step", gradientTimes.z);
+        }
 
         ImGui::TreePop();
     }
@@ -235,14 +333,18 @@ void ShowLiquidParameters()
     // post processing tree
     if (ImGui::TreeNode("Post-process effect"))
     {
+        if (temporalAccumulation)
+            ImGui::Text("Disabled by the temporal accumulation");
+
         // available post-process effects
-        const char* items[] = {"None", "Blur", "DeNoise"};
+        const char* items[] = {"None", "Blur", "DeNoise", "Separable Blur", "A-Trous DeNoise"};
         ImGui::Combo("Post-process effect", (int*) &liquidEffect, items, IM_ARRAYSIZE(items));
 
         // draw the parameters for the selected post-process effect
         switch (liquidEffect)
         {
             case BLUR: // Blur
+            case SEPARABLE_BLUR:
                 static int val = (int)blurRadius;
                 ImGui::SliderInt("Blur Radius", &val, 1.0f, 10.0f);
                 blurRadius = (float)val;
@@ -252,10 +354,20 @@ void ShowLiquidParameters()
                 ImGui::SliderFloat("DeNoise Threshold", &deNoiseThreshold, 0.0f, 10.0f);
                 ImGui::SliderFloat("DeNoise K", &deNoiseKSigma, 0.0f, 10.0f);
                 break;
+            case ATROUS_DENOISE: // A-Trous DeNoise
+                ImGui::SliderInt("Iterations", &aTrousIterations, 1, 5);
+                ImGui::SliderFloat("Color Sigma", &aTrousColorSigma, 0.01f, 1.0f);
+                ImGui::SliderFloat("Depth Sigma", &aTrousDepthSigma, 0.1f, 10.0f);
+                break;
             default:
                 break;
         }
 
+        // GPU time of the effects, measured while they are selected
+        for (int i = BLUR; i < LIQUID_EFFECT_COUNT; i++)
+            if (liquidEffectTimes[i] > 0.0f)
+                ImGui::Text("%s: %.3f ms", items[i], liquidEffectTimes[i]);
+
         ImGui::TreePop();
     }
 }
@@ -290,6 +402,15 @@ void ShowGasParameters()
 
         ImGui::TreePop();
     }
+
+    // self shadowing tree
+    if (ImGui::TreeNode("Self Shadowing"))
+    {
+        ImGui::Checkbox("Enabled", &gasSelfShadowing);
+        ImGui::SliderFloat("Shadow Extinction", &gasShadowExtinction, 0.1f, 8.0f);
+
+        ImGui::TreePop();
+    }
 }
 
 // draw the GUI for the creation and manipulation of external forces
@@ -307,7 +428,7 @@ void ShowStaticForceParameters()
         if (ImGui::TreeNode(s.c_str()))
         {
             // force position
-            ImGui::SliderFloat3("Position", glm::value_ptr(externalForces[i]->position), 0.0f, GRID_WIDTH);
+            ImGui::SliderFloat3("Position", glm::value_ptr(externalForces[i]->position), 0.0f, gridSize.x);
 
             // force direction
             ImGui::SliderFloat3("Direction", glm::value_ptr(externalForces[i]->direction), -1.0, 1.0f);
@@ -350,7 +471,7 @@ void ShowStaticFluidEmitterParameter()
         if (ImGui::TreeNode(s.c_str()))
         {
             // emitter position
-            ImGui::SliderFloat3("Position", glm::value_ptr(fluidQuantities[i]->position), 0.0f, GRID_WIDTH);
+            ImGui::SliderFloat3("Position", glm::value_ptr(fluidQuantities[i]->position), 0.0f, gridSize.x);
 
             // emitter radius
             ImGui::SliderFloat("Radius", &(fluidQuantities[i]->radius), 0.0f, 10.0f);
@@ -393,7 +514,7 @@ void ShowObstacleObjectCreationWindow()
         ImGui::Separator();
 
         // select the object to add from the predefined objects list
-        const char* items[] = { "New import", "Cube", "Sphere", "Bunny", "Baby Yoda" };
+        const char* items[] = { "New import", "Box", "Sphere", "Capsule", "Cylinder", "Bunny", "Baby Yoda" };
         static int item_current = 0;
         ImGui::Combo("Object", &item_current, items, IM_ARRAYSIZE(items));
 
@@ -491,16 +612,22 @@ void ShowObstacleObjectCreationWindow()
             {
                 switch (item_current)
                 {
-                    case 1: // Cube
-                        CreateObstacleObject("models/cube.obj", "Cube");
+                    case 1: // Box
+                        CreatePrimitiveObstacleObject(OBSTACLE_BOX, "Box");
                         break;
                     case 2: // Sphere
-                        CreateObstacleObject("models/sphere.obj", "Sphere");
+                        CreatePrimitiveObstacleObject(OBSTACLE_SPHERE, "Sphere");
+                        break;
+                    case 3: // Capsule
+                        CreatePrimitiveObstacleObject(OBSTACLE_CAPSULE, "Capsule");
                         break;
-                    case 3: // Bunny
+                    case 4: // Cylinder
+                        CreatePrimitiveObstacleObject(OBSTACLE_CYLINDER, "Cylinder");
+                        break;
+                    case 5: // Bunny
                         CreateObstacleObject("models/bunny.obj", "Bunny");
                         break;
-                    case 4: // Baby Yoda
+                    case 6: // Baby Yoda
                         CreateObstacleObject("models/babyyoda.obj", "models/low-poly_babyyoda.obj", "Baby Yoda");
                         break;
                     
@@ -557,10 +684,96 @@ void ShowObstacleObjectsControls()
         ImGui::OpenPopup("Add new obstacle");
     }
 
+    // we show the objects whose models are still loading
+    if (!pendingObstacleObjects.empty())
+        ImGui::Text("Loading %d objects...", (int) pendingObstacleObjects.size());
+
     // draw the popup window for the creation of a new obstacle object
     ShowObstacleObjectCreationWindow();
 }
 
+// draw the GUI for the raymarching parameters, with the steps of the rays when they are measured
+void ShowRaymarchingParameters()
+{
+    // header
+    if (!ImGui::CollapsingHeader("Raymarching"))
+        return;
+
+    // resolution of the raymarching, upsampled to the window in the blending
+    const char* resolutions[] = {"Full", "Half", "Quarter"};
+    ImGui::Combo("Resolution", &raymarchingResolution, resolutions, IM_ARRAYSIZE(resolutions));
+
+    // the quality divides the marching step, the adaptive steps grow it where the details are not visible
+    ImGui::SliderFloat("Step quality", &raymarchingStepQuality, 0.25f, 4.0f);
+    ImGui::Checkbox("Adaptive steps", &adaptiveStepping);
+    ImGui::Checkbox("Step count view", &stepCountView);
+
+    ImGui::Checkbox("Empty space skipping", &emptySpaceSkipping);
+
+    // the temporal accumulation replaces the post-process effects of the liquid
+    ImGui::Checkbox("Temporal accumulation", &temporalAccumulation);
+
+    if (temporalAccumulation)
+        ImGui::SliderFloat("History weight", &temporalHistoryWeight, 0.5f, 0.98f);
+
+    ImGui::Checkbox("Tight ray bounds", &tightRayBounds);
+    ImGui::Checkbox("Step statistics", &raymarchingStatistics);
+
+    if (raymarchingStatistics)
+    {
+        GLfloat totalSteps = raymarchingSteps.x + raymarchingSteps.y;
+
+        ImGui::Text("Steps per ray: %.1f sampled, %.1f skipped", raymarchingSteps.x, raymarchingSteps.y);
+        ImGui::Text("Skipped steps: %.1f%%", totalSteps > 0.0f ? 100.0f * raymarchingSteps.y / totalSteps : 0.0f);
+        ImGui::Text("Marched pixels: %.1f%%", 100.0f * raymarchingSteps.z);
+    }
+}
+
+// draw the GUI for the rendering of the scene
+void ShowSceneParameters()
+{
+    // header
+    if (!ImGui::CollapsingHeader("Scene"))
+        return;
+
+    // the shadow map is split in a static and a dynamic layer, rendered only when they change
+    ImGui::Checkbox("Cache shadow map", &shadowMapCaching);
+
+    if (shadowMapCaching)
+        ImGui::Text("Shadow map updates: %u static, %u dynamic", shadowMapUpdates.x, shadowMapUpdates.y);
+
+    // the depth pre-pass shades each pixel of the scene once, the stencil limits the blending to the fluid volume
+    ImGui::Checkbox("Depth pre-pass", &depthPrePass);
+    ImGui::Checkbox("Stencil fluid blending", &fluidStencil);
+
+    ImGui::Text("Scene shading: %.3f ms", scenePassTimes.x);
+    ImGui::Text("Composition: %.3f ms", scenePassTimes.y);
+}
+
+// draw the GUI with the GPU memory allocated by each subsystem
+void ShowMemoryUsage()
+{
+    // header
+    if (!ImGui::CollapsingHeader("GPU Memory"))
+        return;
+
+    ImGui::Text("Grid: %u x %u x %u", gridSize.x, gridSize.y, gridSize.z);
+
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; i++)
+    {
+        MemorySubsystem subsystem = (MemorySubsystem) i;
+        ImGui::Text("%s: %.2f MB (%u objects)", MemorySubsystemNames[i], ToMegabytes(GetAllocatedBytes(subsystem)), GetAllocationCount(subsystem));
+    }
+
+    ImGui::Separator();
+
+    // the budget applies to the simulation grid, so we compare it with the simulation and obstacle memory
+    GLuint64 gridBytes = GetAllocatedBytes(MEMORY_SIMULATION) + GetAllocatedBytes(MEMORY_OBSTACLES);
+    ImGui::Text("Total: %.2f MB", ToMegabytes(GetTotalAllocatedBytes()));
+    ImGui::Text("Grid: %.2f MB of %u MB budget", ToMegabytes(gridBytes), GRID_MEMORY_BUDGET_MB);
+    ImGui::ProgressBar(glm::min(ToMegabytes(gridBytes) / GRID_MEMORY_BUDGET_MB, 1.0f));
+}
+
 // draw the application GUI
 void CustomUI()
 {
@@ -624,6 +837,21 @@ void CustomUI()
 
     ShowObstacleObjectsControls();
 
+    ////////////////////////////////
+    // draw the raymarching parameters
+
+    ShowRaymarchingParameters();
+
+    ////////////////////////////////
+    // draw the scene parameters
+
+    ShowSceneParameters();
+
+    ////////////////////////////////
+    // draw the GPU memory usage
+
+    ShowMemoryUsage();
+
     ////////////////////////////////
 
     ImGui::End();
@@ -685,35 +913,102 @@ void ExpandUI()
 ////////////////////////////
 // Obstacle Object creation
 
-// create a new obstacle object and add it to the list of obstacle objects
+// create a new obstacle object: its models are imported on worker threads, and the object is added
+// to the list of obstacle objects when their meshes are uploaded (see UpdatePendingObstacleObjects)
 void CreateObstacleObject(const string& highPolyPath, const string& lowPolyPath, const char* name, glm::vec3 position, glm::vec3 scale)
 {
-    // create the high poly model for scene rendering
-    Model* highPoly = new Model(highPolyPath);
-    Model* lowPoly;
+    // start the loading of the high poly model for scene rendering
+    PendingModel* highPoly = LoadModelAsync(highPolyPath);
+    PendingModel* lowPoly;
 
-    // check if the low poly model is the same as the high poly model
+    // if the low poly model is not given, we generate a voxelization proxy simplified for the resolution
+    // of the obstacle volume, which is voxelized in model space independently of the grid size
     if (highPolyPath == lowPolyPath)
-        lowPoly = highPoly;
+        lowPoly = LoadProxyModelAsync(highPolyPath, ProxyTriangleBudget(OBSTACLE_VOLUME_RESOLUTION, OBSTACLE_VOLUME_RESOLUTION, OBSTACLE_VOLUME_RESOLUTION));
     else
-        lowPoly = new Model(lowPolyPath);
+        lowPoly = LoadModelAsync(lowPolyPath);
 
     // setup the name of the object
     string n;
     if (name)
         n = name;
     else
-        n = "Obstacle " + std::to_string(obstacleObjects.size() + 1);
+        n = "Obstacle " + std::to_string(obstacleObjects.size() + pendingObstacleObjects.size() + 1);
+
+    pendingObstacleObjects.push_back({highPoly, lowPoly, n, position, scale, OBSTACLE_MESH});
+}
 
-    // create the obstacle object
-    ObstacleObject *obj = new ObstacleObject { glm::mat4(1.0), glm::mat4(1.0), highPoly, lowPoly, position, scale, n, true };
+// upload the models of the first pending objects within the per-frame budget, so a big model is spread
+// over several frames. The objects are completed in creation order
+void UpdatePendingObstacleObjects()
+{
+    GLuint64 budget = MODEL_UPLOAD_BYTES_PER_FRAME;
+
+    while (!pendingObstacleObjects.empty() && budget > 0)
+    {
+        PendingObstacleObject &pending = pendingObstacleObjects.front();
+
+        bool highPolyReady = UploadPendingModel(pending.highPoly, budget);
+        bool lowPolyReady = UploadPendingModel(pending.lowPoly, budget);
+
+        if (!highPolyReady || !lowPolyReady)
+            return;
+
+        Model* highPoly = TakePendingModel(pending.highPoly);
+        Model* lowPoly = TakePendingModel(pending.lowPoly);
+
+        // a model without meshes failed to load, so the object is discarded
+        if (highPoly->meshes.empty())
+        {
+            std::cout << "ERROR::OBSTACLE:: cannot load the model of " << pending.name << std::endl;
+
+            delete highPoly;
+            delete lowPoly;
+            pendingObstacleObjects.erase(pendingObstacleObjects.begin());
+            continue;
+        }
+
+        // an empty proxy means that the model is already within the triangle budget (or that the low poly
+        // model failed to load), so the same model is used for rendering and simulation
+        if (lowPoly->meshes.empty())
+        {
+            delete lowPoly;
+            lowPoly = highPoly;
+        }
 
-    // add the object to the list of obstacle objects
-    obstacleObjects.push_back(obj);
+        // record the models buffers in the memory registry
+        RegisterModel(highPoly);
+        if (lowPoly != highPoly)
+            RegisterModel(lowPoly);
+
+        // create the obstacle object
+        ObstacleObject *obj = new ObstacleObject { glm::mat4(1.0), glm::mat4(1.0), highPoly, lowPoly, pending.position, pending.scale, pending.name, true, pending.shape, 0, glm::mat4(1.0), 0.0f };
+
+        // add the object to the list of obstacle objects
+        obstacleObjects.push_back(obj);
+
+        pendingObstacleObjects.erase(pendingObstacleObjects.begin());
+    }
 }
 
-// create a new obstacle object with the same model for scene and simulation rendering, and add it to the list of obstacle objects
+// create a new obstacle object from a single model (the simulation uses its generated proxy), and add it to the list of obstacle objects
 void CreateObstacleObject(const string& highPolyPath, const char* name, glm::vec3 position, glm::vec3 scale)
 {
     CreateObstacleObject(highPolyPath, highPolyPath, name, position, scale);
 }
+
+// create a new analytic primitive obstacle: its mesh is generated on a worker thread only for the scene rendering,
+// since the simulation evaluates the shape directly. The simulation uses the same model, so the low poly model is empty
+void CreatePrimitiveObstacleObject(ObstacleShape shape, const char* name, glm::vec3 position, glm::vec3 scale)
+{
+    PendingModel* highPoly = LoadMeshesAsync([shape]() { return BuildPrimitiveMeshes(shape); });
+    PendingModel* lowPoly = LoadMeshesAsync([]() { return vector<MeshData>(); });
+
+    string n;
+    if (name)
+        n = name;
+    else
+        n = "Obstacle " + std::to_string(obstacleObjects.size() + pendingObstacleObjects.size() + 1);
+
+    pendingObstacleObjects.push_back({highPoly, lowPoly, n, position, scale, shape});
+}
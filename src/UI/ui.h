@@ -16,6 +16,18 @@
 // we load the structure for the dynamic objects
 #include "../obstacle_object.h"
 
+// we load the registry of the GPU allocations
+#include "../memory-registry.h"
+
+// we load the background model loading functions
+#include "../model-loader.h"
+
+// we load the generation of the voxelization proxies
+#include "../mesh-simplify.h"
+
+// we load the meshes of the primitive obstacles
+#include "../obstacle-primitives.h"
+
 /////////////////////////////////////////////
 // we define the structures used in the gui
 
@@ -29,7 +41,16 @@ enum TargetFluid {
 enum LiquidEffect {
     NONE,
     BLUR,
-    DENOISE
+    DENOISE,
+    SEPARABLE_BLUR,
+    ATROUS_DENOISE,
+    LIQUID_EFFECT_COUNT
+};
+
+// structure for the policy applied when the requested grid exceeds the memory budget
+enum GridBudgetPolicy {
+    REFUSE_GRID,
+    DOWNSCALE_GRID
 };
 
 // structure to define a force
@@ -69,6 +90,13 @@ struct FluidEmitter
 // default parameters for the simulation grid
 const GLuint GRID_WIDTH = 100, GRID_HEIGHT = 100, GRID_DEPTH = 100;
 
+// GPU memory budget for the simulation grid (in MB), and policy applied when the requested grid exceeds it
+const GLuint GRID_MEMORY_BUDGET_MB = 1024;
+const GridBudgetPolicy GRID_BUDGET_POLICY = DOWNSCALE_GRID;
+
+// size of the simulation grid, equal to the default one or downscaled to fit the memory budget
+extern glm::uvec3 gridSize;
+
 /////////////////////////////////////////////
 // we define the parameters controlled by the gui and used in main application
 
@@ -92,6 +120,11 @@ extern GLfloat levelSetInitialHeight; // initial height for level set
 extern GLfloat gravityAcceleration; // gravity acceleration for liquid
 extern GLfloat gravityLevelSetThreshold; // level set threshold for gravity application in liquid
 
+// Liquid shading parameters
+extern bool packedGradients; // read the level set and its gradient from the packed gradient volume
+extern bool gradientBenchmarkRequested; // measure the raymarching with and without the packed gradients
+extern glm::vec3 gradientTimes; // GPU milliseconds of the raymarching with the tricubic and the packed path, and of the gradient volume
+
 // Jacobi pressure solver iterations
 extern GLuint pressureIterations;
 
@@ -104,6 +137,8 @@ extern GLfloat ambientWeight; // weight of gas for buoyancy
 extern GLfloat velocityDissipation; // velocity dissipation factor
 extern GLfloat densityDissipation; // density dissipation factor
 extern GLfloat temperatureDissipation; // temperature dissipation factor
+extern bool gasSelfShadowing; // shade the gas with the light transmittance volume
+extern GLfloat gasShadowExtinction; // extinction of the light by the gas, per cell at unit density
 
 // Fluid Volume parameters
 extern glm::vec3 fluidTranslation; // translation of fluid volume
@@ -117,9 +152,36 @@ extern GLfloat deNoiseSigma;
 extern GLfloat deNoiseThreshold;
 extern GLfloat deNoiseKSigma;
 
+// A-trous denoise filter parameters
+extern GLint aTrousIterations; // iterations of the filter, each one doubles the distance between the taps
+extern GLfloat aTrousColorSigma; // scale of the color distance in the edge-stopping weights
+extern GLfloat aTrousDepthSigma; // scale of the depth distance in the edge-stopping weights
+
+// GPU milliseconds of the last frame filtered with each post-process effect (0 if not measured yet)
+extern GLfloat liquidEffectTimes[LIQUID_EFFECT_COUNT];
+
 // rotation speed on Y axis
 extern GLfloat spin_speed;
 
+// Scene parameters
+extern bool shadowMapCaching; // render the shadow map only when the light or the obstacle objects change
+extern glm::uvec2 shadowMapUpdates; // renders of the static and of the dynamic layer of the cached shadow map
+extern bool depthPrePass; // render the depth of the scene before its shading
+extern bool fluidStencil; // blend the fluid only in the pixels covered by the fluid volume
+extern glm::vec2 scenePassTimes; // GPU milliseconds of the scene shading and of the final composition
+
+// Raymarching parameters
+extern bool emptySpaceSkipping; // leap over the empty blocks of the occupancy volume
+extern bool raymarchingStatistics; // measure the steps of the rays
+extern bool tightRayBounds; // rasterize only the bounds of the blocks with fluid
+extern GLint raymarchingResolution; // the raymarching runs at the window resolution divided by 2^raymarchingResolution
+extern GLfloat raymarchingStepQuality; // divides the marching step of the rays
+extern bool adaptiveStepping; // adapt the marching step to the distance and to the fluid
+extern bool stepCountView; // show the sampled steps of each pixel
+extern bool temporalAccumulation; // accumulate the raymarched fluid over the frames
+extern GLfloat temporalHistoryWeight; // weight of the previous frames in the accumulation
+extern glm::vec3 raymarchingSteps; // average sampled and skipped steps of the marched rays, and fraction of the marched pixels
+
 // Custom fluid interaction
 extern vector<Force*> externalForces;
 extern vector<FluidEmitter*> fluidQuantities;
@@ -150,5 +212,11 @@ void ResetForcesAndEmitters(TargetFluid target);
 // create an obstacle object with a high poly model for rendering and a low poly model for simulation
 void CreateObstacleObject(const string& highPolyPath, const string& lowPolyPath, const char* name, glm::vec3 position = glm::vec3(0.0), glm::vec3 scale = glm::vec3(1.0));
 
-// create an obstacle object with the same model for rendering and simulation
-void CreateObstacleObject(const string& highPolyPath, const char* name, glm::vec3 position = glm::vec3(0.0), glm::vec3 scale = glm::vec3(1.0));
\ No newline at end of file
+// create an obstacle object from a single model: the simulation uses a proxy simplified for the grid resolution
+void CreateObstacleObject(const string& highPolyPath, const char* name, glm::vec3 position = glm::vec3(0.0), glm::vec3 scale = glm::vec3(1.0));
+
+// create an analytic primitive obstacle (see ObstacleShape), with a generated mesh for the scene rendering
+void CreatePrimitiveObstacleObject(ObstacleShape shape, const char* name, glm::vec3 position = glm::vec3(0.0), glm::vec3 scale = glm::vec3(1.0));
+
+// upload the models of the obstacle objects loaded in background, and add the completed objects to the list
+void UpdatePendingObstacleObjects();
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "blue-noise.h"
+
+// Std. Includes
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+//////////////////////////////////////
+// utility functions
+
+// gaussian filter on the torus, centered in the first pixel: the energy of a pixel is the sum of the
+// filter centered in each pixel of the pattern, so the noise tiles without seams
+std::vector<GLfloat> BlueNoiseKernel(GLuint size)
+{
+    std::vector<GLfloat> kernel(size * size);
+
+    for (GLuint y = 0; y < size; y++)
+    {
+        for (GLuint x = 0; x < size; x++)
+        {
+            GLfloat dx = (GLfloat) std::min(x, size - x);
+            GLfloat dy = (GLfloat) std::min(y, size - y);
+
+            kernel[x + size * y] = std::exp(-(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+        }
+    }
+
+    return kernel;
+}
+
+// add (sign 1) or remove (sign -1) the filter centered in the pixel to the energy
+void SplatEnergy(std::vector<GLfloat>& energy, const std::vector<GLfloat>& kernel, GLuint size, GLuint pixel, GLfloat sign)
+{
+    GLuint px = pixel % size;
+    GLuint py = pixel / size;
+
+    for (GLuint y = 0; y < size; y++)
+    {
+        const GLfloat* row = &kernel[size * ((y + size - py) % size)];
+
+        for (GLuint x = 0; x < size; x++)
+            energy[x + size * y] += sign * row[(x + size - px) % size];
+    }
+}
+
+// pixel with the given value and the largest energy: with value 1 it's the tightest cluster of the pattern
+GLuint TightestCluster(const std::vector<GLubyte>& pattern, const std::vector<GLfloat>& energy, GLubyte value)
+{
+    GLuint best = 0;
+    GLfloat bestEnergy = -1.0f;
+
+    for (GLuint i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] == value && energy[i] > bestEnergy)
+        {
+            best = i;
+            bestEnergy = energy[i];
+        }
+    }
+
+    return best;
+}
+
+// empty pixel with the smallest energy, that is the largest void of the pattern
+GLuint LargestVoid(const std::vector<GLubyte>& pattern, const std::vector<GLfloat>& energy)
+{
+    GLuint best = 0;
+    GLfloat bestEnergy = INFINITY;
+
+    for (GLuint i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] == 0 && energy[i] < bestEnergy)
+        {
+            best = i;
+            bestEnergy = energy[i];
+        }
+    }
+
+    return best;
+}
+
+//////////////////////////////////////
+// blue noise functions
+
+// generate the noise with the void and cluster method (Ulichney, 1993). A random pattern with a tenth of the pixels
+// is relaxed moving its tightest cluster in its largest void; then the pixels are ranked removing the clusters of the
+// pattern, filling its voids up to half of the pixels, and filling the clusters of the empty pixels up to the end
+std::vector<GLfloat> GenerateBlueNoise(GLuint size)
+{
+    GLuint count = size * size;
+    std::vector<GLfloat> kernel = BlueNoiseKernel(size);
+
+    std::vector<GLubyte> pattern(count, 0);
+    std::vector<GLfloat> energy(count, 0.0f);
+    std::vector<GLuint> rank(count, 0);
+
+    // we place the initial pixels at random, with a fixed seed so the noise is the same at each run
+    std::mt19937 random(1993);
+    GLuint ones = count / 10;
+
+    for (GLuint placed = 0; placed < ones; )
+    {
+        GLuint pixel = random() % count;
+
+        if (pattern[pixel] == 0)
+        {
+            pattern[pixel] = 1;
+            SplatEnergy(energy, kernel, size, pixel, 1.0f);
+            placed++;
+        }
+    }
+
+    // we relax the pattern until the tightest cluster is also the largest void
+    for (GLuint i = 0; i < count; i++)
+    {
+        GLuint cluster = TightestCluster(pattern, energy, 1);
+        pattern[cluster] = 0;
+        SplatEnergy(energy, kernel, size, cluster, -1.0f);
+
+        GLuint largestVoid = LargestVoid(pattern, energy);
+        pattern[largestVoid] = 1;
+        SplatEnergy(energy, kernel, size, largestVoid, 1.0f);
+
+        if (largestVoid == cluster)
+            break;
+    }
+
+    // phase 1: the pixels of the pattern are ranked from the last, removing the tightest clusters
+    std::vector<GLubyte> removedPattern = pattern;
+    std::vector<GLfloat> removedEnergy = energy;
+
+    for (GLuint r = ones; r > 0; r--)
+    {
+        GLuint cluster = TightestCluster(removedPattern, removedEnergy, 1);
+        removedPattern[cluster] = 0;
+        SplatEnergy(removedEnergy, kernel, size, cluster, -1.0f);
+        rank[cluster] = r - 1;
+    }
+
+    // phase 2: the largest voids are filled up to half of the pixels
+    for (GLuint r = ones; r < count / 2; r++)
+    {
+        GLuint largestVoid = LargestVoid(pattern, energy);
+        pattern[largestVoid] = 1;
+        SplatEnergy(energy, kernel, size, largestVoid, 1.0f);
+        rank[largestVoid] = r;
+    }
+
+    // phase 3: the empty pixels are the minority, so the tightest clusters of the empty pixels are filled
+    std::fill(energy.begin(), energy.end(), 0.0f);
+
+    for (GLuint i = 0; i < count; i++)
+        if (pattern[i] == 0)
+            SplatEnergy(energy, kernel, size, i, 1.0f);
+
+    for (GLuint r = std::max(ones, count / 2); r < count; r++)
+    {
+        GLuint cluster = TightestCluster(pattern, energy, 0);
+        pattern[cluster] = 1;
+        SplatEnergy(energy, kernel, size, cluster, -1.0f);
+        rank[cluster] = r;
+    }
+
+    std::vector<GLfloat> noise(count);
+
+    for (GLuint i = 0; i < count; i++)
+        noise[i] = (rank[i] + 0.5f) / count;
+
+    return noise;
+}
+
+// rotate the noise with the additive recurrence of the golden ratio, which covers (0, 1) uniformly at any frame count
+GLfloat BlueNoiseFrameOffset(GLuint frame)
+{
+    return (GLfloat) std::fmod(frame * GOLDEN_RATIO_CONJUGATE, 1.0);
+}
@@ -0,0 +1,28 @@
+#include <glad/glad.h>
+
+// Std. Includes
+#include <vector>
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the parameters of the blue noise
+
+// side of the tiled blue noise texture used to jitter the rays (a power of two, so the tiling is a mask)
+const GLuint BLUE_NOISE_SIZE = 64;
+
+// standard deviation of the gaussian filter that measures the clustering of the pixels, in pixels
+const GLfloat BLUE_NOISE_SIGMA = 1.5f;
+
+// golden ratio conjugate, used to rotate the noise at each frame with a low discrepancy sequence
+const double GOLDEN_RATIO_CONJUGATE = 0.61803398874989484820;
+
+/////////////////////////////////////////////
+// we define the blue noise functions. They don't use OpenGL, so they can be used without a GPU
+
+// generate a tileable size x size blue noise with the void and cluster method: each pixel has a distinct
+// rank, and the values are the ranks mapped in (0, 1). The generation is deterministic
+std::vector<GLfloat> GenerateBlueNoise(GLuint size);
+
+// offset of the noise at the given frame: the fractional part of frame times the golden ratio conjugate
+GLfloat BlueNoiseFrameOffset(GLuint frame);
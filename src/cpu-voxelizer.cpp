@@ -0,0 +1,480 @@
+#include "cpu-voxelizer.h"
+
+// Std. Includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+//////////////////////////////////////
+// we define the voxelization structures
+
+// intersection of a row of the grid with a triangle: the winding is +1 if the row enters the mesh, -1 if it exits
+struct RowHit
+{
+    GLfloat t;
+    GLint winding;
+
+    bool operator<(const RowHit &other) const
+    {
+        return this->t < other.t;
+    }
+};
+
+//////////////////////////////////////
+// utility functions
+
+// build the subtree of the triangles in the range, returning the index of its root
+GLuint BuildNode(TriangleBVH &bvh, std::vector<GLuint> &triangles, std::vector<glm::vec3> &centroids, const std::vector<glm::vec3> &vertices, GLuint first, GLuint count)
+{
+    TriangleBVH::Node node;
+    node.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    node.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    node.rightChild = 0;
+    node.firstTriangle = first;
+    node.triangleCount = count;
+
+    glm::vec3 centroidMin = node.boundsMin;
+    glm::vec3 centroidMax = node.boundsMax;
+
+    for (GLuint i = first; i < first + count; i++)
+    {
+        for (GLuint v = 0; v < 3; v++)
+        {
+            node.boundsMin = glm::min(node.boundsMin, vertices[triangles[i] * 3 + v]);
+            node.boundsMax = glm::max(node.boundsMax, vertices[triangles[i] * 3 + v]);
+        }
+
+        centroidMin = glm::min(centroidMin, centroids[triangles[i]]);
+        centroidMax = glm::max(centroidMax, centroids[triangles[i]]);
+    }
+
+    GLuint index = bvh.nodes.size();
+    bvh.nodes.push_back(node);
+
+    if (count <= BVH_LEAF_TRIANGLES)
+        return index;
+
+    // we split the triangles at the median of their centroids, along the largest axis
+    glm::vec3 extent = centroidMax - centroidMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+    GLuint half = count / 2;
+    std::nth_element(triangles.begin() + first, triangles.begin() + first + half, triangles.begin() + first + count,
+                     [&](GLuint a, GLuint b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    bvh.nodes[index].triangleCount = 0;
+
+    BuildNode(bvh, triangles, centroids, vertices, first, half);
+    GLuint right = BuildNode(bvh, triangles, centroids, vertices, first + half, count - half);
+
+    bvh.nodes[index].rightChild = right;
+
+    return index;
+}
+
+// check if the line intersects the box
+bool LineHitsBox(glm::vec3 origin, glm::vec3 inverseDirection, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+    glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+
+    // the components of the direction equal to 0 give NaN if the origin is on a face of the box:
+    // the comparison is false with NaN, so the box is kept
+    GLfloat enter = std::max(std::max(tNear.x, tNear.y), tNear.z);
+    GLfloat exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+
+    return !(enter > exit);
+}
+
+// collect the intersections of the line with the triangles of the BVH (Möller-Trumbore test)
+void IntersectLine(const TriangleBVH &bvh, glm::vec3 origin, glm::vec3 direction, std::vector<RowHit> &hits)
+{
+    hits.clear();
+
+    if (bvh.nodes.empty())
+        return;
+
+    glm::vec3 inverseDirection = 1.0f / direction;
+
+    GLuint stack[64];
+    GLuint stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const TriangleBVH::Node &node = bvh.nodes[stack[--stackSize]];
+
+        if (!LineHitsBox(origin, inverseDirection, node.boundsMin, node.boundsMax))
+            continue;
+
+        if (node.triangleCount == 0)
+        {
+            GLuint index = &node - &bvh.nodes[0];
+            stack[stackSize++] = node.rightChild;
+            stack[stackSize++] = index + 1;
+            continue;
+        }
+
+        for (GLuint i = node.firstTriangle; i < node.firstTriangle + node.triangleCount; i++)
+        {
+            glm::vec3 v0 = bvh.vertices[i * 3];
+            glm::vec3 e1 = bvh.vertices[i * 3 + 1] - v0;
+            glm::vec3 e2 = bvh.vertices[i * 3 + 2] - v0;
+
+            glm::vec3 p = glm::cross(direction, e2);
+            GLfloat det = glm::dot(e1, p);
+
+            // the line is parallel to the triangle
+            if (glm::abs(det) < 1e-12f)
+                continue;
+
+            GLfloat inverseDet = 1.0f / det;
+            glm::vec3 s = origin - v0;
+
+            GLfloat u = glm::dot(s, p) * inverseDet;
+            if (u < 0.0f || u > 1.0f)
+                continue;
+
+            glm::vec3 q = glm::cross(s, e1);
+            GLfloat v = glm::dot(direction, q) * inverseDet;
+            if (v < 0.0f || u + v > 1.0f)
+                continue;
+
+            // the determinant is positive when the line goes against the triangle normal (entering the mesh)
+            hits.push_back({glm::dot(e2, q) * inverseDet, det > 0.0f ? 1 : -1});
+        }
+    }
+
+    std::sort(hits.begin(), hits.end());
+}
+
+// index of the cell in the fields
+inline size_t CellIndex(const VoxelGrid &grid, GLuint x, GLuint y, GLuint z)
+{
+    return ((size_t) z * grid.height + y) * grid.width + x;
+}
+
+// check if the cell is on the border of the grid
+inline bool IsBorderCell(const VoxelGrid &grid, GLuint x, GLuint y, GLuint z)
+{
+    return x == 0 || y == 0 || z == 0 || x == grid.width - 1 || y == grid.height - 1 || z == grid.depth - 1;
+}
+
+// squared Euclidean distance transform of a line of samples (Felzenszwalb and Huttenlocher): the result is
+// the minimum of (i - j)^2 + f(j) over all the samples j. The lower envelope of the parabolas uses the given buffers
+void DistanceTransform1D(const GLfloat* f, GLuint n, GLfloat* d, std::vector<GLint> &parabolas, std::vector<GLfloat> &bounds)
+{
+    const GLfloat infinity = std::numeric_limits<float>::max();
+
+    parabolas.resize(n);
+    bounds.resize(n + 1);
+
+    GLint k = 0;
+    parabolas[0] = 0;
+    bounds[0] = -infinity;
+    bounds[1] = infinity;
+
+    for (GLint q = 1; q < (GLint) n; q++)
+    {
+        // the samples without features don't define a parabola
+        if (f[q] >= infinity)
+            continue;
+
+        if (f[parabolas[k]] >= infinity)
+        {
+            parabolas[k] = q;
+            continue;
+        }
+
+        GLfloat s;
+        while (true)
+        {
+            GLint p = parabolas[k];
+            s = ((f[q] + q * q) - (f[p] + p * p)) / (2.0f * (q - p));
+
+            if (s > bounds[k] || k == 0)
+                break;
+
+            k--;
+        }
+
+        k++;
+        parabolas[k] = q;
+        bounds[k] = s;
+        bounds[k + 1] = infinity;
+    }
+
+    if (f[parabolas[0]] >= infinity)
+    {
+        std::fill(d, d + n, infinity);
+        return;
+    }
+
+    k = 0;
+    for (GLint q = 0; q < (GLint) n; q++)
+    {
+        while (bounds[k + 1] < q)
+            k++;
+
+        GLint p = parabolas[k];
+        d[q] = (q - p) * (q - p) + f[p];
+    }
+}
+
+// squared distance of each voxel from the nearest voxel with the given occupancy, with separable passes along the axes
+void SquaredDistanceToVoxels(const std::vector<GLfloat>& occupancy, bool occupied, GLuint width, GLuint height, GLuint depth, std::vector<GLfloat>& distance)
+{
+    const GLfloat infinity = std::numeric_limits<float>::max();
+    GLuint sizes[3] = {width, height, depth};
+    size_t strides[3] = {1, width, (size_t) width * height};
+
+    distance.resize(occupancy.size());
+    for (size_t i = 0; i < occupancy.size(); i++)
+        distance[i] = (occupancy[i] > 0.0f) == occupied ? 0.0f : infinity;
+
+    std::vector<GLfloat> line, result;
+    std::vector<GLint> parabolas;
+    std::vector<GLfloat> bounds;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        GLuint n = sizes[axis];
+        line.resize(n);
+        result.resize(n);
+
+        // we visit all the lines along the axis, starting from the voxels with coordinate 0 on it
+        for (size_t start = 0; start < distance.size(); start++)
+        {
+            if ((start / strides[axis]) % n != 0)
+                continue;
+
+            for (GLuint i = 0; i < n; i++)
+                line[i] = distance[start + i * strides[axis]];
+
+            DistanceTransform1D(line.data(), n, result.data(), parabolas, bounds);
+
+            for (GLuint i = 0; i < n; i++)
+                distance[start + i * strides[axis]] = result[i];
+        }
+    }
+}
+
+//////////////////////////////////////
+// voxelization functions
+
+// collect the triangles of the meshes and build their BVH
+TriangleBVH BuildTriangleBVH(const vector<Mesh>& meshes)
+{
+    std::vector<glm::vec3> vertices;
+
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        for (size_t j = 0; j + 2 < meshes[i].indices.size(); j += 3)
+        {
+            for (GLuint v = 0; v < 3; v++)
+                vertices.push_back(meshes[i].vertices[meshes[i].indices[j + v]].Position);
+        }
+    }
+
+    return BuildTriangleBVH(vertices);
+}
+
+// build the BVH, sorting the triangles by leaf
+TriangleBVH BuildTriangleBVH(std::vector<glm::vec3> vertices)
+{
+    TriangleBVH bvh;
+
+    GLuint triangleCount = vertices.size() / 3;
+    if (triangleCount == 0)
+        return bvh;
+
+    std::vector<GLuint> triangles(triangleCount);
+    std::vector<glm::vec3> centroids(triangleCount);
+
+    for (GLuint i = 0; i < triangleCount; i++)
+    {
+        triangles[i] = i;
+        centroids[i] = (vertices[i * 3] + vertices[i * 3 + 1] + vertices[i * 3 + 2]) / 3.0f;
+    }
+
+    bvh.nodes.reserve(2 * triangleCount / BVH_LEAF_TRIANGLES + 1);
+    BuildNode(bvh, triangles, centroids, vertices, 0, triangleCount);
+
+    bvh.vertices.resize(vertices.size());
+
+    for (GLuint i = 0; i < triangleCount; i++)
+    {
+        for (GLuint v = 0; v < 3; v++)
+            bvh.vertices[i * 3 + v] = vertices[triangles[i] * 3 + v];
+    }
+
+    return bvh;
+}
+
+// same projection of the grid used by the GPU obstacle passes
+glm::mat4 GridViewProjection(const VoxelGrid& grid)
+{
+    glm::mat4 projection = glm::ortho(-grid.scale, grid.scale, -grid.scale, grid.scale, 1.0f, 100.0f);
+
+    glm::vec3 viewEye = grid.center;
+    viewEye.z += (grid.scale + 1.0f);
+
+    glm::vec3 viewCenter = grid.center;
+    viewCenter.x += glm::epsilon<float>(); // avoid gimbal lock
+    glm::mat4 view = glm::lookAt(viewEye, viewCenter, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    return projection * view;
+}
+
+// reset the fields to the empty grid with the borders
+void ClearObstacleFields(const VoxelGrid& grid, ObstacleFields& fields)
+{
+    size_t cells = (size_t) grid.width * grid.height * grid.depth;
+
+    fields.occupancy.assign(cells, 0.0f);
+    fields.velocity.assign(cells, glm::vec3(0.0f));
+
+    for (GLuint z = 0; z < grid.depth; z++)
+    {
+        for (GLuint y = 0; y < grid.height; y++)
+        {
+            for (GLuint x = 0; x < grid.width; x++)
+            {
+                if (IsBorderCell(grid, x, y, z))
+                    fields.occupancy[CellIndex(grid, x, y, z)] = 1.0f;
+            }
+        }
+    }
+}
+
+// voxelize the obstacle: each row of the grid is a line along x, transformed in model space and
+// intersected with the mesh. The winding number at a cell is the sum of the crossings before it
+void VoxelizeObstacleCPU(const TriangleBVH& bvh, glm::mat4 modelMatrix, glm::mat4 prevModelMatrix, GLfloat deltaTime, const VoxelGrid& grid, ObstacleFields& fields)
+{
+    if (grid.width < 3 || grid.height < 3 || grid.depth < 3)
+        return;
+
+    glm::mat4 inverseModel = glm::inverse(modelMatrix);
+    glm::mat4 prevFromCurrent = prevModelMatrix * inverseModel;
+    glm::mat4 viewProjection = GridViewProjection(grid);
+
+    // the line direction is the x axis of the grid, so the intersection parameter is the world distance along the row
+    glm::vec3 direction = glm::vec3(inverseModel * glm::vec4(1.0f, 0.0f, 0.0f, 0.0f));
+    GLfloat cellSize = 2.0f * grid.scale / grid.width;
+
+    // only the inner cells are written, the borders stay as obstacle
+    GLuint rows = (grid.height - 2) * (grid.depth - 2);
+
+    auto voxelizeRows = [&](GLuint firstRow, GLuint rowStep)
+    {
+        std::vector<RowHit> hits;
+
+        for (GLuint row = firstRow; row < rows; row += rowStep)
+        {
+            GLuint y = 1 + row % (grid.height - 2);
+            GLuint z = 1 + row / (grid.height - 2);
+
+            // the layers go from the front face of the grid to the back face, as the slices of the GPU voxelization
+            glm::vec3 rowStart = grid.center + glm::vec3(-grid.scale,
+                                                         (2.0f * (y + 0.5f) / grid.height - 1.0f) * grid.scale,
+                                                         grid.scale - 2.0f * grid.scale * (z + 1.0f) / grid.depth);
+
+            IntersectLine(bvh, glm::vec3(inverseModel * glm::vec4(rowStart, 1.0f)), direction, hits);
+
+            if (hits.empty())
+                continue;
+
+            size_t nextHit = 0;
+            GLint winding = 0;
+
+            for (GLuint x = 1; x < grid.width - 1; x++)
+            {
+                GLfloat t = (x + 0.5f) * cellSize;
+
+                while (nextHit < hits.size() && hits[nextHit].t < t)
+                    winding += hits[nextHit++].winding;
+
+                if (winding <= 0)
+                    continue;
+
+                glm::vec4 world = glm::vec4(rowStart.x + t, rowStart.y, rowStart.z, 1.0f);
+                glm::vec4 prevWorld = prevFromCurrent * world;
+
+                size_t cell = CellIndex(grid, x, y, z);
+                fields.occupancy[cell] = 1.0f;
+                fields.velocity[cell] = glm::vec3(viewProjection * (world - prevWorld)) / deltaTime;
+            }
+        }
+    };
+
+    // each worker writes its own rows, so the workers don't need synchronization
+    GLuint workerCount = std::max(1u, std::min(std::thread::hardware_concurrency(), rows));
+    std::vector<std::thread> workers;
+
+    for (GLuint i = 1; i < workerCount; i++)
+        workers.push_back(std::thread(voxelizeRows, i, workerCount));
+
+    voxelizeRows(0, workerCount);
+
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+// signed distance from the distance transforms of the occupied and free voxels
+void SignedDistanceField(const std::vector<GLfloat>& occupancy, GLuint width, GLuint height, GLuint depth, std::vector<GLfloat>& distance)
+{
+    std::vector<GLfloat> toOccupied, toFree;
+
+    SquaredDistanceToVoxels(occupancy, true, width, height, depth, toOccupied);
+    SquaredDistanceToVoxels(occupancy, false, width, height, depth, toFree);
+
+    // without occupied (or free) voxels, the distance stays as large as the volume
+    GLfloat maxDistance = (GLfloat) (width + height + depth);
+
+    distance.resize(occupancy.size());
+    for (size_t i = 0; i < occupancy.size(); i++)
+    {
+        if (occupancy[i] > 0.0f)
+            distance[i] = -(std::min(std::sqrt(toFree[i]), maxDistance) - 0.5f);
+        else
+            distance[i] = std::min(std::sqrt(toOccupied[i]), maxDistance) - 0.5f;
+    }
+}
+
+// compare the fields cell by cell
+void CompareObstacleFields(const ObstacleFields& reference, const ObstacleFields& fields, const VoxelGrid& grid)
+{
+    size_t cells = (size_t) grid.width * grid.height * grid.depth;
+
+    if (reference.occupancy.size() != cells || fields.occupancy.size() != cells || fields.velocity.size() != cells)
+    {
+        std::cout << "Obstacle validation: the fields don't match the grid size" << std::endl;
+        return;
+    }
+
+    size_t referenceCells = 0, missingCells = 0, extraCells = 0;
+    GLfloat maxVelocityError = 0.0f;
+
+    for (size_t i = 0; i < cells; i++)
+    {
+        bool inReference = reference.occupancy[i] > 0.0f;
+        bool inFields = fields.occupancy[i] > 0.0f;
+
+        referenceCells += inReference;
+
+        if (inReference && !inFields)
+            missingCells++;
+        else if (!inReference && inFields)
+            extraCells++;
+        else if (inReference && inFields)
+            maxVelocityError = std::max(maxVelocityError, glm::length(reference.velocity[i] - fields.velocity[i]));
+    }
+
+    std::cout << "Obstacle validation: " << referenceCells << " obstacle cells in the reference, " << missingCells << " missing, "
+              << extraCells << " extra, max velocity error " << maxVelocityError << std::endl;
+}
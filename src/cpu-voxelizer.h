@@ -0,0 +1,85 @@
+#include <glad/glad.h>
+
+// Std. Includes
+#include <vector>
+#include <iostream>
+
+// we load the GLM classes used in the application
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// classes developed during lab lectures to load models
+#include <utils/model.h>
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the structures for the CPU voxelization
+
+// triangles of a leaf of the BVH
+const GLuint BVH_LEAF_TRIANGLES = 4;
+
+// simulation grid where the obstacles are voxelized, with the same placement of the GPU obstacle buffers:
+// a cube with half edge equal to the scale, centered in the fluid translation
+struct VoxelGrid
+{
+    GLuint width;
+    GLuint height;
+    GLuint depth;
+    glm::vec3 center;
+    GLfloat scale;
+};
+
+// obstacle fields of the grid, with the same content of the obstacle position and velocity buffers.
+// The cells are stored by rows along x, then by y and by layer
+struct ObstacleFields
+{
+    std::vector<GLfloat> occupancy;
+    std::vector<glm::vec3> velocity;
+};
+
+// bounding volume hierarchy of the triangles of a model, in model space
+struct TriangleBVH
+{
+    // node of the tree: internal nodes have the left child next to them and the index of the right child,
+    // leaves have the range of their triangles
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        GLuint rightChild;
+        GLuint firstTriangle;
+        GLuint triangleCount; // 0 for internal nodes
+    };
+
+    std::vector<Node> nodes;
+    std::vector<glm::vec3> vertices; // 3 vertices for each triangle, sorted by leaf
+};
+
+/////////////////////////////////////////////
+// we define the CPU voxelization functions. They don't use OpenGL, so they can be used without a GPU
+
+// build the BVH of the triangles of the meshes
+TriangleBVH BuildTriangleBVH(const vector<Mesh>& meshes);
+
+// build the BVH of the given triangles (3 vertices for each triangle)
+TriangleBVH BuildTriangleBVH(std::vector<glm::vec3> vertices);
+
+// view projection matrix of the grid, used to express the obstacle velocity in the same space of the GPU buffers
+glm::mat4 GridViewProjection(const VoxelGrid& grid);
+
+// reset the fields to the empty grid, with the borders marked as obstacle
+void ClearObstacleFields(const VoxelGrid& grid, ObstacleFields& fields);
+
+// voxelize the obstacle in the inner cells of the grid: a cell is inside the obstacle if the winding number of the
+// mesh along its row is positive. The velocity is the rigid motion between the previous and current model matrices.
+// The rows of the grid are split among worker threads
+void VoxelizeObstacleCPU(const TriangleBVH& bvh, glm::mat4 modelMatrix, glm::mat4 prevModelMatrix, GLfloat deltaTime, const VoxelGrid& grid, ObstacleFields& fields);
+
+// compute the signed distance of each voxel from the surface of the occupied voxels, in voxels (negative inside).
+// The surface is placed half a voxel away from the centers of the occupied voxels
+void SignedDistanceField(const std::vector<GLfloat>& occupancy, GLuint width, GLuint height, GLuint depth, std::vector<GLfloat>& distance);
+
+// compare the fields with the reference ones, printing the cells with a different occupancy
+// and the largest velocity difference in the cells occupied in both
+void CompareObstacleFields(const ObstacleFields& reference, const ObstacleFields& fields, const VoxelGrid& grid);
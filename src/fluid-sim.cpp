@@ -2,6 +2,10 @@
 
 // Std. Includes
 #include <string>
+#include <map>
+#include <limits>
+#include <algorithm>
+#include <cmath>
 #include <stdarg.h>
 
 //////////////////////////////////////
@@ -19,6 +23,82 @@ glm::vec3 InverseSize;
 GLuint quadVAO = 0;
 GLuint borderVAO = 0;
 
+// parameters shared by all the passes of a simulation step, stored in a uniform buffer
+// with std140 layout (a vec3 followed by a float fills a 16 bytes slot)
+struct SimulationParams
+{
+    glm::vec3 gridSize;
+    GLfloat timeStep;
+    glm::vec3 inverseSize;
+    GLfloat padding;
+};
+
+SimulationParams simulationParams;
+GLuint simulationParamsUBO = 0;
+
+// texture currently bound to each pass texture unit, used to skip redundant bindings
+struct TextureBinding
+{
+    GLenum target;
+    GLuint tex;
+};
+
+TextureBinding passTextures[PASS_TEXTURE_UNIT_COUNT];
+
+// pool of the free simulation grid slabs, recycled instead of being destroyed and created again
+struct FreeSlab
+{
+    Slab slab;
+    SlabDesc desc;
+};
+
+vector<FreeSlab> slabPool;
+
+// description of the slabs created through the pool, indexed by texture (the ping-pong swaps move
+// the texture together with its framebuffer, so the texture identifies the slab)
+map<GLuint, SlabDesc> pooledSlabDescs;
+
+// framebuffer used to write the rigid obstacles in the obstacle position and velocity buffers
+GLuint rigidObstacleFBO = 0;
+
+// uniform buffer with the parameters of the primitive obstacles of a batch
+GLuint obstaclePrimitivesUBO = 0;
+
+// pixel buffer where the occupancy volume is read back without waiting for the GPU, and fence of the last readback
+GLuint occupancyPBO = 0;
+GLsync occupancyFence = 0;
+
+// pixel buffer where the sum of the ray steps is read back, fence of the last readback and pixels of the summed texture
+GLuint rayStepsPBO = 0;
+GLsync rayStepsFence = 0;
+GLuint64 rayStepsPixels = 0;
+
+// indices of the raymarching subroutines of the rendering program, resolved once instead of searched by name at each frame
+GLuint raymarchingLiquidSubroutine = 0;
+GLuint raymarchingGasSubroutine = 0;
+
+// state of an obstacle when it was drawn in the obstacle buffers, used to redraw the buffers only when it changes
+struct DrawnObstacle
+{
+    ObstacleObject* obstacle;
+    GLuint voxelVolume;
+    glm::mat4 modelMatrix;
+    glm::mat4 prevModelMatrix;
+};
+
+// cells of the grid covered by an obstacle, enlarged by the band of its signed distance
+struct ObstacleCells
+{
+    ObstacleObject* obstacle;
+    glm::ivec3 cellMin; // x, y and layer of the first cell
+    glm::ivec3 cellMax; // x, y and layer of the last cell
+};
+
+vector<DrawnObstacle> drawnObstacles;
+glm::vec3 drawnTranslation;
+GLfloat drawnScale = 0.0f;
+bool obstacleBuffersDrawn = false;
+
 //////////////////////////////////////
 // utility functions
 
@@ -62,6 +142,40 @@ void CheckFramebufferStatus()
     }
 }
 
+// bind the texture to the unit reserved to the given sampler (or to the given element of a sampler array).
+// The binding is skipped if the texture is already bound there by a previous pass
+void BindPassTexture(PassSampler sampler, GLenum target, GLuint texture, GLuint element = 0)
+{
+    GLuint unit = sampler + element;
+
+    if (passTextures[unit].target == target && passTextures[unit].tex == texture)
+        return;
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, texture);
+
+    passTextures[unit] = {target, texture};
+}
+
+// forget the tracked texture bindings. This is needed when the texture units may have been
+// changed outside the passes (scene rendering, UI) or a tracked texture has been deleted
+void ResetPassTextures()
+{
+    for (GLuint i = 0; i < PASS_TEXTURE_UNIT_COUNT; i++)
+        passTextures[i] = {0, 0};
+}
+
+// upload the shared simulation parameters in the uniform buffer
+void UpdateSimulationParams()
+{
+    if (simulationParamsUBO == 0)
+        return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, simulationParamsUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SimulationParams), &simulationParams);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 //////////////////////////////////////
 // we define the utility functions for the simulation 
 
@@ -78,15 +192,20 @@ Slab CreateSlab(GLuint width, GLuint height, GLuint depth, GLushort dimensions)
 
     glBindTexture(GL_TEXTURE_3D, texture);
 
+    GLenum internalFormat;
+
     switch(dimensions)
     {
-        case 1: glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, width, height, depth, 0, GL_RED, GL_HALF_FLOAT, NULL); break;
-        case 2: glTexImage3D(GL_TEXTURE_3D, 0, GL_RG16F, width, height, depth, 0, GL_RG, GL_HALF_FLOAT, NULL); break;
-        case 3: glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, width, height, depth, 0, GL_RGB, GL_HALF_FLOAT, NULL); break;
-        case 4: glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, width, height, depth, 0, GL_RGBA, GL_HALF_FLOAT, NULL); break;
+        case 1: internalFormat = GL_R16F; glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, width, height, depth, 0, GL_RED, GL_HALF_FLOAT, NULL); break;
+        case 2: internalFormat = GL_RG16F; glTexImage3D(GL_TEXTURE_3D, 0, GL_RG16F, width, height, depth, 0, GL_RG, GL_HALF_FLOAT, NULL); break;
+        case 3: internalFormat = GL_RGB16F; glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, width, height, depth, 0, GL_RGB, GL_HALF_FLOAT, NULL); break;
+        case 4: internalFormat = GL_RGBA16F; glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, width, height, depth, 0, GL_RGBA, GL_HALF_FLOAT, NULL); break;
         default: std::cout << "Invalid number of dimensions for the texture" << std::endl; return {0, 0};
     }
 
+    RegisterTexture(texture, internalFormat, width, height, depth);
+    RegisterFramebuffer(fbo);
+
     // we set the texture filters to linear interpolation
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -121,15 +240,20 @@ Slab Create2DSlab(GLuint width, GLuint height, GLushort dimensions, bool filter)
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
 
+    GLenum internalFormat;
+
     switch(dimensions)
     {
-        case 1: glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL); break;
-        case 2: glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, NULL); break;
-        case 3: glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, NULL); break;
-        case 4: glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL); break;
+        case 1: internalFormat = GL_R32F; glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL); break;
+        case 2: internalFormat = GL_RG32F; glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, NULL); break;
+        case 3: internalFormat = GL_RGB32F; glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, NULL); break;
+        case 4: internalFormat = GL_RGBA32F; glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL); break;
         default: std::cout << "Invalid number of dimensions for the texture" << std::endl; return {0, 0};
     }
 
+    RegisterTexture(texture, internalFormat, width, height, 1);
+    RegisterFramebuffer(fbo);
+
     // we set the texture filters to linear interpolation or nearest neighbor
     if (filter)
     {
@@ -162,8 +286,63 @@ Slab Create2DSlab(GLuint width, GLuint height, GLushort dimensions, bool filter)
 // destroy the given slab
 void DestroySlab(Slab & slab)
 {
+    UnregisterAllocation(GL_FRAMEBUFFER, slab.fbo);
+    UnregisterAllocation(GL_TEXTURE, slab.tex);
+
     glDeleteFramebuffers(1, &slab.fbo);
     glDeleteTextures(1, &slab.tex);
+
+    // a new texture could reuse the deleted name
+    ResetPassTextures();
+}
+
+// get a free slab with the given description from the pool, or create a new one. A recycled slab is
+// cleared, so it has the same content of a new one
+Slab AcquireSlab(SlabDesc desc)
+{
+    for (size_t i = 0; i < slabPool.size(); i++)
+    {
+        if (slabPool[i].desc == desc)
+        {
+            Slab slab = slabPool[i].slab;
+            slabPool.erase(slabPool.begin() + i);
+
+            ClearSlabs(1, &slab);
+
+            return slab;
+        }
+    }
+
+    Slab slab = CreateSlab(desc.width, desc.height, desc.depth, desc.dimensions);
+    pooledSlabDescs[slab.tex] = desc;
+
+    return slab;
+}
+
+// give back the slab to the pool. A slab not created by the pool is left to its owner, since
+// the pool can't know who else is still using it
+void ReleaseSlab(Slab &slab)
+{
+    map<GLuint, SlabDesc>::iterator it = pooledSlabDescs.find(slab.tex);
+
+    if (it == pooledSlabDescs.end())
+        std::cout << "ERROR::SLAB_POOL:: slab {" << slab.fbo << " , " << slab.tex << "} not created by the pool" << std::endl;
+    else
+        slabPool.push_back({slab, it->second});
+
+    slab = {0, 0};
+}
+
+// destroy the free slabs of the pool
+void ClearSlabPool()
+{
+    for (size_t i = 0; i < slabPool.size(); i++)
+    {
+        pooledSlabDescs.erase(slabPool[i].slab.tex);
+        DestroySlab(slabPool[i].slab);
+    }
+
+    slabPool.clear();
 }
 
 // clear the given slabs
@@ -215,12 +394,54 @@ Scene CreateScene(GLuint width, GLuint height)
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex, 0);
 
+    RegisterTexture(colorTex, GL_RGBA, width, height, 1);
+    RegisterTexture(depthTex, GL_DEPTH_COMPONENT, width, height, 1);
+    RegisterFramebuffer(fbo);
+
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     return {fbo, colorTex, depthTex};
 }
 
+// destroy the framebuffer and the textures of the scene
+void DestroyScene(Scene &scene)
+{
+    UnregisterAllocation(GL_FRAMEBUFFER, scene.fbo);
+    UnregisterAllocation(GL_TEXTURE, scene.colorTex);
+    UnregisterAllocation(GL_TEXTURE, scene.depthTex);
+
+    glDeleteFramebuffers(1, &scene.fbo);
+    glDeleteTextures(1, &scene.colorTex);
+    glDeleteTextures(1, &scene.depthTex);
+
+    // a new texture could reuse the deleted names
+    ResetPassTextures();
+}
+
+// create the blue noise texture, generated on the CPU. The texture is repeated over the screen,
+// and it's read without filtering to keep the distribution of the values
+GLuint CreateBlueNoiseTexture(GLuint size)
+{
+    std::vector<GLfloat> noise = GenerateBlueNoise(size);
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, noise.data());
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    RegisterTexture(texture, GL_R32F, size, size, 1);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}
+
 // swap the simulation grid slabs. This is used due to the ping-pong method 
 // (use the previous result as the input for the next iteration, so two slabs are needed due to 
 // openGL's framebuffer binding)
@@ -243,6 +464,10 @@ void SetGridSize(GLuint width, GLuint height, GLuint depth)
     GRID_DEPTH = depth;
 
     InverseSize = glm::vec3(1.0f / width, 1.0f / height, 1.0f / depth);
+
+    simulationParams.gridSize = glm::vec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH);
+    simulationParams.inverseSize = InverseSize;
+    UpdateSimulationParams();
 }
 
 // create the quad vao for rendering
@@ -262,6 +487,7 @@ void CreateQuadVAO()
     glGenBuffers(1, &quad_VBO);
     glBindBuffer(GL_ARRAY_BUFFER, quad_VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
+    RegisterBuffer(quad_VBO, sizeof(positions));
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_SHORT, GL_FALSE, 2 * sizeof(short), 0);
@@ -293,6 +519,7 @@ void CreateBorderVAO()
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
+    RegisterBuffer(vbo, sizeof(positions));
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0);
@@ -309,11 +536,28 @@ void InitSimulationVAOs()
 
     // create the border vao (lines strip)
     CreateBorderVAO();
+
+    // create the uniform buffer for the shared simulation parameters, and bind it
+    // to the binding point used by the pass shaders
+    glGenBuffers(1, &simulationParamsUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, simulationParamsUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(SimulationParams), &simulationParams, GL_DYNAMIC_DRAW);
+    RegisterBuffer(simulationParamsUBO, sizeof(SimulationParams));
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, SIMULATION_PARAMS_BINDING, simulationParamsUBO);
 }
 
 // setup vars to start simulation phase
-void BeginSimulation()
+void BeginSimulation(GLfloat timeStep)
 {
+    // update the per-step parameters once for all the passes of the step
+    simulationParams.timeStep = timeStep;
+    UpdateSimulationParams();
+    glBindBufferBase(GL_UNIFORM_BUFFER, SIMULATION_PARAMS_BINDING, simulationParamsUBO);
+
+    ResetPassTextures();
+
     glBindVertexArray(quadVAO);
     glViewport(0,0, GRID_WIDTH, GRID_HEIGHT);
     glDisable(GL_DEPTH_TEST);
@@ -330,34 +574,24 @@ void EndSimulation()
 ///////////////////////////////////////////
 
 // execute advection with semi-Lagrangian method
-void Advect(Shader &advectionShader, Slab &velocity, ObstacleSlab &obstacle, Slab &source, Slab &dest, float dissipation, float timeStep)
+void Advect(PassShader &advectionShader, Slab &velocity, ObstacleSlab &obstacle, Slab &source, Slab &dest, float dissipation, float timeStep)
 {
     advectionShader.Use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, velocity.tex);
-    glUniform1i(glGetUniformLocation(advectionShader.Program, "VelocityTexture"), 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, source.tex);
-    glUniform1i(glGetUniformLocation(advectionShader.Program, "SourceTexture"), 1);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_3D, obstacle.tex);
-    glUniform1i(glGetUniformLocation(advectionShader.Program, "ObstacleTexture"), 2);
-
-    glUniform1f(glGetUniformLocation(advectionShader.Program, "timeStep"), timeStep);
-    glUniform3fv(glGetUniformLocation(advectionShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
-    glUniform1f(glGetUniformLocation(advectionShader.Program, "dissipation"), dissipation);
+    BindPassTexture(S_VELOCITY, GL_TEXTURE_3D, velocity.tex);
+    BindPassTexture(S_SOURCE, GL_TEXTURE_3D, source.tex);
+    BindPassTexture(S_OBSTACLE, GL_TEXTURE_3D, obstacle.tex);
+    BindPassTexture(S_OBSTACLE_DISTANCE, GL_TEXTURE_3D, obstacle.distanceTex);
 
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
+    glUniform1f(advectionShader.Locations[U_TIME_STEP], timeStep);
+    glUniform1f(advectionShader.Locations[U_DISSIPATION], dissipation);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_3D, 0);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 }
 
 // execute advection with MacCormack method: allows to reduce the error compared to semi-Lagrangian method for the same grid resolution
-void AdvectMacCormack(Shader &advectionShader, Shader &macCormackShader, Slab &velocity, Slab &phi1_hat, Slab &phi2_hat, ObstacleSlab &obstacle, Slab & source, Slab & dest, float dissipation, float timeStep)
+void AdvectMacCormack(PassShader &advectionShader, PassShader &macCormackShader, Slab &velocity, Slab &phi1_hat, Slab &phi2_hat, ObstacleSlab &obstacle, Slab & source, Slab & dest, float dissipation, float timeStep)
 {
     // use the semi-Lagrangian advection as base for the MacCormack method
 
@@ -373,225 +607,145 @@ void AdvectMacCormack(Shader &advectionShader, Shader &macCormackShader, Slab &v
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, velocity.tex);
-    glUniform1i(glGetUniformLocation(macCormackShader.Program, "VelocityTexture"), 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, phi1_hat.tex);
-    glUniform1i(glGetUniformLocation(macCormackShader.Program, "Phi1HatTexture"), 1);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_3D, phi2_hat.tex);
-    glUniform1i(glGetUniformLocation(macCormackShader.Program, "Phi2HatTexture"), 2);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_3D, source.tex);
-    glUniform1i(glGetUniformLocation(macCormackShader.Program, "SourceTexture"), 3);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_3D, obstacle.tex);
-    glUniform1i(glGetUniformLocation(macCormackShader.Program, "ObstacleTexture"), 4);
-
-    glUniform1f(glGetUniformLocation(macCormackShader.Program, "timeStep"), timeStep);
-    glUniform3fv(glGetUniformLocation(macCormackShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
-    glUniform1f(glGetUniformLocation(macCormackShader.Program, "dissipation"), dissipation);
+    BindPassTexture(S_VELOCITY, GL_TEXTURE_3D, velocity.tex);
+    BindPassTexture(S_PHI1_HAT, GL_TEXTURE_3D, phi1_hat.tex);
+    BindPassTexture(S_PHI2_HAT, GL_TEXTURE_3D, phi2_hat.tex);
+    BindPassTexture(S_SOURCE, GL_TEXTURE_3D, source.tex);
+    BindPassTexture(S_OBSTACLE, GL_TEXTURE_3D, obstacle.tex);
+    BindPassTexture(S_OBSTACLE_DISTANCE, GL_TEXTURE_3D, obstacle.distanceTex);
 
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
+    glUniform1f(macCormackShader.Locations[U_TIME_STEP], timeStep);
+    glUniform1f(macCormackShader.Locations[U_DISSIPATION], dissipation);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE4); glBindTexture(GL_TEXTURE_3D, 0);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
     SwapSlabs(source, dest);
 }
 
 // compute and apply the buoyancy force to the velocity field of the gas
 // simulate the effect of temperature and density on the velocity field
-void Buoyancy(Shader &buoyancyShader, Slab &velocity, Slab &temperature, Slab &density, Slab &dest, float ambientTemperature, float timeStep, float sigma, float kappa)
+void Buoyancy(PassShader &buoyancyShader, Slab &velocity, Slab &temperature, Slab &density, Slab &dest, float ambientTemperature, float sigma, float kappa)
 {
     buoyancyShader.Use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, velocity.tex);
-    glUniform1i(glGetUniformLocation(buoyancyShader.Program, "VelocityTexture"), 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, temperature.tex);
-    glUniform1i(glGetUniformLocation(buoyancyShader.Program, "TemperatureTexture"), 1);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_3D, density.tex);
-    glUniform1i(glGetUniformLocation(buoyancyShader.Program, "DensityTexture"), 2);
-
-    glUniform1f(glGetUniformLocation(buoyancyShader.Program, "timeStep"), timeStep);
-    glUniform1f(glGetUniformLocation(buoyancyShader.Program, "ambientTemperature"), ambientTemperature);
-    glUniform1f(glGetUniformLocation(buoyancyShader.Program, "gasBuoyancy"), sigma);
-    glUniform1f(glGetUniformLocation(buoyancyShader.Program, "gasWeight"), kappa);
-    glUniform3fv(glGetUniformLocation(buoyancyShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
+    BindPassTexture(S_VELOCITY, GL_TEXTURE_3D, velocity.tex);
+    BindPassTexture(S_TEMPERATURE, GL_TEXTURE_3D, temperature.tex);
+    BindPassTexture(S_DENSITY, GL_TEXTURE_3D, density.tex);
 
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
+    glUniform1f(buoyancyShader.Locations[U_AMBIENT_TEMPERATURE], ambientTemperature);
+    glUniform1f(buoyancyShader.Locations[U_GAS_BUOYANCY], sigma);
+    glUniform1f(buoyancyShader.Locations[U_GAS_WEIGHT], kappa);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_3D, 0);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
     SwapSlabs(velocity, dest);
 }
 
 // apply external forces to the velocity field
-void ApplyExternalForces(Shader &externalForcesShader, Slab &velocity, Slab &dest, float timeStep, glm::vec3 force, glm::vec3 position, float radius)
+void ApplyExternalForces(PassShader &externalForcesShader, Slab &velocity, Slab &dest, glm::vec3 force, glm::vec3 position, float radius)
 {
     externalForcesShader.Use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, velocity.tex);
-    glUniform1i(glGetUniformLocation(externalForcesShader.Program, "VelocityTexture"), 0);
-    glUniform1f(glGetUniformLocation(externalForcesShader.Program, "timeStep"), timeStep);
-    glUniform3fv(glGetUniformLocation(externalForcesShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
-    glUniform3fv(glGetUniformLocation(externalForcesShader.Program, "force"), 1, glm::value_ptr(force));
-    glUniform3fv(glGetUniformLocation(externalForcesShader.Program, "center"), 1, glm::value_ptr(position));
-    glUniform1f(glGetUniformLocation(externalForcesShader.Program, "radius"), radius);
+    BindPassTexture(S_VELOCITY, GL_TEXTURE_3D, velocity.tex);
+    glUniform3fv(externalForcesShader.Locations[U_FORCE], 1, glm::value_ptr(force));
+    glUniform3fv(externalForcesShader.Locations[U_CENTER], 1, glm::value_ptr(position));
+    glUniform1f(externalForcesShader.Locations[U_RADIUS], radius);
 
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-
     SwapSlabs(velocity, dest);
 }
 
 // emit fluid into the density field at a given position
-void AddDensity(Shader &dyeShader, Slab &density, Slab &dest, glm::vec3 position, float radius, float color, GLboolean isLiquidSimulation)
+void AddDensity(PassShader &dyeShader, Slab &density, Slab &dest, glm::vec3 position, float radius, float color, GLboolean isLiquidSimulation)
 {
     dyeShader.Use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, density.tex);
-    glUniform1i(glGetUniformLocation(dyeShader.Program, "DensityTexture"), 0);
-    glUniform3fv(glGetUniformLocation(dyeShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
-    glUniform3fv(glGetUniformLocation(dyeShader.Program, "center"), 1, glm::value_ptr(position));
-    glUniform1f(glGetUniformLocation(dyeShader.Program, "radius"), radius);
-    glUniform1f(glGetUniformLocation(dyeShader.Program, "dyeIntensity"), color);
-    glUniform1i(glGetUniformLocation(dyeShader.Program, "isLiquidSimulation"), isLiquidSimulation);
+    BindPassTexture(S_DENSITY, GL_TEXTURE_3D, density.tex);
+    glUniform3fv(dyeShader.Locations[U_CENTER], 1, glm::value_ptr(position));
+    glUniform1f(dyeShader.Locations[U_RADIUS], radius);
+    glUniform1f(dyeShader.Locations[U_DYE_INTENSITY], color);
+    glUniform1i(dyeShader.Locations[U_IS_LIQUID_SIMULATION], isLiquidSimulation);
 
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-
     SwapSlabs(density, dest);
 }
 
 // increase the temperature of the fluid at a given position
-void AddTemperature(Shader &dyeShader, Slab &temperature, Slab &dest, glm::vec3 position, float radius, float appliedTemperature)
+void AddTemperature(PassShader &dyeShader, Slab &temperature, Slab &dest, glm::vec3 position, float radius, float appliedTemperature)
 {
     dyeShader.Use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, temperature.tex);
-    glUniform1i(glGetUniformLocation(dyeShader.Program, "TemperatureTexture"), 0);
-    glUniform3fv(glGetUniformLocation(dyeShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
-    glUniform3fv(glGetUniformLocation(dyeShader.Program, "center"), 1, glm::value_ptr(position));
-    glUniform1f(glGetUniformLocation(dyeShader.Program, "radius"), radius);
-    glUniform1f(glGetUniformLocation(dyeShader.Program, "temperature"), appliedTemperature);
+    BindPassTexture(S_TEMPERATURE, GL_TEXTURE_3D, temperature.tex);
+    glUniform3fv(dyeShader.Locations[U_CENTER], 1, glm::value_ptr(position));
+    glUniform1f(dyeShader.Locations[U_RADIUS], radius);
+    glUniform1f(dyeShader.Locations[U_TEMPERATURE], appliedTemperature);
 
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-
     SwapSlabs(temperature, dest);
 }
 
 // compute the divergence of the velocity field
-void Divergence(Shader &divergenceShader, Slab &velocity, Slab &divergence, ObstacleSlab &obstacle, Slab &obstacleVelocity, Slab &dest)
+void Divergence(PassShader &divergenceShader, Slab &velocity, Slab &divergence, ObstacleSlab &obstacle, Slab &obstacleVelocity, Slab &dest)
 {
     divergenceShader.Use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, velocity.tex);
-    glUniform1i(glGetUniformLocation(divergenceShader.Program, "VelocityTexture"), 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, obstacle.tex);
-    glUniform1i(glGetUniformLocation(divergenceShader.Program, "ObstacleTexture"), 1);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_3D, obstacleVelocity.tex);
-    glUniform1i(glGetUniformLocation(divergenceShader.Program, "ObstacleVelocityTexture"), 2);
-
-    glUniform3fv(glGetUniformLocation(divergenceShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
+    BindPassTexture(S_VELOCITY, GL_TEXTURE_3D, velocity.tex);
+    BindPassTexture(S_OBSTACLE, GL_TEXTURE_3D, obstacle.tex);
+    BindPassTexture(S_OBSTACLE_VELOCITY, GL_TEXTURE_3D, obstacleVelocity.tex);
 
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_3D, 0);
-
     SwapSlabs(divergence, dest);
 }
 
 // execute jacobi iterations to solve the pressure equation
-void Jacobi(Shader &jacobiShader, Slab &pressure, Slab &divergence, ObstacleSlab &obstacle, Slab &dest, GLuint iterations)
+void Jacobi(PassShader &jacobiShader, Slab &pressure, Slab &divergence, ObstacleSlab &obstacle, Slab &dest, GLuint iterations)
 {
     jacobiShader.Use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, pressure.fbo);
     glClear(GL_COLOR_BUFFER_BIT);
 
+    // divergence and obstacles don't change during the iterations, so they are bound only once
+    BindPassTexture(S_DIVERGENCE, GL_TEXTURE_3D, divergence.tex);
+    BindPassTexture(S_OBSTACLE, GL_TEXTURE_3D, obstacle.tex);
+
     for (GLuint i = 0; i < iterations; i++)
     {
         glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_3D, pressure.tex);
-        glUniform1i(glGetUniformLocation(jacobiShader.Program, "Pressure"), 0);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_3D, divergence.tex);
-        glUniform1i(glGetUniformLocation(jacobiShader.Program, "Divergence"), 1);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_3D, obstacle.tex);
-        glUniform1i(glGetUniformLocation(jacobiShader.Program, "Obstacle"), 2);
-
-        glUniform3fv(glGetUniformLocation(jacobiShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
+        BindPassTexture(S_PRESSURE, GL_TEXTURE_3D, pressure.tex);
 
         glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
         SwapSlabs(pressure, dest);
     }
-
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_3D, 0);
 }
 
 
 // apply pressure projection to the velocity field
-void ApplyPressure(Shader &pressureShader, Slab &velocity, Slab &pressure, ObstacleSlab &obstacle, Slab &obstacleVelocity, Slab &dest)
+void ApplyPressure(PassShader &pressureShader, Slab &velocity, Slab &pressure, ObstacleSlab &obstacle, Slab &obstacleVelocity, Slab &dest)
 {
     pressureShader.Use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, velocity.tex);
-    glUniform1i(glGetUniformLocation(pressureShader.Program, "VelocityTexture"), 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, pressure.tex);
-    glUniform1i(glGetUniformLocation(pressureShader.Program, "PressureTexture"), 1);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_3D, obstacle.tex);
-    glUniform1i(glGetUniformLocation(pressureShader.Program, "ObstacleTexture"), 2);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_3D, obstacleVelocity.tex);
-    glUniform1i(glGetUniformLocation(pressureShader.Program, "ObstacleVelocityTexture"), 3);
-
-    glUniform3fv(glGetUniformLocation(pressureShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
+    BindPassTexture(S_VELOCITY, GL_TEXTURE_3D, velocity.tex);
+    BindPassTexture(S_PRESSURE, GL_TEXTURE_3D, pressure.tex);
+    BindPassTexture(S_OBSTACLE, GL_TEXTURE_3D, obstacle.tex);
+    BindPassTexture(S_OBSTACLE_VELOCITY, GL_TEXTURE_3D, obstacleVelocity.tex);
+    BindPassTexture(S_OBSTACLE_DISTANCE, GL_TEXTURE_3D, obstacle.distanceTex);
 
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_3D, 0);
-
     SwapSlabs(velocity, dest);
 }
 
@@ -602,8 +756,13 @@ void ApplyPressure(Shader &pressureShader, Slab &velocity, Slab &pressure, Obsta
 // the front buffer is used to gather information about the initial ray position in the volume
 // and flags position where the volume is occluded by an obstacle.
 // the back buffer is used to gather information about the final ray position and volume backface depth for scene blending.
-void RayData(Shader &backShader, Shader &frontShader, Model &cubeModel, Slab &back, Slab &front, Scene &scene, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, glm::vec2 inverseScreenSize)
+// the cube is rasterized only in the given bounds, which cover the region of the grid with fluid, so the pixels
+// and the rays outside the fluid are not marched.
+void RayData(PassShader &backShader, PassShader &frontShader, Model &cubeModel, glm::vec3 rayBoundsMin, glm::vec3 rayBoundsMax, Slab &back, Slab &front, Scene &scene, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, glm::vec2 inverseScreenSize)
 {
+    // the scene rendering binds its own textures, so the tracked bindings are no longer valid
+    ResetPassTextures();
+
     // draw back raydata
 
     glEnable(GL_CULL_FACE);
@@ -613,15 +772,15 @@ void RayData(Shader &backShader, Shader &frontShader, Model &cubeModel, Slab &ba
     glBindFramebuffer(GL_FRAMEBUFFER, back.fbo);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, scene.depthTex);
-    glUniform1i(glGetUniformLocation(backShader.Program, "SceneDepthTexture"), 0);
+    BindPassTexture(S_SCENE_DEPTH, GL_TEXTURE_2D, scene.depthTex);
 
-    glUniformMatrix4fv(glGetUniformLocation(backShader.Program, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(glGetUniformLocation(backShader.Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(backShader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glUniform3fv(glGetUniformLocation(backShader.Program, "grid_size"), 1, glm::value_ptr(glm::vec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH)));
-    glUniform2fv(glGetUniformLocation(backShader.Program, "InverseSize"), 1, glm::value_ptr(inverseScreenSize));
+    glUniformMatrix4fv(backShader.Locations[U_MODEL], 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(backShader.Locations[U_VIEW], 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(backShader.Locations[U_PROJECTION], 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform3fv(backShader.Locations[U_GRID_SIZE], 1, glm::value_ptr(glm::vec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH)));
+    glUniform2fv(backShader.Locations[U_INVERSE_SCREEN_SIZE], 1, glm::value_ptr(inverseScreenSize));
+    glUniform3fv(backShader.Locations[U_BOUNDS_MIN], 1, glm::value_ptr(rayBoundsMin));
+    glUniform3fv(backShader.Locations[U_BOUNDS_MAX], 1, glm::value_ptr(rayBoundsMax));
 
     glCullFace(GL_FRONT);
 
@@ -634,143 +793,545 @@ void RayData(Shader &backShader, Shader &frontShader, Model &cubeModel, Slab &ba
     glBindFramebuffer(GL_FRAMEBUFFER, front.fbo);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, back.tex);
-    glUniform1i(glGetUniformLocation(frontShader.Program, "RayDataTexture"), 0);
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, scene.depthTex);
-    glUniform1i(glGetUniformLocation(frontShader.Program, "SceneDepthTexture"), 1);
+    BindPassTexture(S_RAYDATA, GL_TEXTURE_2D, back.tex);
+    BindPassTexture(S_SCENE_DEPTH, GL_TEXTURE_2D, scene.depthTex);
 
-    glUniformMatrix4fv(glGetUniformLocation(frontShader.Program, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(glGetUniformLocation(frontShader.Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(frontShader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glUniform3fv(glGetUniformLocation(frontShader.Program, "grid_size"), 1, glm::value_ptr(glm::vec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH)));
-    glUniform2fv(glGetUniformLocation(frontShader.Program, "InverseSize"), 1, glm::value_ptr(inverseScreenSize));
+    glUniformMatrix4fv(frontShader.Locations[U_MODEL], 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(frontShader.Locations[U_VIEW], 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(frontShader.Locations[U_PROJECTION], 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform3fv(frontShader.Locations[U_GRID_SIZE], 1, glm::value_ptr(glm::vec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH)));
+    glUniform2fv(frontShader.Locations[U_INVERSE_SCREEN_SIZE], 1, glm::value_ptr(inverseScreenSize));
+    glUniform3fv(frontShader.Locations[U_BOUNDS_MIN], 1, glm::value_ptr(rayBoundsMin));
+    glUniform3fv(frontShader.Locations[U_BOUNDS_MAX], 1, glm::value_ptr(rayBoundsMax));
 
     glCullFace(GL_BACK);
 
     cubeModel.Draw();
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D, 0);
-
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glDisable(GL_CULL_FACE);
 }
 
 /////////////////////// RENDERING //////////////////////////
 
+// size of the occupancy volume: a voxel for each block of OCCUPANCY_BLOCK_SIZE cells, rounded up
+glm::uvec3 OccupancyGridSize(GLuint width, GLuint height, GLuint depth)
+{
+    return (glm::uvec3(width, height, depth) + OCCUPANCY_BLOCK_SIZE - 1u) / OCCUPANCY_BLOCK_SIZE;
+}
+
+// build the occupancy volume used by the raymarcher to skip the empty space: each voxel stores the
+// minimum and maximum density of a block of the grid, enlarged by the cells read by the filtered samples.
+// the volume is built after each simulation step, so it follows the density used by the rendering
+void BuildOccupancy(PassShader &occupancyShader, Slab &density, Slab &occupancy)
+{
+    glm::uvec3 size = OccupancyGridSize((GLuint) GRID_WIDTH, (GLuint) GRID_HEIGHT, (GLuint) GRID_DEPTH);
+
+    occupancyShader.Use();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, occupancy.fbo);
+    glViewport(0, 0, size.x, size.y);
+
+    BindPassTexture(S_DENSITY, GL_TEXTURE_3D, density.tex);
+
+    glBindVertexArray(quadVAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, size.z);
+    glBindVertexArray(0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// build the packed gradient volume of the liquid after the level set update. the raymarcher reads the value and the
+// normal of a sample with a single fetch of this volume, instead of the tricubic filter and the gradient differences
+void BuildLevelSetGradient(PassShader &gradientShader, Slab &levelSet, ObstacleSlab &obstacle, Slab &gradient)
+{
+    gradientShader.Use();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gradient.fbo);
+    glViewport(0, 0, GRID_WIDTH, GRID_HEIGHT);
+
+    BindPassTexture(S_LEVEL_SET, GL_TEXTURE_3D, levelSet.tex);
+    BindPassTexture(S_OBSTACLE, GL_TEXTURE_3D, obstacle.tex);
+
+    glBindVertexArray(quadVAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
+    glBindVertexArray(0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// side of the light transmittance volume: the volume is a cube, since its axes follow the light direction
+GLuint LightVolumeSize(GLuint width, GLuint height, GLuint depth)
+{
+    return (glm::max(width, glm::max(height, depth)) + LIGHT_VOLUME_DOWNSCALE - 1) / LIGHT_VOLUME_DOWNSCALE;
+}
+
+// compute the light transmittance volume of the gas. the layers of a 3D texture can be drawn only along its z axis,
+// so the volume is stored in light space: its z axis is the grid axis closest to the direction of the light, pointing
+// away from the light, and the other axes are the remaining grid axes. The layers are drawn one at a time from the
+// light, each one adding the density crossed by the light from the previous layer to its optical depth. the previous
+// layer is read from a 2D slab, written together with the volume layer, so the volume is never read while it's drawn
+void LightTransmittance(PassShader &transmittanceShader, Slab &density, Slab &transmittance, Slab &sliceA, Slab &sliceB, glm::vec3 lightDirection, glm::mat4 &model, glm::mat4 &textureToLight)
+{
+    GLuint size = LightVolumeSize((GLuint) GRID_WIDTH, (GLuint) GRID_HEIGHT, (GLuint) GRID_DEPTH);
+
+    // direction towards the light in texture space, where the z axis is inverted
+    glm::vec3 toLight = glm::vec3(glm::inverse(model) * glm::vec4(lightDirection, 0.0f));
+    toLight = glm::normalize(glm::vec3(toLight.x, toLight.y, -toLight.z));
+
+    GLint axis = 0;
+    for (GLint i = 1; i < 3; i++)
+        if (glm::abs(toLight[i]) > glm::abs(toLight[axis]))
+            axis = i;
+
+    // the volume z axis points away from the light, so it's flipped if the light is on the positive side
+    bool flip = toLight[axis] > 0.0f;
+
+    textureToLight = glm::mat4(0.0f);
+    textureToLight[(axis + 1) % 3][0] = 1.0f;
+    textureToLight[(axis + 2) % 3][1] = 1.0f;
+    textureToLight[axis][2] = flip ? -1.0f : 1.0f;
+    textureToLight[3][2] = flip ? 1.0f : 0.0f;
+    textureToLight[3][3] = 1.0f;
+
+    glm::mat4 lightToTexture = glm::inverse(textureToLight);
+
+    // offset of the light ray position in the previous layer, and length of the ray between two layers in cells
+    glm::vec3 lightToward = glm::mat3(textureToLight) * toLight;
+    glm::vec2 sliceOffset = glm::vec2(lightToward) / (-lightToward.z * size);
+    GLfloat sliceLength = glm::length(toLight) / (glm::abs(toLight[axis]) * size) * glm::max(GRID_WIDTH, glm::max(GRID_HEIGHT, GRID_DEPTH));
+
+    glViewport(0, 0, size, size);
+
+    transmittanceShader.Use();
+
+    BindPassTexture(S_DENSITY, GL_TEXTURE_3D, density.tex);
+
+    glUniformMatrix4fv(transmittanceShader.Locations[U_LIGHT_TO_TEXTURE], 1, GL_FALSE, glm::value_ptr(lightToTexture));
+    glUniform2fv(transmittanceShader.Locations[U_SLICE_OFFSET], 1, glm::value_ptr(sliceOffset));
+    glUniform1f(transmittanceShader.Locations[U_SLICE_LENGTH], sliceLength);
+    glUniform2fv(transmittanceShader.Locations[U_INVERSE_SCREEN_SIZE], 1, glm::value_ptr(glm::vec2(1.0f / size)));
+
+    // the light enters the first layer without crossing the gas
+    glBindFramebuffer(GL_FRAMEBUFFER, sliceA.fbo);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+
+    glBindVertexArray(quadVAO);
+
+    for (GLuint layer = 0; layer < size; layer++)
+    {
+        // the volume layer is attached to the slab framebuffer only while it's drawn
+        glBindFramebuffer(GL_FRAMEBUFFER, sliceB.fbo);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, transmittance.tex, 0, layer);
+        glDrawBuffers(2, drawBuffers);
+
+        BindPassTexture(S_SOURCE, GL_TEXTURE_2D, sliceA.tex);
+        glUniform1f(transmittanceShader.Locations[U_SLICE_DEPTH], (layer + 0.5f) / size);
+
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 0, 0, 0);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+        SwapSlabs(sliceA, sliceB);
+    }
+
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// copy the occupancy volume in the pixel buffer. The copy runs on the GPU after the build of the volume, and
+// the fence tells when it's complete, so the CPU reads the volume in a next frame without stalling the pipeline
+void RequestOccupancyReadback(Slab &occupancy)
+{
+    glm::uvec3 size = OccupancyGridSize((GLuint) GRID_WIDTH, (GLuint) GRID_HEIGHT, (GLuint) GRID_DEPTH);
+    GLuint64 bytes = (GLuint64) size.x * size.y * size.z * sizeof(glm::vec2);
+
+    if (occupancyPBO == 0)
+    {
+        glGenBuffers(1, &occupancyPBO);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, occupancyPBO);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+        RegisterBuffer(occupancyPBO, bytes);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, occupancyPBO);
+    glBindTexture(GL_TEXTURE_3D, occupancy.tex);
+    glGetTexImage(GL_TEXTURE_3D, 0, GL_RG, GL_FLOAT, 0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // the readback changed the texture bindings
+    ResetPassTextures();
+
+    // a pending readback is replaced by the new one
+    if (occupancyFence != 0)
+        glDeleteSync(occupancyFence);
+
+    occupancyFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// compute the bounds of the blocks with fluid, with the same criteria of the raymarcher, from the last readback.
+// the bounds are enlarged by a block on each side, since the fluid can move into the next blocks while the
+// readback is pending. They are expressed in the local space of the fluid cube, at the positions where the
+// raydata shaders place the rays covering the blocks (the rays are aligned to the voxel centers)
+bool ReadOccupiedBounds(GLboolean isLiquidSimulation, glm::vec3 &boundsMin, glm::vec3 &boundsMax)
+{
+    if (occupancyFence == 0 || glClientWaitSync(occupancyFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    glDeleteSync(occupancyFence);
+    occupancyFence = 0;
+
+    glm::uvec3 size = OccupancyGridSize((GLuint) GRID_WIDTH, (GLuint) GRID_HEIGHT, (GLuint) GRID_DEPTH);
+    GLuint64 bytes = (GLuint64) size.x * size.y * size.z * sizeof(glm::vec2);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, occupancyPBO);
+    const glm::vec2* blocks = (const glm::vec2*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+
+    if (!blocks)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return false;
+    }
+
+    glm::ivec3 first = glm::ivec3(size);
+    glm::ivec3 last = glm::ivec3(-1);
+
+    for (GLuint z = 0; z < size.z; z++)
+    {
+        for (GLuint y = 0; y < size.y; y++)
+        {
+            for (GLuint x = 0; x < size.x; x++)
+            {
+                glm::vec2 range = blocks[x + size.x * (y + size.y * z)];
+                bool empty = isLiquidSimulation ? range.x > 0.0f : range.y <= OCCUPANCY_EMPTY_GAS_DENSITY;
+
+                if (!empty)
+                {
+                    first = glm::min(first, glm::ivec3(x, y, z));
+                    last = glm::max(last, glm::ivec3(x, y, z));
+                }
+            }
+        }
+    }
+
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // without fluid, the bounds are empty and nothing is rasterized
+    if (last.x < 0)
+    {
+        boundsMin = boundsMax = glm::vec3(0.0f);
+        return true;
+    }
+
+    first = glm::max(first - 1, glm::ivec3(0));
+    last = glm::min(last + 1, glm::ivec3(size) - 1);
+
+    // the texture space position u of a ray is aligned to the voxel centers as (u * (size - 1) + 0.5) / size
+    glm::vec3 gridSize = glm::vec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH);
+    glm::vec3 texelMin = glm::vec3(first * (GLint) OCCUPANCY_BLOCK_SIZE);
+    glm::vec3 texelMax = glm::min(glm::vec3((last + 1) * (GLint) OCCUPANCY_BLOCK_SIZE), gridSize);
+
+    glm::vec3 uvwMin = glm::clamp((texelMin - 0.5f) / (gridSize - 1.0f), 0.0f, 1.0f);
+    glm::vec3 uvwMax = glm::clamp((texelMax - 0.5f) / (gridSize - 1.0f), 0.0f, 1.0f);
+
+    // the z axis of the texture space is inverted with respect to the cube local space
+    boundsMin = glm::vec3(uvwMin.x, uvwMin.y, 1.0f - uvwMax.z) * 2.0f - 1.0f;
+    boundsMax = glm::vec3(uvwMax.x, uvwMax.y, 1.0f - uvwMin.z) * 2.0f - 1.0f;
+
+    return true;
+}
+
+// the subroutine indices are fixed after linking, so they are searched only once
+void ResolveRaymarchingSubroutines(PassShader &renderShader)
+{
+    FinishProgram(renderShader.Program);
+
+    raymarchingLiquidSubroutine = glGetSubroutineIndex(renderShader.Program, GL_FRAGMENT_SHADER, "RaymarchingLiquid");
+    raymarchingGasSubroutine = glGetSubroutineIndex(renderShader.Program, GL_FRAGMENT_SHADER, "RaymarchingGas");
+
+    if (raymarchingLiquidSubroutine == GL_INVALID_INDEX || raymarchingGasSubroutine == GL_INVALID_INDEX)
+        std::cout << "Raymarching subroutines not found in the rendering program" << std::endl;
+}
+
 // render fluid using raymarching technique. this is done by sampling the density texture with
 // the data gathered in the two raydata textures. the two target fluids rendering is handled
 // separately with subroutines.
+// the raymarcher leaps over the blocks of the occupancy volume without fluid, if the empty space skipping is enabled.
 // If the target fluid is liquid, the surface is shaded with ggx lighting model.
 // for each surface point, the normal is approximated by the gradient of the level set function. the 
 // lighting model is then applied to the surface point. Refraction is also applied to all surface points.
 // draw the result in a scene object.
-void RenderFluid(Shader &renderShader, Slab &density_slab, ObstacleSlab &obstacle, Slab &rayDataFront, Slab &rayDataBack, Scene &backgroudScene, Scene &dest, Model &cubeModel, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, glm::vec2 inverseScreenSize, GLfloat nearPlane, glm::vec3 eyePosition, glm::vec3 cameraFront, glm::vec3 cameraUp, glm::vec3 cameraRight, glm::vec3 lightDirection, GLfloat Kd, GLfloat rugosity, GLfloat F0, GLboolean isLiquidSimulation)
+void RenderFluid(PassShader &renderShader, Slab &density_slab, Slab &occupancy, ObstacleSlab &obstacle, Slab &rayDataFront, Slab &rayDataBack, Scene &backgroudScene, Scene &dest, Model &cubeModel, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, glm::vec2 inverseScreenSize, GLfloat nearPlane, glm::vec3 eyePosition, glm::vec3 cameraFront, glm::vec3 cameraUp, glm::vec3 cameraRight, glm::vec3 lightDirection, GLfloat Kd, GLfloat rugosity, GLfloat F0, GLboolean isLiquidSimulation, RaymarchingSettings &settings, Slab *raySteps)
 {
     renderShader.Use();
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
+
+    // the steps are written in a second attachment of the fluid scene only while they are measured
+    if (raySteps)
+    {
+        GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, raySteps->tex, 0);
+        glDrawBuffers(2, drawBuffers);
+    }
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, density_slab.tex);
-    glUniform1i(glGetUniformLocation(renderShader.Program, "DensityTexture"), 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, backgroudScene.colorTex);
-    glUniform1i(glGetUniformLocation(renderShader.Program, "BackgroundTexture"), 1);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, rayDataFront.tex);
-    glUniform1i(glGetUniformLocation(renderShader.Program, "RayDataFront"), 2);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, rayDataBack.tex);
-    glUniform1i(glGetUniformLocation(renderShader.Program, "RayDataBack"), 3);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_3D, obstacle.tex);
-    glUniform1i(glGetUniformLocation(renderShader.Program, "ObstacleTexture"), 4);
-
-    glUniformMatrix4fv(glGetUniformLocation(renderShader.Program, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(glGetUniformLocation(renderShader.Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(renderShader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glUniform3fv(glGetUniformLocation(renderShader.Program, "grid_size"), 1, glm::value_ptr(glm::vec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH)));
-    glUniform2fv(glGetUniformLocation(renderShader.Program, "InverseScreenSize"), 1, glm::value_ptr(inverseScreenSize));
-    glUniform1f(glGetUniformLocation(renderShader.Program, "nearPlane"), nearPlane);
-    glUniform3fv(glGetUniformLocation(renderShader.Program, "eyePos"), 1, glm::value_ptr(eyePosition));
-    glUniform3fv(glGetUniformLocation(renderShader.Program, "cameraFront"), 1, glm::value_ptr(cameraFront));
-    glUniform3fv(glGetUniformLocation(renderShader.Program, "cameraUp"), 1, glm::value_ptr(cameraUp));
-    glUniform3fv(glGetUniformLocation(renderShader.Program, "cameraRight"), 1, glm::value_ptr(cameraRight));
-
-    glUniform1f(glGetUniformLocation(renderShader.Program, "Kd"), Kd);
-    glUniform1f(glGetUniformLocation(renderShader.Program, "rugosity"), rugosity);
-    glUniform1f(glGetUniformLocation(renderShader.Program, "F0"), F0);
-    glUniform3fv(glGetUniformLocation(renderShader.Program, "lightVector"), 1, glm::value_ptr(lightDirection));
+    BindPassTexture(S_DENSITY, GL_TEXTURE_3D, density_slab.tex);
+    BindPassTexture(S_BACKGROUND, GL_TEXTURE_2D, backgroudScene.colorTex);
+    BindPassTexture(S_RAYDATA_FRONT, GL_TEXTURE_2D, rayDataFront.tex);
+    BindPassTexture(S_RAYDATA_BACK, GL_TEXTURE_2D, rayDataBack.tex);
+    BindPassTexture(S_OBSTACLE, GL_TEXTURE_3D, obstacle.tex);
+    BindPassTexture(S_OCCUPANCY, GL_TEXTURE_3D, occupancy.tex);
+    BindPassTexture(S_BLUE_NOISE, GL_TEXTURE_2D, settings.blueNoiseTex);
+    BindPassTexture(S_TRANSMITTANCE, GL_TEXTURE_3D, settings.transmittanceTex);
+    BindPassTexture(S_GRADIENT, GL_TEXTURE_3D, settings.gradientTex);
+
+    glUniformMatrix4fv(renderShader.Locations[U_MODEL], 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(renderShader.Locations[U_VIEW], 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(renderShader.Locations[U_PROJECTION], 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform3fv(renderShader.Locations[U_GRID_SIZE], 1, glm::value_ptr(glm::vec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH)));
+    glUniform2fv(renderShader.Locations[U_INVERSE_SCREEN_SIZE], 1, glm::value_ptr(inverseScreenSize));
+    glUniform1f(renderShader.Locations[U_NEAR_PLANE], nearPlane);
+    glUniform3fv(renderShader.Locations[U_EYE_POS], 1, glm::value_ptr(eyePosition));
+    glUniform3fv(renderShader.Locations[U_CAMERA_FRONT], 1, glm::value_ptr(cameraFront));
+    glUniform3fv(renderShader.Locations[U_CAMERA_UP], 1, glm::value_ptr(cameraUp));
+    glUniform3fv(renderShader.Locations[U_CAMERA_RIGHT], 1, glm::value_ptr(cameraRight));
+
+    glUniform1f(renderShader.Locations[U_KD], Kd);
+    glUniform1f(renderShader.Locations[U_RUGOSITY], rugosity);
+    glUniform1f(renderShader.Locations[U_F0], F0);
+    glUniform3fv(renderShader.Locations[U_LIGHT_VECTOR], 1, glm::value_ptr(lightDirection));
+    glUniform1i(renderShader.Locations[U_EMPTY_SPACE_SKIPPING], settings.emptySpaceSkipping);
+    glUniform1f(renderShader.Locations[U_STEP_QUALITY], settings.stepQuality);
+    glUniform1i(renderShader.Locations[U_ADAPTIVE_STEPPING], settings.adaptiveStepping);
+    glUniform1i(renderShader.Locations[U_STEP_COUNT_VIEW], settings.stepCountView);
+    glUniform1i(renderShader.Locations[U_PACKED_GRADIENTS], settings.packedGradients);
+    glUniform1f(renderShader.Locations[U_JITTER_OFFSET], settings.jitterOffset);
+    glUniformMatrix4fv(renderShader.Locations[U_TEXTURE_TO_LIGHT], 1, GL_FALSE, glm::value_ptr(settings.textureToLight));
+    glUniform1f(renderShader.Locations[U_SHADOW_EXTINCTION], settings.shadowExtinction);
+    glUniform3fv(renderShader.Locations[U_BOUNDS_MIN], 1, glm::value_ptr(settings.boundsMin));
+    glUniform3fv(renderShader.Locations[U_BOUNDS_MAX], 1, glm::value_ptr(settings.boundsMax));
 
     // set the correct subroutine for the shader
-    GLuint index = 0;
-    if (isLiquidSimulation)
-        index = glGetSubroutineIndex(renderShader.Program, GL_FRAGMENT_SHADER, "RaymarchingLiquid");
-    else
-        index = glGetSubroutineIndex(renderShader.Program, GL_FRAGMENT_SHADER, "RaymarchingGas");
+    GLuint index = isLiquidSimulation ? raymarchingLiquidSubroutine : raymarchingGasSubroutine;
 
     glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &index);
 
     cubeModel.Draw();
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE4); glBindTexture(GL_TEXTURE_3D, 0);
+    // the post processing effects can swap the fluid scene framebuffer, so the steps texture is detached
+    if (raySteps)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, 0, 0);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    }
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// size of the targets of the ray steps sum: a texel for each block of STEPS_SUM_BLOCK_SIZE pixels, rounded up
+glm::uvec2 StepsSumSize(GLuint width, GLuint height)
+{
+    return (glm::uvec2(width, height) + STEPS_SUM_BLOCK_SIZE - 1u) / STEPS_SUM_BLOCK_SIZE;
+}
+
+// sum the steps texture: each pass sums the blocks of its source, ping-ponging between the two sum slabs, until
+// a single texel is left (the pixels without fluid are 0). The texel is copied in the pixel buffer, and the fence
+// tells when it's complete, so the CPU reads the steps in a next frame without stalling the pipeline
+void RequestRaymarchingSteps(PassShader &sumShader, Slab &raySteps, Slab &sum, Slab &tempSum, GLuint width, GLuint height)
+{
+    Slab *source = &raySteps;
+    Slab *dest = &sum;
+    glm::uvec2 size = glm::uvec2(width, height);
+
+    sumShader.Use();
+    glBindVertexArray(quadVAO);
+
+    do
+    {
+        glm::uvec2 sumSize = StepsSumSize(size.x, size.y);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, dest->fbo);
+        glViewport(0, 0, sumSize.x, sumSize.y);
+
+        BindPassTexture(S_SOURCE, GL_TEXTURE_2D, source->tex);
+        glUniform2i(sumShader.Locations[U_SOURCE_SIZE], size.x, size.y);
+
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        source = dest;
+        dest = dest == &sum ? &tempSum : &sum;
+        size = sumSize;
+    }
+    while (size.x > 1 || size.y > 1);
+
+    glBindVertexArray(0);
+
+    if (rayStepsPBO == 0)
+    {
+        glGenBuffers(1, &rayStepsPBO);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, rayStepsPBO);
+        glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(glm::vec4), NULL, GL_STREAM_READ);
+        RegisterBuffer(rayStepsPBO, sizeof(glm::vec4));
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, source->fbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rayStepsPBO);
+    glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // the following passes work on the fluid resolution
+    glViewport(0, 0, width, height);
+
+    // a pending readback is replaced by the new one
+    if (rayStepsFence != 0)
+        glDeleteSync(rayStepsFence);
+
+    rayStepsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    rayStepsPixels = (GLuint64) width * height;
+}
+
+// compute the average steps of the marched rays from the sums of the last readback
+bool ReadRaymarchingSteps(glm::vec3 &steps)
+{
+    if (rayStepsFence == 0 || glClientWaitSync(rayStepsFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    glDeleteSync(rayStepsFence);
+    rayStepsFence = 0;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rayStepsPBO);
+    const glm::vec4* sum = (const glm::vec4*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(glm::vec4), GL_MAP_READ_BIT);
+
+    if (!sum)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return false;
+    }
+
+    // the steps are averaged over the marched pixels
+    if (sum->z > 0.0f)
+        steps = glm::vec3(sum->x / sum->z, sum->y / sum->z, sum->z / rayStepsPixels);
+    else
+        steps = glm::vec3(0.0f);
+
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return true;
+}
+
 // blend the fluid scene with the background scene. this is done by sampling the fluid scene color and depth and
 // compare the depth with the background scene depth. if the fluid scene depth is closer, then the fluid scene color
 // is used. otherwise, the background scene color is used. because the fluid can have depth values equal to cube volume
 // front face depth or near plane depth in case of culling (camera is inside cube volume), the depth comparison is done 
 // by comparing the background scene depth with the first values and the cube volume back face depth (stored in 
 // raydataBack texture) to handle the cases of objects inside the fluid volume.
-void BlendRendering(Shader &blendingShader, Scene &scene, Scene &fluid, Slab &raydataBack, glm::vec2 inverseScreenSize)
+// if the fluid is rendered at a lower resolution, it is upsampled by the shader weighting the nearest fluid texels by
+// the similarity of their scene depth with the depth of the pixel, so the fluid doesn't bleed over the object edges.
+void BlendRendering(PassShader &blendingShader, Scene &scene, Scene &fluid, Slab &raydataBack, glm::mat4 &projection, glm::vec2 inverseScreenSize)
 {
     blendingShader.Use();
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, fluid.colorTex);
-    glUniform1i(glGetUniformLocation(blendingShader.Program, "FluidTexture"), 0);
+    BindPassTexture(S_FLUID, GL_TEXTURE_2D, fluid.colorTex);
+    BindPassTexture(S_FLUID_DEPTH, GL_TEXTURE_2D, fluid.depthTex);
+    BindPassTexture(S_RAYDATA_DEPTH, GL_TEXTURE_2D, raydataBack.tex);
+    BindPassTexture(S_SCENE, GL_TEXTURE_2D, scene.colorTex);
+    BindPassTexture(S_SCENE_DEPTH, GL_TEXTURE_2D, scene.depthTex);
+
+    glUniform2fv(blendingShader.Locations[U_INVERSE_SCREEN_SIZE], 1, glm::value_ptr(inverseScreenSize));
+    glUniformMatrix4fv(blendingShader.Locations[U_PROJECTION], 1, GL_FALSE, glm::value_ptr(projection));
+
+    glBindVertexArray(quadVAO);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glBindVertexArray(0);
+}
+
+// mark the pixels covered by the fluid volume in the stencil buffer of the bound framebuffer. both the faces of the
+// volume are drawn without the depth test, so the pixels are marked also where the volume is behind the scene. the
+// stencil test is left enabled: the following passes select the marked pixels with glStencilFunc
+void FluidStencil(PassShader &stencilShader, Model &cubeModel, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection)
+{
+    stencilShader.Use();
+
+    glClear(GL_STENCIL_BUFFER_BIT);
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, fluid.depthTex);
-    glUniform1i(glGetUniformLocation(blendingShader.Program, "FluidDepth"), 1);
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_DEPTH_TEST);
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, raydataBack.tex);
-    glUniform1i(glGetUniformLocation(blendingShader.Program, "RayDataDepth"), 2);
+    glUniformMatrix4fv(stencilShader.Locations[U_MODEL], 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(stencilShader.Locations[U_VIEW], 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(stencilShader.Locations[U_PROJECTION], 1, GL_FALSE, glm::value_ptr(projection));
+
+    cubeModel.Draw();
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_DEPTH_TEST);
+
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+}
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, scene.colorTex);
-    glUniform1i(glGetUniformLocation(blendingShader.Program, "SceneTexture"), 3);
+// draw the scene color and depth, as the blending does without the fluid. it's used for the pixels outside the fluid
+// volume, so the blending reads the fluid and raydata textures only where the fluid can be
+void CopyScene(PassShader &copyShader, Scene &scene, glm::vec2 inverseScreenSize)
+{
+    copyShader.Use();
 
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, scene.depthTex);
-    glUniform1i(glGetUniformLocation(blendingShader.Program, "SceneDepth"), 4);
+    BindPassTexture(S_SCENE, GL_TEXTURE_2D, scene.colorTex);
+    BindPassTexture(S_SCENE_DEPTH, GL_TEXTURE_2D, scene.depthTex);
 
-    glUniform2fv(glGetUniformLocation(blendingShader.Program, "InverseSize"), 1, glm::value_ptr(inverseScreenSize));
+    glUniform2fv(copyShader.Locations[U_INVERSE_SCREEN_SIZE], 1, glm::value_ptr(inverseScreenSize));
 
     glBindVertexArray(quadVAO);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
     glBindVertexArray(0);
+}
+
+// blend the fluid scene color with the colors of the previous frames. the history is reprojected in the current frame
+// with the depth of the fluid scene and the reprojection matrix (from the current to the previous clip space), and it's
+// clamped to the colors around the pixel to reject the stale history. the result is drawn in the dest slab, which is
+// then swapped with the history, so the history stores the accumulated color used by the blending
+void TemporalAccumulation(PassShader &temporalShader, Scene &fluid, Slab &history, Slab &dest, glm::mat4 &reprojection, GLfloat historyWeight, glm::vec2 inverseScreenSize)
+{
+    temporalShader.Use();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    BindPassTexture(S_FLUID, GL_TEXTURE_2D, fluid.colorTex);
+    BindPassTexture(S_FLUID_DEPTH, GL_TEXTURE_2D, fluid.depthTex);
+    BindPassTexture(S_HISTORY, GL_TEXTURE_2D, history.tex);
+
+    glUniformMatrix4fv(temporalShader.Locations[U_REPROJECTION], 1, GL_FALSE, glm::value_ptr(reprojection));
+    glUniform1f(temporalShader.Locations[U_HISTORY_WEIGHT], historyWeight);
+    glUniform2fv(temporalShader.Locations[U_INVERSE_SCREEN_SIZE], 1, glm::value_ptr(inverseScreenSize));
+
+    glBindVertexArray(quadVAO);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+
+    SwapSlabs(history, dest);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE4); glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 //////////////////////////////////////
@@ -779,12 +1340,12 @@ void BlendRendering(Shader &blendingShader, Scene &scene, Scene &fluid, Slab &ra
 // blur the fluid scene color to solve the dithering problem caused by raymarching jittering used to
 // avoid banding artifacts. the blur effect is applied through a separable gaussian blur filter (so 
 // two passes are required)
-void Blur(Shader &blurShader, Slab &source, Slab &dest, GLfloat radius, glm::vec2 inverseScreenSize)
+void Blur(PassShader &blurShader, Slab &source, Slab &dest, GLfloat radius, glm::vec2 inverseScreenSize)
 {
     blurShader.Use();
 
-    glUniform1f(glGetUniformLocation(blurShader.Program, "radius"), radius);
-    glUniform2fv(glGetUniformLocation(blurShader.Program, "InverseScreenSize"), 1, glm::value_ptr(inverseScreenSize));
+    glUniform1f(blurShader.Locations[U_RADIUS], radius);
+    glUniform2fv(blurShader.Locations[U_INVERSE_SCREEN_SIZE], 1, glm::value_ptr(inverseScreenSize));
 
     glBindVertexArray(quadVAO);
 
@@ -793,38 +1354,33 @@ void Blur(Shader &blurShader, Slab &source, Slab &dest, GLfloat radius, glm::vec
         glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, source.tex);
-        glUniform1i(glGetUniformLocation(blurShader.Program, "SourceTexture"), 0);
+        BindPassTexture(S_SOURCE, GL_TEXTURE_2D, source.tex);
 
-        glUniform1i(glGetUniformLocation(blurShader.Program, "axis"), i);
+        glUniform1i(blurShader.Locations[U_AXIS], i);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
         SwapSlabs(source, dest);  
     }
 
     glBindVertexArray(0);
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 // apply a denoising filter to the fluid scene color. the filter is based on a circular gaussian filter
 // (see https://github.com/BrutPitt/glslSmartDeNoise)
-void DeNoise(Shader &deNoiseShader, Slab &source, Slab &dest, GLfloat sigma, GLfloat threshold, GLfloat kSigma, glm::vec2 inverseScreenSize)
+void DeNoise(PassShader &deNoiseShader, Slab &source, Slab &dest, GLfloat sigma, GLfloat threshold, GLfloat kSigma, glm::vec2 inverseScreenSize)
 {
     deNoiseShader.Use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, source.tex);
-    glUniform1i(glGetUniformLocation(deNoiseShader.Program, "imageData"), 0);
+    BindPassTexture(S_IMAGE_DATA, GL_TEXTURE_2D, source.tex);
 
-    glUniform1f(glGetUniformLocation(deNoiseShader.Program, "uSigma"), sigma);
-    glUniform1f(glGetUniformLocation(deNoiseShader.Program, "uThreshold"), threshold);
-    glUniform1f(glGetUniformLocation(deNoiseShader.Program, "uKSigma"), kSigma);
-    glUniform2fv(glGetUniformLocation(deNoiseShader.Program, "InverseScreenSize"), 1, glm::value_ptr(inverseScreenSize));
+    glUniform1f(deNoiseShader.Locations[U_SIGMA], sigma);
+    glUniform1f(deNoiseShader.Locations[U_THRESHOLD], threshold);
+    glUniform1f(deNoiseShader.Locations[U_K_SIGMA], kSigma);
+    glUniform2fv(deNoiseShader.Locations[U_INVERSE_SCREEN_SIZE], 1, glm::value_ptr(inverseScreenSize));
 
     glBindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
@@ -832,16 +1388,142 @@ void DeNoise(Shader &deNoiseShader, Slab &source, Slab &dest, GLfloat sigma, GLf
     SwapSlabs(source, dest);
 
     glBindVertexArray(0);
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// normalized gaussian weights of the separable blur, for the offsets from 0 to the radius. They are computed only when
+// the radius changes, so the shader reads them instead of evaluating the gaussian at each tap
+GLfloat blurWeights[MAX_BLUR_RADIUS + 1];
+GLint blurWeightsRadius = -1;
+
+// apply the gaussian blur in two passes, one for each axis, as the blur filter. the weights have the same shape of the
+// blur filter, with the standard deviation equal to the radius, but their sum is exactly 1
+void SeparableBlur(PassShader &blurShader, Slab &source, Slab &dest, GLint radius, glm::ivec4 fluidRect)
+{
+    radius = glm::clamp(radius, 1, (GLint) MAX_BLUR_RADIUS);
+
+    if (radius != blurWeightsRadius)
+    {
+        GLfloat sum = 0.0f;
+
+        for (GLint i = 0; i <= radius; i++)
+        {
+            blurWeights[i] = std::exp(-(GLfloat)(i * i) / (2.0f * radius * radius));
+            sum += i == 0 ? blurWeights[i] : 2.0f * blurWeights[i];
+        }
+
+        for (GLint i = 0; i <= radius; i++)
+            blurWeights[i] /= sum;
+
+        blurWeightsRadius = radius;
+    }
+
+    blurShader.Use();
+
+    glUniform1i(blurShader.Locations[U_RADIUS], radius);
+    glUniform1fv(blurShader.Locations[U_BLUR_WEIGHTS], radius + 1, blurWeights);
+
+    // only the pixels covered by the fluid volume are filtered
+    glScissor(fluidRect.x, fluidRect.y, fluidRect.z, fluidRect.w);
+
+    glBindVertexArray(quadVAO);
+
+    for(int i = 0; i < 2; i++)
+    {
+        // the whole destination is cleared, so the taps outside the rectangle read no fluid
+        glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
+        glDisable(GL_SCISSOR_TEST);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glEnable(GL_SCISSOR_TEST);
+
+        BindPassTexture(S_SOURCE, GL_TEXTURE_2D, source.tex);
+
+        glUniform1i(blurShader.Locations[U_AXIS], i);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        SwapSlabs(source, dest);
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// apply the a-trous wavelet filter: each iteration doubles the distance between the taps, and it's applied in two
+// passes, one for each axis, restricted by the scissor test to the rectangle covered by the fluid. the passes are
+// even, so the filtered color ends in the source slab
+void ATrousDeNoise(PassShader &aTrousShader, Slab &source, Slab &dest, GLuint fluidDepth, GLint iterations, GLfloat colorSigma, GLfloat depthSigma, glm::ivec4 fluidRect)
+{
+    aTrousShader.Use();
+
+    glUniform1f(aTrousShader.Locations[U_COLOR_SIGMA], colorSigma);
+    glUniform1f(aTrousShader.Locations[U_DEPTH_SIGMA], depthSigma);
+
+    BindPassTexture(S_FLUID_DEPTH, GL_TEXTURE_2D, fluidDepth);
+
+    // only the pixels covered by the fluid volume are filtered
+    glScissor(fluidRect.x, fluidRect.y, fluidRect.z, fluidRect.w);
+
+    glBindVertexArray(quadVAO);
+
+    for (GLint iteration = 0; iteration < iterations; iteration++)
+    {
+        glUniform1i(aTrousShader.Locations[U_STEP_WIDTH], 1 << iteration);
+
+        for(int i = 0; i < 2; i++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
+            glDisable(GL_SCISSOR_TEST);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glEnable(GL_SCISSOR_TEST);
+
+            BindPassTexture(S_SOURCE, GL_TEXTURE_2D, source.tex);
+
+            glUniform1i(aTrousShader.Locations[U_AXIS], i);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+            SwapSlabs(source, dest);
+        }
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// project the corners of the bounds and take their screen rectangle, enlarged by a pixel for the rounding. if a corner
+// is behind the camera its projection is not valid, so the whole target is used
+glm::ivec4 FluidScreenRect(glm::vec3 boundsMin, glm::vec3 boundsMax, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, GLuint width, GLuint height)
+{
+    glm::mat4 mvp = projection * view * model;
+    glm::vec2 ndcMin = glm::vec2(1.0f), ndcMax = glm::vec2(-1.0f);
+
+    for (GLuint i = 0; i < 8; i++)
+    {
+        glm::vec3 corner = glm::vec3(i & 1 ? boundsMax.x : boundsMin.x, i & 2 ? boundsMax.y : boundsMin.y, i & 4 ? boundsMax.z : boundsMin.z);
+        glm::vec4 clip = mvp * glm::vec4(corner, 1.0f);
+
+        if (clip.w <= 0.0f)
+            return glm::ivec4(0, 0, width, height);
+
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+
+    glm::vec2 size = glm::vec2(width, height);
+    glm::ivec2 rectMin = glm::clamp(glm::ivec2(glm::floor((ndcMin * 0.5f + 0.5f) * size)) - 1, glm::ivec2(0), glm::ivec2(width, height));
+    glm::ivec2 rectMax = glm::clamp(glm::ivec2(glm::ceil((ndcMax * 0.5f + 0.5f) * size)) + 1, glm::ivec2(0), glm::ivec2(width, height));
+
+    return glm::ivec4(rectMin, glm::max(rectMax - rectMin, glm::ivec2(0)));
+}
+
 ///////////////////////// OBSTACLE FUNCTIONS /////////////////////////////
 
 // draw the cube volume obstacle borders in the obstacle texture. the borders are drawn as a set of
 // line strips, one for each depth slice of the obstacle volume, and two full screen quads are used
 // to draw the first and last layers. 
-void BorderObstacle(Shader &borderObstacleShader, Shader &borderObstacleShaderLayered, ObstacleSlab &dest)
+void BorderObstacle(PassShader &borderObstacleShader, PassShader &borderObstacleShaderLayered, ObstacleSlab &dest)
 {
     glViewport(0,0, GRID_WIDTH, GRID_HEIGHT);
 
@@ -853,7 +1535,7 @@ void BorderObstacle(Shader &borderObstacleShader, Shader &borderObstacleShaderLa
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
 
-    glUniform4fv(glGetUniformLocation(borderObstacleShaderLayered.Program, "color"), 1, glm::value_ptr(color));
+    glUniform4fv(borderObstacleShaderLayered.Locations[U_COLOR], 1, glm::value_ptr(color));
 
     glBindVertexArray(borderVAO);
     glDrawArraysInstanced(GL_LINE_STRIP, 0, 5, GRID_DEPTH);
@@ -864,7 +1546,7 @@ void BorderObstacle(Shader &borderObstacleShader, Shader &borderObstacleShaderLa
 
     glBindVertexArray(quadVAO);
 
-    glUniform4fv(glGetUniformLocation(borderObstacleShader.Program, "color"), 1, glm::value_ptr(color));
+    glUniform4fv(borderObstacleShader.Locations[U_COLOR], 1, glm::value_ptr(color));
 
     glBindFramebuffer(GL_FRAMEBUFFER, dest.firstLayerFBO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
@@ -880,8 +1562,10 @@ void BorderObstacle(Shader &borderObstacleShader, Shader &borderObstacleShaderLa
 // a 3D texture for color buffer and a 2D texture array for depth-stencil buffer. 
 // for the last one, the stencil buffer is the only one used, but OpenGL 4.1 doesn't
 // allow to create a 2D texture array with only the stencil buffer, neither to create
-// a single 2D texture with the stencil buffer
-ObstacleSlab CreateObstacleBuffer(GLuint width, GLuint height, GLuint depth)
+// a single 2D texture with the stencil buffer.
+// the signed distance texture is linearly filtered, to sample the distance between the cells. It is
+// initialized to the distance of the border cells, which are never written again
+ObstacleSlab CreateObstacleBuffer(GLuint width, GLuint height, GLuint depth, bool distanceField)
 {
     GLuint fbo;
 
@@ -945,11 +1629,37 @@ ObstacleSlab CreateObstacleBuffer(GLuint width, GLuint height, GLuint depth)
     std::cout << "\tChecking for last layer FBO completeness: " << std::endl;
     CheckFramebufferStatus();
 
+    RegisterTexture(texture, GL_R16F, width, height, depth);
+    RegisterTexture(depthStencil, GL_DEPTH24_STENCIL8, width, height, depth);
+    RegisterFramebuffer(fbo);
+    RegisterFramebuffer(firstLayerFBO);
+    RegisterFramebuffer(lastLayerFBO);
+
+    GLuint distance = 0;
+
+    if (distanceField)
+    {
+        vector<GLfloat> borderDistance((size_t) width * height * depth, -0.5f);
+
+        glGenTextures(1, &distance);
+        glBindTexture(GL_TEXTURE_3D, distance);
+
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, width, height, depth, 0, GL_RED, GL_FLOAT, borderDistance.data());
+
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        RegisterTexture(distance, GL_R16F, width, height, depth);
+    }
+
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glBindTexture(GL_TEXTURE_3D, 0);
     glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
-    return {fbo, texture, depthStencil, firstLayerFBO, lastLayerFBO};
+    return {fbo, texture, depthStencil, firstLayerFBO, lastLayerFBO, distance};
 }
 
 // clear the obstacle buffers (both position and velocity)
@@ -964,20 +1674,17 @@ void ClearObstacleBuffers(ObstacleSlab &obstaclePosition, Slab &obstacleVelocity
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-// draw in the obstacle buffer a voxelized version of the obstacle in order to 
-// determine the grid cells that are inside the obstacle. The stencil buffer is used
+// draw in the obstacle buffer a voxelized version of the model in order to 
+// determine the cells that are inside the model. The stencil buffer is used
 // to apply the voxelization through the stencil test, with a similar algorithm to the
 // stencil shadow volume one: the stencil buffer is incremented for each back-facing
 // fragment, and decremented for each front-facing fragment. after rendering both 
-// back and front faces of the obstacle, the stencil buffer will contain a non-zero value
-// for each grid cell that is inside the obstacle. in order to capture the geometry of the
-// obstacle through each slice of the 3D texture, the shader computes a different projection
+// back and front faces of the model, the stencil buffer will contain a non-zero value
+// for each cell that is inside the model. in order to capture the geometry of the
+// model through each slice of the 3D texture, the shader computes a different projection
 // matrix for each slice, by adjusting the near plane to the slice's depth, and the far plane
-// a default value (100.0f) away enough to capture the whole obstacle. 
-//
-//as optimization, the poly model of the obstacle is used (when instanced) to reduce the number 
-// of data to compute and send to the GPU without losing the geometry of the obstacle.
-void DynamicObstaclePosition(Shader &stencilObstacleShader, ObstacleSlab &dest, ObstacleObject* obstacle, glm::mat4 view, glm::mat4 projection, GLfloat scale)
+// a default value (100.0f) away enough to capture the whole model. 
+void StencilVoxelization(PassShader &stencilObstacleShader, ObstacleSlab &dest, Model &model, glm::mat4 modelMatrix, glm::mat4 view, glm::mat4 projection, GLfloat scale, GLuint layers)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
 
@@ -998,27 +1705,26 @@ void DynamicObstaclePosition(Shader &stencilObstacleShader, ObstacleSlab &dest,
 
     stencilObstacleShader.Use();
 
-    glUniformMatrix4fv(glGetUniformLocation(stencilObstacleShader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glUniformMatrix4fv(glGetUniformLocation(stencilObstacleShader.Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(stencilObstacleShader.Program, "model"), 1, GL_FALSE, glm::value_ptr(obstacle->modelMatrix));
+    glUniformMatrix4fv(stencilObstacleShader.Locations[U_PROJECTION], 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix4fv(stencilObstacleShader.Locations[U_VIEW], 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(stencilObstacleShader.Locations[U_MODEL], 1, GL_FALSE, glm::value_ptr(modelMatrix));
 
-    glUniform1f(glGetUniformLocation(stencilObstacleShader.Program, "scaling_factor"), scale);
-    glUniform1f(glGetUniformLocation(stencilObstacleShader.Program, "grid_depth"), GRID_DEPTH);
+    glUniform1f(stencilObstacleShader.Locations[U_SCALING_FACTOR], scale);
 
-    glUniform4fv(glGetUniformLocation(stencilObstacleShader.Program, "color"), 1, glm::value_ptr(glm::vec4(0.0f)));
+    glUniform4fv(stencilObstacleShader.Locations[U_COLOR], 1, glm::value_ptr(glm::vec4(0.0f)));
 
     glCullFace(GL_FRONT);
-    obstacle->lowPolyModel->DrawInstanced(GRID_DEPTH);
+    model.DrawInstanced(layers);
 
     glCullFace(GL_BACK);
-    obstacle->lowPolyModel->DrawInstanced(GRID_DEPTH);
+    model.DrawInstanced(layers);
 
     glStencilFunc(GL_NOTEQUAL, 0, 0xFF); // pass stencil test only if stencil value is not 0
     glStencilMask(0x00); // disable writing to stencil buffer
 
     glDisable(GL_CULL_FACE); // draw all faces
-    glUniform4fv(glGetUniformLocation(stencilObstacleShader.Program, "color"), 1, glm::value_ptr(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)));
-    obstacle->lowPolyModel->DrawInstanced(GRID_DEPTH);
+    glUniform4fv(stencilObstacleShader.Locations[U_COLOR], 1, glm::value_ptr(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)));
+    model.DrawInstanced(layers);
 
     // reset state
     glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
@@ -1031,92 +1737,434 @@ void DynamicObstaclePosition(Shader &stencilObstacleShader, ObstacleSlab &dest,
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-// compute the velocity of the obstacle at each grid cell, by calculating the velocity of each
-// vertex of the obstacle with the position of the obstacle at the previous time step, and
-// the current time step. because the obstacle is voxelized, we only need to compute the velocity
-// of the vertices that are on the surface of the obstacle and splitted for each slice: in
-// geometry stage, calculate the intersection of each triangle with the current slice of the 
-// 3D texture, and output only the triangles that lays on the current slice, or output a quad 
-// if the intersection produces a segment. this quad is obtained by extending the intersection 
-// segment along the projection of the triangle normal on the current slice plane (the velocity 
-// of their vertices is computed by interpolation), by a factor equal to the diagonal of a grid 
-// cell
-void DynamicObstacleVelocity(Shader &obstacleVelocityShader, Slab &obstacle_velocity, Slab &dest, ObstacleObject* obstacle, glm::mat4 view, glm::mat4 projection, glm::vec3 firstLayerPoint, glm::vec3 layersDir, GLfloat deltaTime, GLfloat texelDiagonalSize)
+// voxelize the low poly model of the obstacle in its model space. The obstacles are rigid, so the volume is
+// computed only once, and then it is resampled in the simulation grid (see RigidObstacles). The volume
+// stores the signed distance from the model surface, computed on the CPU from the voxelization.
+// The volume covers the bounding box of the model, enlarged by a voxel on each side to keep its borders empty,
+// with OBSTACLE_VOLUME_RESOLUTION voxels along the longest side.
+//
+// as optimization, the low poly model of the obstacle is used to reduce the number 
+// of data to compute and send to the GPU without losing the geometry of the obstacle.
+void VoxelizeObstacleModel(PassShader &stencilObstacleShader, ObstacleObject* obstacle)
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
+    Model &model = *obstacle->lowPolyModel;
+
+    glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        for (size_t v = 0; v < model.meshes[i].vertices.size(); v++)
+        {
+            boundsMin = glm::min(boundsMin, model.meshes[i].vertices[v].Position);
+            boundsMax = glm::max(boundsMax, model.meshes[i].vertices[v].Position);
+        }
+    }
+
+    if (boundsMin.x > boundsMax.x)
+    {
+        std::cout << "Obstacle " << obstacle->name << " has no vertices to voxelize" << std::endl;
+        return;
+    }
+
+    GLfloat voxelSize = glm::max(glm::max(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y), boundsMax.z - boundsMin.z) / OBSTACLE_VOLUME_RESOLUTION;
+    voxelSize = glm::max(voxelSize, glm::epsilon<float>());
+
+    boundsMin -= glm::vec3(voxelSize);
+    glm::uvec3 size = glm::uvec3(glm::ceil((boundsMax + glm::vec3(voxelSize) - boundsMin) / voxelSize));
+    boundsMax = boundsMin + glm::vec3(size) * voxelSize;
+
+    SetMemorySubsystem(MEMORY_OBSTACLES);
+    ObstacleSlab volume = CreateObstacleBuffer(size.x, size.y, size.z);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, volume.fbo);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    obstacleVelocityShader.Use();
+    // the orthographic projection covers the bounds, with the camera in front of them as for the simulation grid
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 halfSize = (boundsMax - boundsMin) * 0.5f;
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, obstacle_velocity.tex);
-    glUniform1i(glGetUniformLocation(obstacleVelocityShader.Program, "ObstacleVelocity"), 0);
+    glm::mat4 projection = glm::ortho(-halfSize.x, halfSize.x, -halfSize.y, halfSize.y, 1.0f, 100.0f);
+
+    glm::vec3 viewEye = center;
+    viewEye.z += halfSize.z + 1.0f;
 
-    glUniformMatrix4fv(glGetUniformLocation(obstacleVelocityShader.Program, "model"), 1, GL_FALSE, glm::value_ptr(obstacle->modelMatrix));
-    glUniformMatrix4fv(glGetUniformLocation(obstacleVelocityShader.Program, "prevModel"), 1, GL_FALSE, glm::value_ptr(obstacle->prevModelMatrix));
-    glUniformMatrix4fv(glGetUniformLocation(obstacleVelocityShader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glUniformMatrix4fv(glGetUniformLocation(obstacleVelocityShader.Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glm::vec3 viewCenter = center;
+    viewCenter.x += glm::epsilon<float>(); // avoid gimbal lock
+    glm::mat4 view = glm::lookAt(viewEye, viewCenter, glm::vec3(0.0f, 1.0f, 0.0f));
 
-    glUniform1f(glGetUniformLocation(obstacleVelocityShader.Program, "grid_depth"), GRID_DEPTH);
+    // the voxelization shader places the slices using the grid size of the shared parameters,
+    // so we set it to the volume size during the voxelization
+    glm::vec3 gridSize = simulationParams.gridSize;
+    simulationParams.gridSize = glm::vec3(size);
+    UpdateSimulationParams();
 
-    glUniform1f(glGetUniformLocation(obstacleVelocityShader.Program, "deltaTime"), deltaTime);
-    glUniform1f(glGetUniformLocation(obstacleVelocityShader.Program, "texelDiagonal"), texelDiagonalSize);
+    glViewport(0, 0, size.x, size.y);
+    StencilVoxelization(stencilObstacleShader, volume, model, glm::mat4(1.0f), view, projection, halfSize.z, size.z);
 
-    glUniform3fv(glGetUniformLocation(obstacleVelocityShader.Program, "firstLayerPoint"), 1, glm::value_ptr(firstLayerPoint));
-    glUniform3fv(glGetUniformLocation(obstacleVelocityShader.Program, "layersDir"), 1, glm::value_ptr(layersDir));
+    simulationParams.gridSize = gridSize;
+    UpdateSimulationParams();
 
-    obstacle->lowPolyModel->DrawInstanced(GRID_DEPTH);
+    // we replace the occupancy with the signed distance from the model surface, in voxels, filtered linearly
+    // to find the surface between the voxels when the volume is resampled in the grid
+    vector<GLfloat> occupancy((size_t) size.x * size.y * size.z), distance;
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_3D, volume.tex);
+    glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_FLOAT, occupancy.data());
 
-    SwapSlabs(obstacle_velocity, dest);
+    SignedDistanceField(occupancy, size.x, size.y, size.z, distance);
+
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, size.x, size.y, size.z, GL_RED, GL_FLOAT, distance.data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    // the creation of the volume changed the texture bindings
+    ResetPassTextures();
+
+    // only the color texture is kept
+    UnregisterAllocation(GL_TEXTURE, volume.depthStencil);
+    UnregisterAllocation(GL_FRAMEBUFFER, volume.fbo);
+    UnregisterAllocation(GL_FRAMEBUFFER, volume.firstLayerFBO);
+    UnregisterAllocation(GL_FRAMEBUFFER, volume.lastLayerFBO);
+
+    glDeleteTextures(1, &volume.depthStencil);
+    glDeleteFramebuffers(1, &volume.fbo);
+    glDeleteFramebuffers(1, &volume.firstLayerFBO);
+    glDeleteFramebuffers(1, &volume.lastLayerFBO);
+
+    // the layer i of the volume is placed by the voxelization shader at the depth (i + 1) / size.z from the
+    // front face, so the texture coordinate along z is shifted by half a voxel
+    obstacle->voxelVolume = volume.tex;
+    obstacle->voxelSize = voxelSize;
+    obstacle->voxelVolumeMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 1.0f - 0.5f / size.z)) *
+                                  glm::scale(glm::mat4(1.0f), glm::vec3(1.0f) / (boundsMax - boundsMin) * glm::vec3(1.0f, 1.0f, -1.0f)) *
+                                  glm::translate(glm::mat4(1.0f), -boundsMin);
+
+    std::cout << "Voxelized obstacle " << obstacle->name << " in a " << size.x << "x" << size.y << "x" << size.z << " volume" << std::endl;
 }
 
-// update the obstacle buffers by computing the voxelized obstacle position and velocity 
-void DynamicObstacle(Shader &stencilObstacleShader, Shader &obstacleVelocityShader, ObstacleSlab &obstacle_position, Slab &obstacle_velocity, Slab &temp_slab, ObstacleObject* obstacle, glm::vec3 translation, GLfloat scale, GLfloat deltaTime)
+// compute the inner cells of the grid covered by the bounds of the obstacle, enlarged by the distance band (the
+// obstacle doesn't change the cells farther than the band). Returns false if the obstacle doesn't touch any inner cell
+bool ObstacleGridCells(ObstacleObject* obstacle, glm::vec3 translation, GLfloat scale, ObstacleCells &cells)
 {
-    glViewport(0,0, GRID_WIDTH, GRID_HEIGHT);
+    // the voxelized volumes cover the model bounds, the primitives are inside the unit cube
+    glm::mat4 boundsToWorld = obstacle->modelMatrix;
 
-    glm::mat4 projection, view;
+    if (obstacle->shape == OBSTACLE_MESH)
+        boundsToWorld = boundsToWorld * glm::inverse(obstacle->voxelVolumeMatrix) * glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
 
-    GLfloat far_plane = 100, near_plane = 1; // near and far plane of the orthographic projection
-    
-    // size of the orthographic projection equal to half the edge 
-    // of the cube (easily computed from the scale thanks to unitary cube)
-    GLfloat frustumSize = scale; 
+    glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+
+    for (GLuint corner = 0; corner < 8; corner++)
+    {
+        glm::vec4 position = boundsToWorld * glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : -1.0f, 1.0f);
+
+        boundsMin = glm::min(boundsMin, glm::vec3(position));
+        boundsMax = glm::max(boundsMax, glm::vec3(position));
+    }
+
+    // the cell centers are placed at (x + 0.5) / size along x and y, while the layer i is placed at (i + 1) / size
+    // from the front face of the grid, which has the greatest z
+    glm::vec3 gridSize = glm::vec3(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH);
+    glm::vec3 gridMin = (glm::vec3(boundsMin.x, boundsMin.y, -boundsMax.z) - translation * glm::vec3(1.0f, 1.0f, -1.0f) + scale) / (2.0f * scale) * gridSize - glm::vec3(0.5f, 0.5f, 1.0f);
+    glm::vec3 gridMax = (glm::vec3(boundsMax.x, boundsMax.y, -boundsMin.z) - translation * glm::vec3(1.0f, 1.0f, -1.0f) + scale) / (2.0f * scale) * gridSize - glm::vec3(0.5f, 0.5f, 1.0f);
+
+    cells.obstacle = obstacle;
+    cells.cellMin = glm::ivec3(glm::floor(gridMin)) - glm::ivec3((GLint) OBSTACLE_DISTANCE_BAND);
+    cells.cellMax = glm::ivec3(glm::ceil(gridMax)) + glm::ivec3((GLint) OBSTACLE_DISTANCE_BAND);
+
+    // the borders are never written by the obstacles
+    glm::ivec3 innerMax = glm::ivec3(gridSize) - 2;
+
+    if (glm::any(glm::lessThan(cells.cellMax, glm::ivec3(1))) || glm::any(glm::greaterThan(cells.cellMin, innerMax)))
+        return false;
+
+    cells.cellMin = glm::clamp(cells.cellMin, glm::ivec3(1), innerMax);
+    cells.cellMax = glm::clamp(cells.cellMax, glm::ivec3(1), innerMax);
+
+    return true;
+}
+
+// draw the obstacles in the obstacle buffers by resampling their voxelized volumes: each cell of the grid is
+// transformed in the model space of each obstacle, and the cells inside a volume are marked as obstacle.
+// the obstacles are rigid, so the velocity of a cell is computed from its position at the previous step,
+// obtained with the previous model matrix, and it is expressed in the same clip space of the
+// grid projection used by the other obstacle passes.
+// the obstacles are drawn in batches of OBSTACLE_BATCH_SIZE, with a single instanced draw for each batch,
+// so the cost of the pass doesn't grow with the number of obstacles.
+// the buffers are redrawn only when the obstacles change, and the pass overwrites all the inner cells,
+// so the buffers don't need to be cleared (the borders are drawn once, at the creation of the buffers).
+// the analytic primitives are evaluated by the same draws, with their parameters in a uniform buffer: a batch
+// draws up to OBSTACLE_BATCH_SIZE voxelized obstacles and PRIMITIVE_BATCH_SIZE primitives, so many simple
+// obstacles cost a few draws and no mesh rendering or texture sampling.
+// the pass writes also the narrow band signed distance from the obstacles and the borders, used by the
+// simulation passes to find the obstacle surfaces between the cells.
+// the obstacles outside the grid are culled on the CPU, and the obstacles are sorted by their first layer, so
+// each batch after the first one is drawn only in the layers and in the rectangle covered by its obstacles
+void RigidObstacles(PassShader &rigidObstacleShader, ObstacleSlab &obstacle_position, Slab &obstacle_velocity, vector<ObstacleObject*> &obstacles, glm::vec3 translation, GLfloat scale, GLfloat deltaTime)
+{
+    // we collect the obstacles inside the grid, with their current state
+    vector<ObstacleCells> batchable;
+    vector<ObstacleCells> primitives;
+    vector<DrawnObstacle> state;
+
+    for (size_t i = 0; i < obstacles.size(); i++)
+    {
+        ObstacleCells cells;
+
+        if (obstacles[i]->isActive && obstacles[i]->IsSimulationReady() && ObstacleGridCells(obstacles[i], translation, scale, cells))
+        {
+            if (obstacles[i]->shape == OBSTACLE_MESH)
+                batchable.push_back(cells);
+            else
+                primitives.push_back(cells);
+
+            state.push_back({obstacles[i], obstacles[i]->voxelVolume, obstacles[i]->modelMatrix, obstacles[i]->prevModelMatrix});
+        }
+    }
+
+    // the buffers keep the obstacles drawn at the previous step, so we redraw them only if an obstacle
+    // was added, removed or moved. The previous model matrix is part of the state, so the step after
+    // an obstacle stops is still redrawn, to reset its velocity
+    if (obstacleBuffersDrawn && translation == drawnTranslation && scale == drawnScale && state.size() == drawnObstacles.size())
+    {
+        bool changed = false;
+
+        for (size_t i = 0; i < state.size() && !changed; i++)
+        {
+            changed = state[i].obstacle != drawnObstacles[i].obstacle || state[i].voxelVolume != drawnObstacles[i].voxelVolume ||
+                      state[i].modelMatrix != drawnObstacles[i].modelMatrix || state[i].prevModelMatrix != drawnObstacles[i].prevModelMatrix;
+        }
+
+        if (!changed)
+            return;
+    }
+
+    drawnObstacles = state;
+    drawnTranslation = translation;
+    drawnScale = scale;
+    obstacleBuffersDrawn = true;
+
+    // the obstacles of a batch are close along the grid depth, to reduce the layers drawn by the batch
+    auto firstLayerOrder = [](const ObstacleCells &a, const ObstacleCells &b) { return a.cellMin.z < b.cellMin.z; };
+
+    std::stable_sort(batchable.begin(), batchable.end(), firstLayerOrder);
+    std::stable_sort(primitives.begin(), primitives.end(), firstLayerOrder);
+
+    // the framebuffer writes the obstacle position, velocity and distance at the same time
+    if (rigidObstacleFBO == 0)
+    {
+        glGenFramebuffers(1, &rigidObstacleFBO);
+        RegisterFramebuffer(rigidObstacleFBO);
+
+        glGenBuffers(1, &obstaclePrimitivesUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, obstaclePrimitivesUBO);
+        glBufferData(GL_UNIFORM_BUFFER, PRIMITIVE_BATCH_SIZE * sizeof(ObstaclePrimitive), NULL, GL_STREAM_DRAW);
+        RegisterBuffer(obstaclePrimitivesUBO, PRIMITIVE_BATCH_SIZE * sizeof(ObstaclePrimitive));
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, rigidObstacleFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, obstacle_position.tex, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, obstacle_velocity.tex, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, obstacle_position.distanceTex, 0);
 
-    // compute the projection as orthographic projection of the cube
-    projection = glm::ortho(-frustumSize, frustumSize, -frustumSize, frustumSize, near_plane, far_plane);
+    GLenum drawBuffers[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    glDrawBuffers(3, drawBuffers);
+
+    glViewport(0,0, GRID_WIDTH, GRID_HEIGHT);
+
+    // compute the projection of the grid as orthographic projection of the cube, with the camera in front of it
+    glm::mat4 projection = glm::ortho(-scale, scale, -scale, scale, 1.0f, 100.0f);
 
-    // compute the view matrix as a lookAt matrix, with the camera in front of the cube
     glm::vec3 viewEye = glm::vec3(translation);
     viewEye.z += (scale + 1.0f);
 
     glm::vec3 viewCenter = translation;
     viewCenter.x += glm::epsilon<float>(); // avoid gimbal lock
-    glm::vec3 viewUp = glm::vec3(0.0f, 1.0f, 0.0f);
-    view = glm::lookAt(viewEye, viewCenter, viewUp);
+    glm::mat4 view = glm::lookAt(viewEye, viewCenter, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    rigidObstacleShader.Use();
+
+    glUniformMatrix4fv(rigidObstacleShader.Locations[U_PROJECTION], 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix4fv(rigidObstacleShader.Locations[U_VIEW], 1, GL_FALSE, glm::value_ptr(view));
+
+    glUniform3fv(rigidObstacleShader.Locations[U_CENTER], 1, glm::value_ptr(translation));
+    glUniform1f(rigidObstacleShader.Locations[U_SCALING_FACTOR], scale);
+    glUniform1f(rigidObstacleShader.Locations[U_DELTA_TIME], deltaTime);
+
+    // the obstacle pass runs before the setup of the simulation passes, so the tracked bindings could be stale
+    ResetPassTextures();
+
+    // the borders of the grid are drawn once in the obstacle buffer, so only the inner cells are written.
+    // the shader discards the first and last layers
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(1, 1, GRID_WIDTH - 2, GRID_HEIGHT - 2);
+
+    glBindVertexArray(quadVAO);
+    glBindBufferBase(GL_UNIFORM_BUFFER, OBSTACLE_PRIMITIVES_BINDING, obstaclePrimitivesUBO);
+
+    // the first batch is drawn also without obstacles, to clear the cells of the previous step
+    size_t batches = glm::max((batchable.size() + OBSTACLE_BATCH_SIZE - 1) / OBSTACLE_BATCH_SIZE, (primitives.size() + PRIMITIVE_BATCH_SIZE - 1) / PRIMITIVE_BATCH_SIZE);
+
+    for (size_t batch = 0; batch == 0 || batch < batches; batch++)
+    {
+        size_t first = batch * OBSTACLE_BATCH_SIZE;
+        GLuint count = first < batchable.size() ? glm::min((GLuint) (batchable.size() - first), OBSTACLE_BATCH_SIZE) : 0;
+
+        glm::mat4 worldToVolume[OBSTACLE_BATCH_SIZE];
+        glm::mat4 prevFromCurrent[OBSTACLE_BATCH_SIZE];
+        GLfloat distanceScale[OBSTACLE_BATCH_SIZE];
+
+        // cells covered by the obstacles of the batch
+        glm::ivec3 cellMin = glm::ivec3(std::numeric_limits<GLint>::max());
+        glm::ivec3 cellMax = glm::ivec3(std::numeric_limits<GLint>::min());
 
-    // compute the obstacle position 
-    DynamicObstaclePosition(stencilObstacleShader, obstacle_position, obstacle, view, projection, scale);
+        for (GLuint i = 0; i < count; i++)
+        {
+            ObstacleObject* obstacle = batchable[first + i].obstacle;
+
+            cellMin = glm::min(cellMin, batchable[first + i].cellMin);
+            cellMax = glm::max(cellMax, batchable[first + i].cellMax);
+
+            glm::mat4 inverseModel = glm::inverse(obstacle->modelMatrix);
+
+            worldToVolume[i] = obstacle->voxelVolumeMatrix * inverseModel;
+            prevFromCurrent[i] = obstacle->prevModelMatrix * inverseModel;
 
-    // calculate the front direction of the view frustum
-    glm::vec3 projectionDir = glm::normalize(viewCenter - viewEye);
+            // the volume distance is converted from voxels to grid cells, with the average scale of the model matrix
+            GLfloat modelScale = glm::pow(glm::abs(glm::determinant(glm::mat3(obstacle->modelMatrix))), 1.0f / 3.0f);
+            distanceScale[i] = obstacle->voxelSize * modelScale * GRID_WIDTH / (2.0f * scale);
 
-    // calculate a point on the first and last layer of the 3D texture along the view
-    // front direction to define their slice planes (point on plane + normal)
-    glm::vec3 firstLayerPoint = viewEye + projectionDir * near_plane;
-    glm::vec3 lastLayerPoint = viewEye + projectionDir * (2 * scale + 1);
+            BindPassTexture(S_VOXEL_VOLUMES, GL_TEXTURE_3D, obstacle->voxelVolume, i);
+        }
+
+        glUniformMatrix4fv(rigidObstacleShader.Locations[U_WORLD_TO_VOLUME], count, GL_FALSE, glm::value_ptr(worldToVolume[0]));
+        glUniformMatrix4fv(rigidObstacleShader.Locations[U_PREV_FROM_CURRENT], count, GL_FALSE, glm::value_ptr(prevFromCurrent[0]));
+        glUniform1fv(rigidObstacleShader.Locations[U_DISTANCE_SCALE], count, distanceScale);
+        glUniform1i(rigidObstacleShader.Locations[U_OBSTACLE_COUNT], count);
 
-    // compute the obstacle velocity
-    DynamicObstacleVelocity(obstacleVelocityShader, obstacle_velocity, temp_slab, obstacle, view, projection, firstLayerPoint, lastLayerPoint - firstLayerPoint, deltaTime, 1.41421f * (2*scale / GRID_WIDTH));
+        // the primitives are evaluated in their unit space, and the distance is converted to grid cells with the
+        // smallest scale of the model matrix (exact for uniform scales, an underestimate for the others)
+        size_t firstPrimitive = batch * PRIMITIVE_BATCH_SIZE;
+        GLuint primitiveCount = firstPrimitive < primitives.size() ? glm::min((GLuint) (primitives.size() - firstPrimitive), PRIMITIVE_BATCH_SIZE) : 0;
+
+        if (primitiveCount > 0)
+        {
+            ObstaclePrimitive params[PRIMITIVE_BATCH_SIZE];
+
+            for (GLuint i = 0; i < primitiveCount; i++)
+            {
+                ObstacleObject* primitive = primitives[firstPrimitive + i].obstacle;
+
+                cellMin = glm::min(cellMin, primitives[firstPrimitive + i].cellMin);
+                cellMax = glm::max(cellMax, primitives[firstPrimitive + i].cellMax);
+
+                glm::mat4 inverseModel = glm::inverse(primitive->modelMatrix);
+
+                glm::mat3 axes = glm::mat3(primitive->modelMatrix);
+                GLfloat modelScale = glm::min(glm::min(glm::length(axes[0]), glm::length(axes[1])), glm::length(axes[2]));
+
+                params[i].worldToPrimitive = inverseModel;
+                params[i].prevFromCurrent = primitive->prevModelMatrix * inverseModel;
+                params[i].shape = glm::vec4((GLfloat) primitive->shape, modelScale * GRID_WIDTH / (2.0f * scale), 0.0f, 0.0f);
+            }
+
+            // the buffer is orphaned, so the update doesn't wait for the draws of the previous batch
+            glBindBuffer(GL_UNIFORM_BUFFER, obstaclePrimitivesUBO);
+            glBufferData(GL_UNIFORM_BUFFER, PRIMITIVE_BATCH_SIZE * sizeof(ObstaclePrimitive), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, primitiveCount * sizeof(ObstaclePrimitive), params);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+
+        glUniform1i(rigidObstacleShader.Locations[U_PRIMITIVE_COUNT], primitiveCount);
+
+        if (batch == 0)
+        {
+            // the first batch writes all the cells
+            glUniform1i(rigidObstacleShader.Locations[U_FIRST_BATCH], GL_TRUE);
+            glUniform1i(rigidObstacleShader.Locations[U_FIRST_LAYER], 0);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
+        }
+        else
+        {
+            // the next batches change only the cells covered by their obstacles: the instances start from the
+            // first covered layer (the base instance is not available in OpenGL 4.1, so it is added by the shader)
+            GLsizei layers = cellMax.z - cellMin.z + 1;
+
+            glScissor(cellMin.x, cellMin.y, cellMax.x - cellMin.x + 1, cellMax.y - cellMin.y + 1);
+            glUniform1i(rigidObstacleShader.Locations[U_FIRST_LAYER], cellMin.z);
+
+            // they write the position and velocity only in the cells inside their obstacles, and then
+            // they merge their distance in all the cells, keeping the minimum with a blended draw
+            glUniform1i(rigidObstacleShader.Locations[U_FIRST_BATCH], GL_FALSE);
+            glColorMaski(2, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, layers);
+            glColorMaski(2, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+            glUniform1i(rigidObstacleShader.Locations[U_FIRST_BATCH], GL_TRUE);
+            glColorMaski(0, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glColorMaski(1, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glEnablei(GL_BLEND, 2);
+            glBlendEquationi(2, GL_MIN);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, layers);
+            glBlendEquationi(2, GL_FUNC_ADD);
+            glDisablei(GL_BLEND, 2);
+            glColorMaski(0, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glColorMaski(1, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        }
+    }
+
+    glBindVertexArray(0);
+    glDisable(GL_SCISSOR_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// voxelize the active obstacles on the CPU, with the same models used by the GPU voxelization, and compare
+// the fields with the obstacle buffers read back from the GPU. The GPU resamples a voxelized volume of
+// each model, so a few cells along the boundaries are expected to differ
+void ValidateObstacleBuffers(ObstacleSlab &obstacle_position, Slab &obstacle_velocity, vector<ObstacleObject*> &obstacles, glm::vec3 translation, GLfloat scale, GLfloat deltaTime)
+{
+    VoxelGrid grid = {(GLuint) GRID_WIDTH, (GLuint) GRID_HEIGHT, (GLuint) GRID_DEPTH, translation, scale};
+
+    ObstacleFields reference;
+    ClearObstacleFields(grid, reference);
+
+    for (size_t i = 0; i < obstacles.size(); i++)
+    {
+        // the primitives are voxelized with their generated meshes
+        if (obstacles[i]->isActive && obstacles[i]->IsSimulationReady())
+        {
+            TriangleBVH bvh = BuildTriangleBVH(obstacles[i]->lowPolyModel->meshes);
+            VoxelizeObstacleCPU(bvh, obstacles[i]->modelMatrix, obstacles[i]->prevModelMatrix, deltaTime, grid, reference);
+        }
+    }
+
+    ObstacleFields fields;
+    fields.occupancy.resize(reference.occupancy.size());
+    fields.velocity.resize(reference.velocity.size());
+
+    glBindTexture(GL_TEXTURE_3D, obstacle_position.tex);
+    glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_FLOAT, fields.occupancy.data());
+
+    glBindTexture(GL_TEXTURE_3D, obstacle_velocity.tex);
+    glGetTexImage(GL_TEXTURE_3D, 0, GL_RGB, GL_FLOAT, fields.velocity.data());
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    // the readback changed the texture bindings
+    ResetPassTextures();
+
+    CompareObstacleFields(reference, fields, grid);
 }
 
 ///////////////////////// LIQUID SIMULATION FUNCTIONS /////////////////////////////
 
 // initialize the liquid simulation by setting the level set to the initial height
-void InitLiquidSimulation(Shader &initLiquidSimShader, Slab &levelSet, GLfloat initialHeight)
+void InitLiquidSimulation(PassShader &initLiquidSimShader, Slab &levelSet, GLfloat initialHeight)
 {
     glViewport(0,0, GRID_WIDTH, GRID_HEIGHT);
 
@@ -1125,8 +2173,7 @@ void InitLiquidSimulation(Shader &initLiquidSimShader, Slab &levelSet, GLfloat i
 
     initLiquidSimShader.Use();
 
-    glUniform1f(glGetUniformLocation(initLiquidSimShader.Program, "initialHeight"), glm::clamp(initialHeight, 0.0f, 1.0f));
-    glUniform1f(glGetUniformLocation(initLiquidSimShader.Program, "grid_height"), GRID_HEIGHT);
+    glUniform1f(initLiquidSimShader.Locations[U_INITIAL_HEIGHT], glm::clamp(initialHeight, 0.0f, 1.0f));
 
     glBindVertexArray(quadVAO);
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
@@ -1137,60 +2184,43 @@ void InitLiquidSimulation(Shader &initLiquidSimShader, Slab &levelSet, GLfloat i
 // apply the level set damping by adding (a factor of) the level set value in the liquid /
 // equilibrium state. This is used to damp the level set value and avoid oscillations 
 // caused by the level set advection
-void ApplyLevelSetDamping(Shader &dampingLevelSetShader, Slab &levelSet, ObstacleSlab obstacle, Slab &dest, GLfloat dampingFactor, GLfloat equilibriumHeight)
+void ApplyLevelSetDamping(PassShader &dampingLevelSetShader, Slab &levelSet, ObstacleSlab obstacle, Slab &dest, GLfloat dampingFactor, GLfloat equilibriumHeight)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
     glClear(GL_COLOR_BUFFER_BIT);
 
     dampingLevelSetShader.Use();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, levelSet.tex);
-    glUniform1i(glGetUniformLocation(dampingLevelSetShader.Program, "LevelSetTexture"), 0);
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, obstacle.tex);
-    glUniform1i(glGetUniformLocation(dampingLevelSetShader.Program, "ObstacleTexture"), 1);
+    BindPassTexture(S_LEVEL_SET, GL_TEXTURE_3D, levelSet.tex);
+    BindPassTexture(S_OBSTACLE, GL_TEXTURE_3D, obstacle.tex);
 
-    glUniform1f(glGetUniformLocation(dampingLevelSetShader.Program, "dampingFactor"), glm::clamp(dampingFactor, 0.0f, 1.0f));
-    glUniform1f(glGetUniformLocation(dampingLevelSetShader.Program, "equilibriumHeight"), glm::clamp(equilibriumHeight, 0.0f, 1.0f));
-    glUniform3fv(glGetUniformLocation(dampingLevelSetShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
-    glUniform1f(glGetUniformLocation(dampingLevelSetShader.Program, "grid_height"), GRID_HEIGHT);
+    glUniform1f(dampingLevelSetShader.Locations[U_DAMPING_FACTOR], glm::clamp(dampingFactor, 0.0f, 1.0f));
+    glUniform1f(dampingLevelSetShader.Locations[U_EQUILIBRIUM_HEIGHT], glm::clamp(equilibriumHeight, 0.0f, 1.0f));
 
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_3D, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     SwapSlabs(levelSet, dest);
 }
 
 // apply the gravity to the velocity field for those cells that are inside the liquid
-void ApplyGravity(Shader &gravityShader, Slab &velocity, Slab &levelSet, Slab &dest, GLfloat gravityAcceleration, GLfloat timeStep, GLfloat threshold)
+void ApplyGravity(PassShader &gravityShader, Slab &velocity, Slab &levelSet, Slab &dest, GLfloat gravityAcceleration, GLfloat threshold)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, dest.fbo);
     glClear(GL_COLOR_BUFFER_BIT);
 
     gravityShader.Use();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, velocity.tex);
-    glUniform1i(glGetUniformLocation(gravityShader.Program, "VelocityTexture"), 0);
+    BindPassTexture(S_VELOCITY, GL_TEXTURE_3D, velocity.tex);
     
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, levelSet.tex);
-    glUniform1i(glGetUniformLocation(gravityShader.Program, "LevelSetTexture"), 1);
+    BindPassTexture(S_LEVEL_SET, GL_TEXTURE_3D, levelSet.tex);
 
-    glUniform3fv(glGetUniformLocation(gravityShader.Program, "InverseSize"), 1, glm::value_ptr(InverseSize));
-    glUniform1f(glGetUniformLocation(gravityShader.Program, "gravityAcceleration"), gravityAcceleration);
-    glUniform1f(glGetUniformLocation(gravityShader.Program, "timeStep"), timeStep);
-    glUniform1f(glGetUniformLocation(gravityShader.Program, "levelSetThreshold"), threshold);
+    glUniform1f(gravityShader.Locations[U_GRAVITY_ACCELERATION], gravityAcceleration);
+    glUniform1f(gravityShader.Locations[U_LEVEL_SET_THRESHOLD], threshold);
 
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GRID_DEPTH);
 
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_3D, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     SwapSlabs(velocity, dest);
@@ -16,6 +16,58 @@
 // we load the structure for the dynamic objects
 #include "obstacle_object.h"
 
+// we load the shader class for the passes, with cached uniform locations
+#include "pass_shader.h"
+
+// we load the registry of the GPU allocations
+#include "memory-registry.h"
+
+// we load the CPU voxelizer, used as reference for the obstacle buffers
+#include "cpu-voxelizer.h"
+
+// we load the blue noise generator, used to jitter the rays
+#include "blue-noise.h"
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the parameters of the obstacles
+
+// voxels along the longest side of the volume used to voxelize an obstacle model
+const GLuint OBSTACLE_VOLUME_RESOLUTION = 64;
+
+// cells from the obstacle surfaces where the signed distance is stored: farther cells are clamped to this value
+const GLfloat OBSTACLE_DISTANCE_BAND = 4.0f;
+
+// analytic primitive obstacles evaluated by a single draw, limited by the size of their uniform block
+const GLuint PRIMITIVE_BATCH_SIZE = 64;
+
+/////////////////////////////////////////////
+// we define the parameters of the fluid rendering
+
+// cells of the simulation grid along each axis covered by a voxel of the occupancy volume
+const GLuint OCCUPANCY_BLOCK_SIZE = 8;
+
+// cells of the longest side of the grid covered by a voxel of the light transmittance volume of the gas
+const GLuint LIGHT_VOLUME_DOWNSCALE = 2;
+
+// largest radius of the separable blur of the liquid, in pixels (MAX_BLUR_RADIUS in separable_blur.frag)
+const GLuint MAX_BLUR_RADIUS = 16;
+
+// pixels along each axis summed by a fragment of the ray steps sum (STEPS_SUM_BLOCK_SIZE in steps_sum.frag)
+const GLuint STEPS_SUM_BLOCK_SIZE = 8;
+
+// maximum density of an empty block of the occupancy volume for the gas (the liquid blocks are empty if their level set is positive)
+const GLfloat OCCUPANCY_EMPTY_GAS_DENSITY = 0.0001f;
+
+// parameters of a primitive obstacle in the uniform block, with the std140 layout of the shader
+struct ObstaclePrimitive
+{
+    glm::mat4 worldToPrimitive; // transform from world space to the unit space of the primitive
+    glm::mat4 prevFromCurrent; // transform from the current to the previous position of the primitive
+    glm::vec4 shape; // shape of the primitive (x) and size of its unit in grid cells (y)
+};
+
 /////////////////////////////////////////////
 // we define the structures for the simulation
 
@@ -26,6 +78,20 @@ struct Slab
     GLuint tex;
 };
 
+// description of a simulation grid slab: two slabs with the same description are interchangeable
+struct SlabDesc
+{
+    GLuint width;
+    GLuint height;
+    GLuint depth;
+    GLushort dimensions;
+
+    bool operator==(const SlabDesc &other) const
+    {
+        return width == other.width && height == other.height && depth == other.depth && dimensions == other.dimensions;
+    }
+};
+
 // structure for scene texture used to compose the final image
 struct Scene
 {
@@ -34,6 +100,24 @@ struct Scene
     GLuint depthTex;
 };
 
+// settings of the fluid raymarching, gathered by the application at each frame
+struct RaymarchingSettings
+{
+    glm::vec3 boundsMin; // bounds of the marched region, in the local space of the fluid cube
+    glm::vec3 boundsMax;
+    GLboolean emptySpaceSkipping; // leap over the empty blocks of the occupancy volume
+    GLfloat stepQuality; // divides the marching step
+    GLboolean adaptiveStepping; // adapt the step to the distance and to the fluid
+    GLboolean stepCountView; // show the sampled steps of each pixel
+    GLboolean packedGradients; // read the liquid level set and its gradient from the packed gradient volume
+    GLuint gradientTex; // packed gradient volume of the liquid
+    GLuint blueNoiseTex; // tiled blue noise used to jitter the rays
+    GLfloat jitterOffset; // rotation of the blue noise at the current frame
+    GLuint transmittanceTex; // light transmittance volume of the gas
+    glm::mat4 textureToLight; // from the grid texture coords to the transmittance volume coords
+    GLfloat shadowExtinction; // extinction of the gas self shadowing (0 to disable it)
+};
+
 // structure for obstacle texture
 struct ObstacleSlab
 {
@@ -44,6 +128,9 @@ struct ObstacleSlab
     // additional fbos used to draw in the first and last layer of the obstacle texture
     GLuint firstLayerFBO;
     GLuint lastLayerFBO;
+
+    // narrow band signed distance from the obstacles, in cells (0 if not created)
+    GLuint distanceTex;
 };
 
 /////////////////////////////////////////////
@@ -58,12 +145,27 @@ Slab Create2DSlab(GLuint width, GLuint height, GLushort dimensions, bool filter)
 // destroy a simulation grid slab
 void DestroySlab(Slab &slab);
 
+// get a simulation grid slab from the pool of free slabs, or create it if none matches the description
+Slab AcquireSlab(SlabDesc desc);
+
+// give back a slab to the pool, to be recycled by the next acquisition with the same description
+void ReleaseSlab(Slab &slab);
+
+// destroy the free slabs of the pool
+void ClearSlabPool();
+
 // clear the given simulation grid slabss
 void ClearSlabs(int nSlabs, ...);
 
 // create a scene
 Scene CreateScene(GLuint width, GLuint height);
 
+// destroy a scene
+void DestroyScene(Scene &scene);
+
+// create the tiled blue noise texture used to jitter the rays
+GLuint CreateBlueNoiseTexture(GLuint size);
+
 // swap the simulation grid slabs 
 void SwapSlabs(Slab &slabA, Slab &slabB);
 
@@ -74,7 +176,7 @@ void SetGridSize(GLuint width, GLuint height, GLuint depth);
 void InitSimulationVAOs();
 
 // setup vars and state to begin simulation phase
-void BeginSimulation();
+void BeginSimulation(GLfloat timeStep);
 
 // reset state to end simulation phase
 void EndSimulation();
@@ -83,80 +185,143 @@ void EndSimulation();
 // we define the simulation functions
 
 // execute advection with semi-lagrangian scheme
-void Advect(Shader &advectionShader, Slab &velocity, ObstacleSlab &obstacle, Slab &source, Slab &dest, float dissipation, float timeStep);
+void Advect(PassShader &advectionShader, Slab &velocity, ObstacleSlab &obstacle, Slab &source, Slab &dest, float dissipation, float timeStep);
 
 // execute advection with mac-cormack scheme
-void AdvectMacCormack(Shader &advectionShader, Shader &macCormackShader, Slab &velocity, Slab &phi1_hat, Slab &phi2_hat, ObstacleSlab &obstacle, Slab &source, Slab &dest, float dissipation, float timeStep);
+void AdvectMacCormack(PassShader &advectionShader, PassShader &macCormackShader, Slab &velocity, Slab &phi1_hat, Slab &phi2_hat, ObstacleSlab &obstacle, Slab &source, Slab &dest, float dissipation, float timeStep);
 
 // execute buoyancy
-void Buoyancy(Shader &buoyancyShader, Slab &velocity, Slab &temperature, Slab &density, Slab &dest, float ambientTemperature, float timeStep, float sigma, float kappa);
+void Buoyancy(PassShader &buoyancyShader, Slab &velocity, Slab &temperature, Slab &density, Slab &dest, float ambientTemperature, float sigma, float kappa);
 
 // execute divergence
-void Divergence(Shader &divergenceShader, Slab &velocity, Slab &divergence, ObstacleSlab &obstacle, Slab &obstacleVelocity, Slab &dest);
+void Divergence(PassShader &divergenceShader, Slab &velocity, Slab &divergence, ObstacleSlab &obstacle, Slab &obstacleVelocity, Slab &dest);
 
 // execute jacobi
-void Jacobi(Shader &jacobiShader, Slab &pressure, Slab &divergence, ObstacleSlab &obstacle, Slab &dest, GLuint iterations);
+void Jacobi(PassShader &jacobiShader, Slab &pressure, Slab &divergence, ObstacleSlab &obstacle, Slab &dest, GLuint iterations);
 
 // apply external forces
-void ApplyExternalForces(Shader &externalForcesShader, Slab &velocity, Slab &dest, float timeStep, glm::vec3 force, glm::vec3 position, float radius);
+void ApplyExternalForces(PassShader &externalForcesShader, Slab &velocity, Slab &dest, glm::vec3 force, glm::vec3 position, float radius);
 
 // add density
-void AddDensity(Shader &dyeShader, Slab &density, Slab &dest, glm::vec3 position, float radius, float color, GLboolean isLiquidSimulation);
+void AddDensity(PassShader &dyeShader, Slab &density, Slab &dest, glm::vec3 position, float radius, float color, GLboolean isLiquidSimulation);
 
 // apply pressure
-void ApplyPressure(Shader &pressureShader, Slab &velocity, Slab &pressure, ObstacleSlab &obstacle, Slab &obstacleVelocity, Slab &dest);
+void ApplyPressure(PassShader &pressureShader, Slab &velocity, Slab &pressure, ObstacleSlab &obstacle, Slab &obstacleVelocity, Slab &dest);
 
 /////////////////////////////////////////////
 // we define the gas-exlusive simulation functions
 
 // add temperature
-void AddTemperature(Shader &dyeShader, Slab &temperature, Slab &dest, glm::vec3 position, float radius, float appliedTemperature);
+void AddTemperature(PassShader &dyeShader, Slab &temperature, Slab &dest, glm::vec3 position, float radius, float appliedTemperature);
 
 /////////////////////////////////////////////
 // we define the liquid-exclusive simulation functions
 
 // initialize the simulation
-void InitLiquidSimulation(Shader &initLiquidSimShader, Slab &levelSet, GLfloat initialHeight = 0.5f);
+void InitLiquidSimulation(PassShader &initLiquidSimShader, Slab &levelSet, GLfloat initialHeight = 0.5f);
 
 // update the level set
-void ApplyLevelSetDamping(Shader &dampingLevelSetShader, Slab &levelSet, ObstacleSlab obstacle, Slab &dest, GLfloat dampingFactor, GLfloat equilibriumHeight = 0.5f);
+void ApplyLevelSetDamping(PassShader &dampingLevelSetShader, Slab &levelSet, ObstacleSlab obstacle, Slab &dest, GLfloat dampingFactor, GLfloat equilibriumHeight = 0.5f);
 
 // update the velocity with gravity
-void ApplyGravity(Shader &gravityShader, Slab &velocity, Slab &levelSet, Slab &dest, GLfloat gravityAcceleration, GLfloat timeStep, GLfloat threshold = 0.0f);
+void ApplyGravity(PassShader &gravityShader, Slab &velocity, Slab &levelSet, Slab &dest, GLfloat gravityAcceleration, GLfloat threshold = 0.0f);
 
 /////////////////////////////////////////////
 // we define the fluid rendering functions
 
-// generate the raydata texture for the raymarching 
-void RayData(Shader &backShader, Shader &frontShader, Model &cubeModel, Slab &back, Slab &front, Scene &scene, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, glm::vec2 inverseScreenSize);
+// generate the raydata texture for the raymarching, rasterizing the given bounds of the fluid cube (in its local space)
+void RayData(PassShader &backShader, PassShader &frontShader, Model &cubeModel, glm::vec3 rayBoundsMin, glm::vec3 rayBoundsMax, Slab &back, Slab &front, Scene &scene, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, glm::vec2 inverseScreenSize);
+
+// build the occupancy volume of the density, with the density range of each block of the grid
+void BuildOccupancy(PassShader &occupancyShader, Slab &density, Slab &occupancy);
+
+// size of the occupancy volume of the given simulation grid
+glm::uvec3 OccupancyGridSize(GLuint width, GLuint height, GLuint depth);
+
+// side of the cubic light transmittance volume of the given simulation grid
+GLuint LightVolumeSize(GLuint width, GLuint height, GLuint depth);
+
+// compute the optical depth of the light through the gas in the light transmittance volume, sweeping its layers from
+// the light, and the transform from the grid texture coords to the volume coords
+void LightTransmittance(PassShader &transmittanceShader, Slab &density, Slab &transmittance, Slab &sliceA, Slab &sliceB, glm::vec3 lightDirection, glm::mat4 &model, glm::mat4 &textureToLight);
+
+// build the packed gradient volume of the liquid, with the gradient and the value of the level set in each cell
+void BuildLevelSetGradient(PassShader &gradientShader, Slab &levelSet, ObstacleSlab &obstacle, Slab &gradient);
+
+// start the asynchronous readback of the occupancy volume, used to compute the bounds of the fluid
+void RequestOccupancyReadback(Slab &occupancy);
+
+// compute the bounds of the occupied blocks in the local space of the fluid cube, if the last readback is complete.
+// Returns false if the readback is not ready, leaving the bounds unchanged
+bool ReadOccupiedBounds(GLboolean isLiquidSimulation, glm::vec3 &boundsMin, glm::vec3 &boundsMax);
 
-// render the fluid using the raycasting technique
-void RenderFluid(Shader &renderShader, Slab &density_slab, ObstacleSlab &obstacle, Slab &rayDataFront, Slab &rayDataBack, Scene &backgroudScene, Scene &dest, Model &cubeModel, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, glm::vec2 inverseScreenSize, GLfloat nearPlane, glm::vec3 eyePosition, glm::vec3 cameraFront, glm::vec3 cameraUp, glm::vec3 cameraRight, glm::vec3 lightDirection, GLfloat Kd, GLfloat rugosity, GLfloat F0, GLboolean isLiquidSimulation);
+// resolve the indices of the raymarching subroutines of the rendering program, once after it's finished
+void ResolveRaymarchingSubroutines(PassShader &renderShader);
+
+// render the fluid using the raycasting technique. If the ray steps slab is given, the sampled and skipped
+// steps of each pixel are written in it
+void RenderFluid(PassShader &renderShader, Slab &density_slab, Slab &occupancy, ObstacleSlab &obstacle, Slab &rayDataFront, Slab &rayDataBack, Scene &backgroudScene, Scene &dest, Model &cubeModel, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, glm::vec2 inverseScreenSize, GLfloat nearPlane, glm::vec3 eyePosition, glm::vec3 cameraFront, glm::vec3 cameraUp, glm::vec3 cameraRight, glm::vec3 lightDirection, GLfloat Kd, GLfloat rugosity, GLfloat F0, GLboolean isLiquidSimulation, RaymarchingSettings &settings, Slab *raySteps);
+
+// size of the targets of the ray steps sum, for the given size of the ray steps texture
+glm::uvec2 StepsSumSize(GLuint width, GLuint height);
+
+// sum the ray steps of the marched pixels in a single texel, and start its asynchronous readback
+void RequestRaymarchingSteps(PassShader &sumShader, Slab &raySteps, Slab &sum, Slab &tempSum, GLuint width, GLuint height);
+
+// average sampled and skipped steps of the marched rays, and fraction of the marched pixels, if the last readback
+// is complete. Returns false if the readback is not ready, leaving the steps unchanged
+bool ReadRaymarchingSteps(glm::vec3 &steps);
 
 // compose the final frame
-void BlendRendering(Shader &blendingShader, Scene &scene, Scene &fluid, Slab &raydataBack, glm::vec2 inverseScreenSize);
+void BlendRendering(PassShader &blendingShader, Scene &scene, Scene &fluid, Slab &raydataBack, glm::mat4 &projection, glm::vec2 inverseScreenSize);
+
+// mark in the stencil buffer of the bound framebuffer the pixels covered by the fluid volume, and enable the stencil test
+void FluidStencil(PassShader &stencilShader, Model &cubeModel, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection);
+
+// draw the scene color and depth in the bound framebuffer, for the pixels not covered by the fluid
+void CopyScene(PassShader &copyShader, Scene &scene, glm::vec2 inverseScreenSize);
+
+// accumulate the fluid scene color in the history over the frames, reprojecting the history from the previous frame
+void TemporalAccumulation(PassShader &temporalShader, Scene &fluid, Slab &history, Slab &dest, glm::mat4 &reprojection, GLfloat historyWeight, glm::vec2 inverseScreenSize);
 
 /////////////////////////////////////////////
 // post processing functions for the liquid rendering
 
 // apply the blur effect to the given slab
-void Blur(Shader &blurShader, Slab &source, Slab &dest, GLfloat radius, glm::vec2 inverseScreenSize);
+void Blur(PassShader &blurShader, Slab &source, Slab &dest, GLfloat radius, glm::vec2 inverseScreenSize);
 
 // apply the denoise effect to the given slab
-void DeNoise(Shader &deNoiseShader, Slab &source, Slab &dest, GLfloat sigma, GLfloat threshold, GLfloat kSigma, glm::vec2 inverseScreenSize);
+void DeNoise(PassShader &deNoiseShader, Slab &source, Slab &dest, GLfloat sigma, GLfloat threshold, GLfloat kSigma, glm::vec2 inverseScreenSize);
+
+// apply the separable blur effect to the given slab, with the gaussian weights computed when the radius changes
+void SeparableBlur(PassShader &blurShader, Slab &source, Slab &dest, GLint radius, glm::ivec4 fluidRect);
+
+// apply the edge-aware a-trous denoise effect to the given slab, with the fluid depth to keep the silhouettes
+void ATrousDeNoise(PassShader &aTrousShader, Slab &source, Slab &dest, GLuint fluidDepth, GLint iterations, GLfloat colorSigma, GLfloat depthSigma, glm::ivec4 fluidRect);
+
+// screen rectangle (x, y, width, height) covered by the given bounds of the fluid volume, in pixels of a target of the
+// given size. The whole target is returned if the bounds cross the camera plane
+glm::ivec4 FluidScreenRect(glm::vec3 boundsMin, glm::vec3 boundsMax, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, GLuint width, GLuint height);
 
 /////////////////////////////////////////////
 // we define the obstacle functions
 
-// create the volume obstacle grid
-ObstacleSlab CreateObstacleBuffer(GLuint width, GLuint height, GLuint depth);
+// create the volume obstacle grid, with the signed distance texture if requested
+ObstacleSlab CreateObstacleBuffer(GLuint width, GLuint height, GLuint depth, bool distanceField = false);
 
 // clear the obstacle position and velocity grid
 void ClearObstacleBuffers(ObstacleSlab &obstaclePosition, Slab &obstacleVelocity);
 
 // draw the borders of the obstacle grid
-void BorderObstacle(Shader &borderObstacleShader, Shader &borderObstacleShaderLayered, ObstacleSlab &dest);
+void BorderObstacle(PassShader &borderObstacleShader, PassShader &borderObstacleShaderLayered, ObstacleSlab &dest);
+
+// voxelize the model of the obstacle in its model space (done once for each obstacle)
+void VoxelizeObstacleModel(PassShader &stencilObstacleShader, ObstacleObject* obstacle);
+
+// voxelize the active obstacles on the CPU and compare the result with the obstacle buffers
+void ValidateObstacleBuffers(ObstacleSlab &obstacle_position, Slab &obstacle_velocity, vector<ObstacleObject*> &obstacles, glm::vec3 translation, GLfloat scale, GLfloat deltaTime);
 
-// draw a dynamic obstacle in the obstacle grid
-void DynamicObstacle(Shader &stencilObstacleShader, Shader &obstacleVelocityShader, ObstacleSlab &obstacle_position, Slab &obstacle_velocity, Slab &temp_slab, ObstacleObject* obstacle, glm::vec3 translation, GLfloat scale, GLfloat deltaTime);
+// draw the active rigid obstacles in the obstacle grid, by resampling their voxelized models with their model matrices,
+// and by evaluating the analytic primitives. The obstacle buffers are redrawn only if the obstacles changed since the previous call
+void RigidObstacles(PassShader &rigidObstacleShader, ObstacleSlab &obstacle_position, Slab &obstacle_velocity, vector<ObstacleObject*> &obstacles, glm::vec3 translation, GLfloat scale, GLfloat deltaTime);
 
@@ -0,0 +1,71 @@
+#include "gpu-timer.h"
+
+//////////////////////////////////////
+// timer functions
+
+// create the queries of the timer
+GpuTimer CreateGpuTimer()
+{
+    GpuTimer timer;
+
+    glGenQueries(GPU_TIMER_QUERIES, timer.queries);
+    timer.next = 0;
+    timer.pending = 0;
+    timer.milliseconds = 0.0f;
+
+    return timer;
+}
+
+// delete the queries of the timer
+void DestroyGpuTimer(GpuTimer &timer)
+{
+    glDeleteQueries(GPU_TIMER_QUERIES, timer.queries);
+    timer.pending = 0;
+}
+
+// start a measure in the next query of the ring. if all the queries are waiting, the oldest is read
+// even if the CPU has to wait for it, since its query is reused
+void BeginGpuTimer(GpuTimer &timer)
+{
+    if (timer.pending == GPU_TIMER_QUERIES)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(timer.queries[timer.next], GL_QUERY_RESULT, &elapsed);
+
+        timer.milliseconds = elapsed / 1000000.0f;
+        timer.pending--;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, timer.queries[timer.next]);
+}
+
+// end the measure and move to the next query of the ring
+void EndGpuTimer(GpuTimer &timer)
+{
+    glEndQuery(GL_TIME_ELAPSED);
+
+    timer.next = (timer.next + 1) % GPU_TIMER_QUERIES;
+    timer.pending++;
+}
+
+// read the oldest pending measure, without waiting for the GPU
+bool ReadGpuTimer(GpuTimer &timer)
+{
+    if (timer.pending == 0)
+        return false;
+
+    GLuint oldest = (timer.next + GPU_TIMER_QUERIES - timer.pending) % GPU_TIMER_QUERIES;
+    GLint available = 0;
+    glGetQueryObjectiv(timer.queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+
+    if (!available)
+        return false;
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(timer.queries[oldest], GL_QUERY_RESULT, &elapsed);
+
+    timer.milliseconds = elapsed / 1000000.0f;
+    timer.pending--;
+
+    return true;
+}
@@ -0,0 +1,37 @@
+#include <glad/glad.h>
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the structures for the GPU timers
+
+// queries of a timer in flight: a measure is read a few frames after it's taken, so the CPU doesn't wait for the GPU
+const GLuint GPU_TIMER_QUERIES = 4;
+
+// timer of the GPU time spent by the commands between its begin and end. The measures are taken with a ring of
+// time elapsed queries, read when their results are available
+struct GpuTimer
+{
+    GLuint queries[GPU_TIMER_QUERIES];
+    GLuint next; // query of the next measure
+    GLuint pending; // measures taken and not read yet
+    GLfloat milliseconds; // last measure read
+};
+
+/////////////////////////////////////////////
+// we define the timer functions
+
+// create the queries of the timer
+GpuTimer CreateGpuTimer();
+
+// delete the queries of the timer
+void DestroyGpuTimer(GpuTimer &timer);
+
+// start a measure. The time elapsed queries can't be nested, so only a timer can be running at a time
+void BeginGpuTimer(GpuTimer &timer);
+
+// end the measure
+void EndGpuTimer(GpuTimer &timer);
+
+// read the oldest measure if its result is available. Returns true if the milliseconds of the timer are updated
+bool ReadGpuTimer(GpuTimer &timer);
@@ -80,6 +80,15 @@ positive Z axis points "outside" the screen
 // we include the fluid simulation functions
 #include "fluid-sim.h"
 
+// we include the timers of the GPU passes
+#include "gpu-timer.h"
+
+// we include the render graph used to schedule the simulation step
+#include "render-graph.h"
+
+// we include the cache of the Shader Programs
+#include "shader-cache.h"
+
 // we include the UI functions
 #include "UI/ui.h"
 
@@ -97,14 +106,18 @@ void SetupShader(int program, bool save);
 // print on console the name of current shader subroutine
 void PrintCurrentShader(int subroutine);
 
-// in this application, we have isolated the scene models rendering using a function, which will be called in each rendering step
-void RenderObjects(Shader &shader, Model &planeModel, GLint render_pass, GLuint depthMap);
+// in this application, we have isolated the scene models rendering using a function, which will be called in each rendering step.
+// The layers select the static objects (the plane), the dynamic ones (the obstacle objects) or both
+void RenderObjects(Shader &shader, Model &planeModel, GLint render_pass, GLuint depthMap, GLint layers);
 
 // load image from disk and create an OpenGL texture
 GLint LoadTexture(const char* path);
 
+// create a depth texture for the shadow map and its framebuffer
+void CreateShadowMap(GLuint width, GLuint height, GLuint &fbo, GLuint &depthMap);
+
 // Shaders and data structure initialization functions
-void CreateFluidShaders(TargetFluid target);
+void CreateFluidShaders();
 
 ///////////////////////// GLOBAL VARIABLES /////////////////////////
 
@@ -112,7 +125,9 @@ void CreateFluidShaders(TargetFluid target);
 GLuint screenWidth = 1200, screenHeight = 900;
 
 // the rendering steps used in the application for objects shadow map rendering
-enum render_passes{ SHADOWMAP, RENDER};
+enum render_passes{ SHADOWMAP, RENDER, DEPTH_PREPASS};
+// the objects of the scene are split in layers, so the shadow map of the static objects can be cached
+enum scene_layers{ STATIC_LAYER = 1, DYNAMIC_LAYER = 2, ALL_LAYERS = STATIC_LAYER | DYNAMIC_LAYER };
 // index of the current shader subroutine (= 0 in the beginning)
 GLuint current_subroutine = 2;
 // a vector for all the shader subroutines names used and swapped in the application
@@ -138,6 +153,20 @@ GLfloat lastSimulationUpdate = 0.0f;
 // boolean to start/stop animated rotation on Y angle
 GLboolean spinning = GL_TRUE;
 
+// if true, the obstacle buffers are validated with the CPU voxelization after the next simulation step
+GLboolean validateObstacles = GL_FALSE;
+
+// state of a dynamic object when it was rendered in the shadow map, used to render the shadow map only when it changes
+struct ShadowCaster
+{
+    ObstacleObject* obstacle;
+    Model* model;
+    glm::mat4 modelMatrix;
+};
+
+// frames rendered with each path of the liquid shading by the gradient benchmark
+const GLuint GRADIENT_BENCHMARK_FRAMES = 120;
+
 // View matrix: the camera moves, so we just set to indentity now
 glm::mat4 view = glm::mat4(1.0f);
 
@@ -169,7 +198,7 @@ GLfloat repeat = 1.0;
 GLfloat orientationY;
 
 // Target fluid exclusive shaders
-Shader *buoyancyShader, *temperatureShader, *initLiquidShader, *dampingLevelSetShader, *gravityShader;
+PassShader *buoyancyShader, *temperatureShader, *initLiquidShader, *dampingLevelSetShader, *gravityShader;
 
 /////////////////// MAIN function ///////////////////////
 int main()
@@ -187,6 +216,9 @@ int main()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     // we set if the window is resizable
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    // the final composition restricts the fluid blending with the stencil buffer of the window
+    glfwWindowHint(GLFW_DEPTH_BITS, 24);
+    glfwWindowHint(GLFW_STENCIL_BITS, 8);
 
     // we create the application's window
     GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "3D Fluid Simulation", nullptr, nullptr);
@@ -212,6 +244,9 @@ int main()
         return -1;
     }
 
+    // we initialize the cache of the Shader Programs, stored in the working directory
+    InitShaderCache("shader_cache", (GLADloadproc) glfwGetProcAddress);
+
     // we define the viewport dimensions
     int width, height;
     glfwGetFramebufferSize(window, &width, &height);
@@ -227,6 +262,10 @@ int main()
     TargetFluid currTarget = targetFluid;
     TargetFluid prevTarget = currTarget;
 
+    // bounds of the region of the fluid cube rasterized by the raymarching, in its local space
+    glm::vec3 rayBoundsMin = glm::vec3(-1.0f);
+    glm::vec3 rayBoundsMax = glm::vec3(1.0f);
+
     // output to console initial the target fluid
     if (currTarget == GAS)
         std::cout << "Target fluid: GAS" << std::endl;
@@ -237,51 +276,82 @@ int main()
     
     }
 
+    // we check the memory needed by the requested grid against the budget. The estimate is done for
+    // the gas simulation, which needs the temperature slab, because the target fluid can be switched
+    // at runtime. If the grid exceeds the budget, it is downscaled or refused according to the policy
+    GLuint gridWidth = GRID_WIDTH, gridHeight = GRID_HEIGHT, gridDepth = GRID_DEPTH;
+    GLuint64 gridBytesPerCell = EstimateGridBytesPerCell(true);
+    GLuint64 gridBudget = (GLuint64) GRID_MEMORY_BUDGET_MB * 1024 * 1024;
+
+    if (!FitGridToBudget(gridWidth, gridHeight, gridDepth, gridBytesPerCell, gridBudget))
+    {
+        std::cout << "The requested grid " << GRID_WIDTH << "x" << GRID_HEIGHT << "x" << GRID_DEPTH << " needs "
+                  << ToMegabytes((GLuint64) GRID_WIDTH * GRID_HEIGHT * GRID_DEPTH * gridBytesPerCell) << " MB, over the budget of " << GRID_MEMORY_BUDGET_MB << " MB" << std::endl;
+
+        if (GRID_BUDGET_POLICY == REFUSE_GRID)
+        {
+            glfwTerminate();
+            return -1;
+        }
+
+        std::cout << "Grid downscaled to " << gridWidth << "x" << gridHeight << "x" << gridDepth << std::endl;
+    }
+
+    gridSize = glm::uvec3(gridWidth, gridHeight, gridDepth);
+    std::cout << "Simulation grid " << gridSize.x << "x" << gridSize.y << "x" << gridSize.z << ": estimated "
+              << ToMegabytes((GLuint64) gridSize.x * gridSize.y * gridSize.z * gridBytesPerCell) << " MB" << std::endl;
+
     // we set the initial values for forces and emitters to default
     ResetForcesAndEmitters(currTarget);
 
+    // we request the Shader Programs to the cache: they are compiled (or loaded from their binaries) while the
+    // textures and models are loaded, and they are finished before the render loop
     // we create the Shader Program for the creation of the shadow map
-    Shader shadow_shader("src/shaders/shadowmap/19_shadowmap.vert", "src/shaders/shadowmap/20_shadowmap.frag");
+    Shader shadow_shader(RequestProgram("src/shaders/shadowmap/19_shadowmap.vert", nullptr, "src/shaders/shadowmap/20_shadowmap.frag"));
     // we create the Shader Program used for objects (which presents different subroutines we can switch)
-    Shader illumination_shader = Shader("src/shaders/shadowmap/21_ggx_tex_shadow.vert", "src/shaders/shadowmap/22_ggx_tex_shadow.frag");
+    Shader illumination_shader = Shader(RequestProgram("src/shaders/shadowmap/21_ggx_tex_shadow.vert", nullptr, "src/shaders/shadowmap/22_ggx_tex_shadow.frag"));
+    // the depth pre-pass writes the depth of the scene before the shading, with the same positions of the shading pass
+    Shader depthPrePassShader = Shader(RequestProgram("src/shaders/shadowmap/depth_prepass.vert", nullptr, "src/shaders/shadowmap/20_shadowmap.frag"));
 
     // we create the Shader Programs for fluid simulation
-    Shader advectionShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom"  ,"src/shaders/simulation/advection.frag");
-    Shader macCormackShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom"  ,"src/shaders/simulation/macCormack_advection.frag");
-    Shader divergenceShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/divergence.frag");
-    Shader jacobiShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/jacobi_pressure.frag");
-    Shader externalForcesShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/apply_force.frag");
-    Shader pressureShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/pressure_projection.frag");
-    Shader dyeShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/add_dye.frag");
-    Shader fillShader = Shader("src/shaders/generic/load_proj_vertices.vert", "src/shaders/generic/fill.frag");
-
-    // we create the simulation Shader Programs for the requested target fluid
-    CreateFluidShaders(currTarget);
+    PassShader advectionShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom"  ,"src/shaders/simulation/advection.frag");
+    PassShader macCormackShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom"  ,"src/shaders/simulation/macCormack_advection.frag");
+    PassShader divergenceShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/divergence.frag");
+    PassShader jacobiShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/jacobi_pressure.frag");
+    PassShader externalForcesShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/apply_force.frag");
+    PassShader pressureShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/pressure_projection.frag");
+    PassShader dyeShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/add_dye.frag");
+    Shader fillShader = Shader(RequestProgram("src/shaders/generic/load_proj_vertices.vert", nullptr, "src/shaders/generic/fill.frag"));
+
+    // we create the simulation Shader Programs of both the target fluids, so switching fluid doesn't recompile them
+    CreateFluidShaders();
 
     // we create the Shader Programs for solid-fluid interaction
-    Shader borderObstacleShaderLayered = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/obstacles/border.geom","src/shaders/generic/fill.frag");
-    Shader borderObstacleShader = Shader("src/shaders/generic/load_vertices.vert","src/shaders/generic/fill.frag");
+    PassShader borderObstacleShaderLayered = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/obstacles/border.geom","src/shaders/generic/fill.frag");
+    PassShader borderObstacleShader = PassShader("src/shaders/generic/load_vertices.vert","src/shaders/generic/fill.frag");
 
-    Shader stencilObstacleShader = Shader("src/shaders/obstacles/position/obstacle_position.vert", "src/shaders/generic/set_layer.geom" , "src/shaders/generic/fill.frag");
-    Shader obstacleVelocityShader = Shader("src/shaders/obstacles/velocity/obstacle_velocity.vert", "src/shaders/obstacles/velocity/obstacle_velocity.geom", "src/shaders/obstacles/velocity/obstacle_velocity.frag");
+    PassShader stencilObstacleShader = PassShader("src/shaders/obstacles/position/obstacle_position.vert", "src/shaders/generic/set_layer.geom" , "src/shaders/generic/fill.frag");
+    PassShader rigidObstacleShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom", "src/shaders/obstacles/rigid/rigid_obstacle.frag");
 
     // we create the Shader Programs for fluid rendering
-    Shader raydataBackShader = Shader("src/shaders/rendering/raydata/raydata.vert", "src/shaders/rendering/raydata/raydata_back.frag");
-    Shader raydataFrontShader = Shader("src/shaders/rendering/raydata/raydata.vert", "src/shaders/rendering/raydata/raydata_front.frag");
-
-    Shader blendingShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/blending/blending.frag");
-    Shader blurShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/blur.frag");
-    Shader deNoiseShader = Shader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/glslSmartDeNoise/frag.glsl");
+    PassShader raydataBackShader = PassShader("src/shaders/rendering/raydata/raydata.vert", "src/shaders/rendering/raydata/raydata_back.frag");
+    PassShader raydataFrontShader = PassShader("src/shaders/rendering/raydata/raydata.vert", "src/shaders/rendering/raydata/raydata_front.frag");
+
+    PassShader blendingShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/blending/blending.frag");
+    PassShader blurShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/blur.frag");
+    PassShader deNoiseShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/glslSmartDeNoise/frag.glsl");
+    PassShader separableBlurShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/blur/separable_blur.frag");
+    PassShader aTrousShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/atrous/atrous.frag");
+    PassShader transmittanceShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/transmittance/transmittance.frag");
+    PassShader temporalShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/temporal/temporal.frag");
+    PassShader fluidStencilShader = PassShader("src/shaders/generic/load_proj_vertices.vert", "src/shaders/shadowmap/20_shadowmap.frag");
+    PassShader sceneCopyShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/blending/scene_copy.frag");
 
     // we create the rendering Shader Program
-    Shader renderShader = Shader("src/shaders/rendering/raydata/raydata.vert", "src/shaders/rendering/raymarching.frag");
-
-    // we parse the Shader Programs to search for the number and names of the subroutines.
-    // the names are placed in the shaders vector only for the illumination shader
-    SetupShader(illumination_shader.Program, true);
-    SetupShader(renderShader.Program, false);
-    // we print on console the name of the first subroutine used
-    PrintCurrentShader(current_subroutine);
+    PassShader renderShader = PassShader("src/shaders/rendering/raydata/raydata.vert", "src/shaders/rendering/raymarching.frag");
+    PassShader occupancyShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom", "src/shaders/rendering/occupancy/occupancy.frag");
+    PassShader gradientShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom", "src/shaders/rendering/gradient/level_set_gradient.frag");
+    PassShader stepsSumShader = PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/rendering/raysteps/steps_sum.frag");
 
     // we load the images and store them in a vector
     textureID.push_back(LoadTexture("textures/UV_Grid_Sm.png")); // objects texture
@@ -291,36 +361,44 @@ int main()
     Model planeModel("models/plane.obj"); // floor
     Model cubeModel("models/cube.obj"); // fluid volume
 
+    RegisterModel(&planeModel);
+    RegisterModel(&cubeModel);
+
     /////////////////// CREATION OF OBSTACLES /////////////////////////////////////////////////////////////
 
     CreateObstacleObject("models/bunny_lp.obj", "bunny", glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(0.3f, 0.3f, 0.3f));
 
-    CreateObstacleObject("models/sphere.obj", "sphere", glm::vec3(-5.0f, 1.0f, 1.0f), glm::vec3(1.0f));
+    CreatePrimitiveObstacleObject(OBSTACLE_SPHERE, "sphere", glm::vec3(-5.0f, 1.0f, 1.0f), glm::vec3(1.0f));
     
     CreateObstacleObject("models/babyyoda.obj", "models/low-poly_babyyoda.obj", "baby yoda", glm::vec3(4.0f, 1.0f, 1.0f), glm::vec3(0.3f, 0.3f, 0.3f));
 
+    // we wait for the requested Shader Programs, and we save the binaries of the ones compiled from source
+    FinishPendingPrograms();
+    PrintShaderCacheStats();
+
+    // we parse the Shader Programs to search for the number and names of the subroutines.
+    // the names are placed in the shaders vector only for the illumination shader
+    SetupShader(illumination_shader.Program, true);
+    SetupShader(renderShader.Program, false);
+    ResolveRaymarchingSubroutines(renderShader);
+    // we print on console the name of the first subroutine used
+    PrintCurrentShader(current_subroutine);
+
     /////////////////// CREATION OF BUFFERS FOR THE SIMULATION GRID /////////////////////////////////////////
 
     // we setup the simulation grid
-    SetGridSize(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH);
+    SetGridSize(gridSize.x, gridSize.y, gridSize.z);
 
-    // we create the simulation buffers
+    // we create the simulation buffers. The persistent slabs are imported in the simulation graph, which swaps
+    // them with the transient ones, so they are taken from the slab pool as well: the pool owns each texture
+    // independently of the slab holding it
+    SetMemorySubsystem(MEMORY_SIMULATION);
 
-    Slab velocity_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 3);
+    Slab velocity_slab = AcquireSlab({gridSize.x, gridSize.y, gridSize.z, 3});
     std::cout << "Created velocity grid = {" << velocity_slab.fbo << " , " << velocity_slab.tex << "}" << std::endl;
-    Slab pressure_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 1);
-    std::cout << "Created pressure grid = {" << pressure_slab.fbo << " , " << pressure_slab.tex << "}" << std::endl;
-    Slab divergence_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 1);
-    std::cout << "Created divergence grid = {" << divergence_slab.fbo << " , " << divergence_slab.tex << "}" << std::endl;
-
-    // advection buffers (macCormack)
-    Slab phi1_hat_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 3);
-    std::cout << "Created phi1_hat grid = {" << phi1_hat_slab.fbo << " , " << phi1_hat_slab.tex << "}" << std::endl;
-    Slab phi2_hat_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 3);
-    std::cout << "Created phi2_hat grid = {" << phi2_hat_slab.fbo << " , " << phi2_hat_slab.tex << "}" << std::endl;
 
     // we create a buffer representing the density for gas simulation or level set for liquid simulation
-    Slab density_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 1);
+    Slab density_slab = AcquireSlab({gridSize.x, gridSize.y, gridSize.z, 1});
     std::cout << "Created density grid = {" << density_slab.fbo << " , " << density_slab.tex << "}" << std::endl;
 
     // we create the buffers for the target fluid
@@ -328,16 +406,18 @@ int main()
     if (currTarget == GAS)
     {
         // gas simulation exclusive buffer
-        temperature_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 1);
+        temperature_slab = AcquireSlab({gridSize.x, gridSize.y, gridSize.z, 1});
         std::cout << "Created temperature grid = {" << temperature_slab.fbo << " , " << temperature_slab.tex << "}" << std::endl;
     }
 
     /////////////////// CREATION OF TEMPORARY BUFFERS /////////////////////////////////////////
 
-    Slab temp_velocity_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 3);
-    std::cout << "Created temp velocity grid = {" << temp_velocity_slab.fbo << " , " << temp_velocity_slab.tex << "}" << std::endl;
-    Slab temp_pressure_divergence_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 1);
-    std::cout << "Created temp pressure divergence grid = {" << temp_pressure_divergence_slab.fbo << " , " << temp_pressure_divergence_slab.tex << "}" << std::endl;
+    // the temporary buffers of the simulation step (pressure, divergence, advection and ping-pong
+    // buffers) are transient slabs of the simulation graph: they are allocated
+    // by the graph at the first step, sharing the textures when their lifetimes don't overlap
+    RenderGraph simulationGraph("simulation");
+
+    SetMemorySubsystem(MEMORY_RENDERING);
 
     Slab temp_screenSize_slab = Create2DSlab(width, height, 4, false);
     std::cout << "Created temp screen size grid = {" << temp_screenSize_slab.fbo << " , " << temp_screenSize_slab.tex << "}" << std::endl;
@@ -348,47 +428,62 @@ int main()
     std::cout << "Created raydata back grid = {" << rayDataBack.fbo << " , " << rayDataBack.tex << "}" << std::endl;
     Slab rayDataFront = Create2DSlab(width, height, 4, false);
     std::cout << "Created raydata front grid = {" << rayDataFront.fbo << " , " << rayDataFront.tex << "}" << std::endl;
+
+    // the occupancy volume stores the density range of the blocks of the grid, to skip the empty space in the raymarching
+    glm::uvec3 occupancySize = OccupancyGridSize(gridSize.x, gridSize.y, gridSize.z);
+    Slab occupancy_slab = CreateSlab(occupancySize.x, occupancySize.y, occupancySize.z, 2);
+    std::cout << "Created occupancy grid = {" << occupancy_slab.fbo << " , " << occupancy_slab.tex << "}" << std::endl;
+
+    // the packed gradient volume stores the gradient and the value of the liquid level set, read by the raymarcher
+    Slab gradient_slab = CreateSlab(gridSize.x, gridSize.y, gridSize.z, 4);
+    std::cout << "Created level set gradient grid = {" << gradient_slab.fbo << " , " << gradient_slab.tex << "}" << std::endl;
+
+    // the light transmittance volume of the gas is swept from the light with two slabs for its layers
+    GLuint lightVolumeSize = LightVolumeSize(gridSize.x, gridSize.y, gridSize.z);
+    Slab transmittance_slab = CreateSlab(lightVolumeSize, lightVolumeSize, lightVolumeSize, 1);
+    Slab lightSlice_slab = Create2DSlab(lightVolumeSize, lightVolumeSize, 1, true);
+    Slab temp_lightSlice_slab = Create2DSlab(lightVolumeSize, lightVolumeSize, 1, true);
+    glm::mat4 textureToLight = glm::mat4(1.0f);
+
+    // the steps of the raymarching are measured only if requested in the gui. The texture has 4 components
+    // because RGB32F is not required to be color renderable
+    Slab raySteps_slab = Create2DSlab(width, height, 4, false);
+
+    // the steps are summed in two slabs reduced by a block of pixels, read back without waiting for the GPU
+    glm::uvec2 stepsSumSize = StepsSumSize(width, height);
+    Slab stepsSum_slab = Create2DSlab(stepsSumSize.x, stepsSumSize.y, 4, false);
+    Slab temp_stepsSum_slab = Create2DSlab(stepsSumSize.x, stepsSumSize.y, 4, false);
+
+    // the temporal accumulation of the fluid color uses two history buffers, filtered for the reprojection
+    Slab fluidHistory = Create2DSlab(width, height, 4, true);
+    Slab temp_fluidHistory = Create2DSlab(width, height, 4, true);
     
     /////////////////// CREATION OF BUFFERS AND DATA FOR OBSTACLES /////////////////////////////////////////
 
-    ObstacleSlab obstacle_slab = CreateObstacleBuffer(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH);
+    SetMemorySubsystem(MEMORY_OBSTACLES);
+
+    ObstacleSlab obstacle_slab = CreateObstacleBuffer(gridSize.x, gridSize.y, gridSize.z, true);
     std::cout << "Created obstacle grid = {" << obstacle_slab.fbo << " , " << obstacle_slab.tex << " , " << obstacle_slab.depthStencil << " , " << obstacle_slab.firstLayerFBO << " , " << obstacle_slab.lastLayerFBO << "}" << std::endl;
 
-    Slab obstacle_velocity_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 3);
+    // the obstacle velocity persists between the steps, because the obstacle buffers are redrawn only when the obstacles change
+    Slab obstacle_velocity_slab = AcquireSlab({gridSize.x, gridSize.y, gridSize.z, 3});
     std::cout << "Created obstacle velocity grid = {" << obstacle_velocity_slab.fbo << " , " << obstacle_velocity_slab.tex << "}" << std::endl;
 
     /////////////////// CREATION OF BUFFER FOR THE DEPTH MAP - SHADOW MAP ///////////////////////////////////
 
     // buffer dimension: too large -> performance may slow down if we have many lights; too small -> strong aliasing
     const GLuint SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-    GLuint depthMapFBO;
-    // we create a Frame Buffer Object: the first rendering step will render to this buffer, and not to the real frame buffer
-    glGenFramebuffers(1, &depthMapFBO);
-    // we create a texture for the depth map
-    GLuint depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    // in the texture, we will save only the depth data of the fragments. Thus, we specify that we need to render only depth in the first rendering step
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    // we set to clamp the uv coordinates outside [0,1] to the color of the border
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    GLuint depthMapFBO, depthMap;
+    CreateShadowMap(SHADOW_WIDTH, SHADOW_HEIGHT, depthMapFBO, depthMap);
 
-    // outside the area covered by the light frustum, everything is rendered in shadow (because we set GL_CLAMP_TO_BORDER)
-    // thus, we set the texture border to white, so to render correctly everything not involved by the shadow map
-    //*************
-    GLfloat borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    // the static objects never move, so their shadow map is cached and copied in the shadow map at each update,
+    // before the dynamic objects. Both are rendered again only when the light or the dynamic objects change
+    GLuint staticDepthMapFBO, staticDepthMap;
+    CreateShadowMap(SHADOW_WIDTH, SHADOW_HEIGHT, staticDepthMapFBO, staticDepthMap);
 
-    // we bind the depth map FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    // we set that we are not calculating nor saving color data
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    bool staticShadowMapValid = false;
+    glm::mat4 shadowLightSpaceMatrix = glm::mat4(1.0f);
+    vector<ShadowCaster> shadowCasters;
 
     /////////////////// CREATION OF SCENE BUFFERS /////////////////////////////////////////
 
@@ -398,11 +493,55 @@ int main()
     Scene fluidScene = CreateScene(width, height);
     std::cout << "Created fluid scene framebuffer = {" << fluidScene.fbo << " , " << fluidScene.colorTex << ", " << fluidScene.depthTex << "}" << std::endl;
 
+    // the buffers of the fluid rendering (raydata, fluid scene and post processing) are created at the window
+    // resolution, and they are recreated when the resolution of the raymarching changes
+    GLint fluidResolution = 0;
+    GLuint fluidWidth = width, fluidHeight = height;
+
+    // the rays are jittered with a tiled blue noise, rotated at each frame if the frames are accumulated
+    SetMemorySubsystem(MEMORY_RENDERING);
+    GLuint blueNoiseTexture = CreateBlueNoiseTexture(BLUE_NOISE_SIZE);
+
+    // the history of the temporal accumulation is discarded when it doesn't match the current fluid
+    bool fluidHistoryValid = false;
+    glm::mat4 prevFluidMVP = glm::mat4(1.0f);
+    GLuint fluidFrame = 0;
+
+    // the gradient volume and the raymarching are measured on the GPU, the raymarching with a timer for each
+    // shading path of the liquid. The benchmark renders the two paths for GRADIENT_BENCHMARK_FRAMES frames each
+    GpuTimer gradientTimer = CreateGpuTimer();
+    GpuTimer tricubicRaymarchingTimer = CreateGpuTimer();
+    GpuTimer packedRaymarchingTimer = CreateGpuTimer();
+    GLuint gradientBenchmarkFrames = 0;
+
+    // the post-process effects of the liquid are measured with a timer for each effect, to compare them
+    GpuTimer liquidEffectTimers[LIQUID_EFFECT_COUNT];
+    for (int i = 0; i < LIQUID_EFFECT_COUNT; i++)
+        liquidEffectTimers[i] = CreateGpuTimer();
+
+    // the scene shading and the final composition are measured, to compare the depth pre-pass and the stencil
+    GpuTimer sceneTimer = CreateGpuTimer();
+    GpuTimer compositionTimer = CreateGpuTimer();
+    bool gradientBenchmarkRunning = false;
+    glm::vec2 gradientBenchmarkSum = glm::vec2(0.0f);
+    glm::vec2 gradientBenchmarkCount = glm::vec2(0.0f);
+
+    // the packed gradient volume is built only when the raymarching reads it, so it can be older than the level set
+    bool gradientValid = false;
+
     ///////////////////////////////////////////////////////////////////
 
     // Create vertex objects for fluid simulation
+    SetMemorySubsystem(MEMORY_SIMULATION);
     InitSimulationVAOs();
 
+    // the fluid box borders are static, so we draw them in the obstacle position buffer only once
+    ClearObstacleBuffers(obstacle_slab, obstacle_velocity_slab);
+    BorderObstacle(borderObstacleShader, borderObstacleShaderLayered, obstacle_slab);
+
+    // we print the memory allocated at startup (the transient slabs of the simulation are allocated at the first step)
+    PrintMemoryReport();
+
     // we call the init function in case of liquid simulation as default
     if (currTarget == LIQUID)
         InitLiquidSimulation(*initLiquidShader, density_slab, levelSetInitialHeight);
@@ -433,26 +572,12 @@ int main()
             // Destroy old fluid context
             // renderShader.Delete();
 
+            // the temperature grid goes back to the slab pool, to be recycled when switching back to gas
             if (prevTarget == GAS)
-            {
-                DestroySlab(temperature_slab);
-
-                temperatureShader->Delete();
-                buoyancyShader->Delete();
-            }
-            else
-            {
-                initLiquidShader->Delete();
-                dampingLevelSetShader->Delete();
-                gravityShader->Delete();
-            }
+                ReleaseSlab(temperature_slab);
             
             // Reset all simulation slabs
-            ClearSlabs(4, &velocity_slab, &pressure_slab, &divergence_slab, &density_slab);
-
-            // Instantiate the new fluid shaders
-            // CreateRenderShader(currTarget);
-            CreateFluidShaders(currTarget);
+            ClearSlabs(2, &velocity_slab, &density_slab);
 
             if (currTarget == LIQUID)
             {
@@ -462,16 +587,33 @@ int main()
             else
             {
                 densityDissipation = 0.99f;
-                temperature_slab = CreateSlab(GRID_WIDTH, GRID_HEIGHT, GRID_DEPTH, 1);
+                SetMemorySubsystem(MEMORY_SIMULATION);
+                temperature_slab = AcquireSlab({gridSize.x, gridSize.y, gridSize.z, 1});
             }
 
             ResetForcesAndEmitters(currTarget);
+
+            // the bounds and the history of the old fluid are not valid for the new one
+            rayBoundsMin = glm::vec3(-1.0f);
+            rayBoundsMax = glm::vec3(1.0f);
+            fluidHistoryValid = false;
+            gradientValid = false;
         }
 
         // Check is an I/O event is happening
         glfwPollEvents();
         // we apply FPS camera movements
         apply_camera_movements();
+
+        // we upload the models of the obstacle objects loaded in background
+        UpdatePendingObstacleObjects();
+
+        // we voxelize the models of the new obstacle objects
+        for_each(obstacleObjects.begin(), obstacleObjects.end(), [&](ObstacleObject* obj)
+        {
+            if (!obj->IsSimulationReady())
+                VoxelizeObstacleModel(stencilObstacleShader, obj);
+        });
         
         // Draw the UI
         DrawUI();
@@ -479,13 +621,44 @@ int main()
         // we update the simulation based on the defined framerate
         if (currentFrame - lastSimulationUpdate >= simulationFramerate)
         {
-            /////////////////// STEP 1 - UPDATE OBSTACLES  //////////////////////////////////////////////////////////////////////////
+            // we declare the passes of the simulation step in the graph, with the slabs they read and write.
+            // the velocity, density, temperature and obstacle velocity slabs persist between the steps, while all the others
+            // are transient: the graph assigns them to pooled slabs when the step is compiled
+            simulationGraph.Reset();
+
+            SlabDesc scalarDesc = {gridSize.x, gridSize.y, gridSize.z, 1};
+            SlabDesc vectorDesc = {gridSize.x, gridSize.y, gridSize.z, 3};
+
+            SlabHandle velocity = simulationGraph.Import("velocity", &velocity_slab, vectorDesc);
+            SlabHandle density = simulationGraph.Import("density", &density_slab, scalarDesc);
+            SlabHandle temperature = -1;
+            if (currTarget == GAS)
+                temperature = simulationGraph.Import("temperature", &temperature_slab, scalarDesc);
 
-            // we clear the obstacle buffers
-            ClearObstacleBuffers(obstacle_slab, obstacle_velocity_slab);
+            SlabHandle obstacleVelocity = simulationGraph.Import("obstacle velocity", &obstacle_velocity_slab, vectorDesc);
+            SlabHandle divergence = simulationGraph.Create("divergence", scalarDesc);
+            SlabHandle pressure = simulationGraph.Create("pressure", scalarDesc);
 
-            // we draw fluid box borders in the obstacle position buffer
-            BorderObstacle(borderObstacleShader, borderObstacleShaderLayered, obstacle_slab);
+            // each pass updating a field in ping-pong gets its own temporary slab, so its lifetime is limited to the pass
+            auto temporarySlab = [&](const std::string &name, SlabDesc desc)
+            {
+                return simulationGraph.Create(name + " temp", desc);
+            };
+
+            // the MacCormack advection of a field needs the predictor and corrector slabs, with the same format of the field
+            auto addAdvectionPass = [&](const std::string &name, SlabHandle field, SlabDesc desc, GLfloat dissipation)
+            {
+                SlabHandle phi1Hat = simulationGraph.Create(name + " phi1_hat", desc);
+                SlabHandle phi2Hat = simulationGraph.Create(name + " phi2_hat", desc);
+                SlabHandle temp = temporarySlab(name, desc);
+
+                simulationGraph.AddPass("advect " + name, {velocity, field}, {field, phi1Hat, phi2Hat, temp}, [&, field, phi1Hat, phi2Hat, temp, dissipation]()
+                {
+                    AdvectMacCormack(advectionShader, macCormackShader, simulationGraph.Get(velocity), simulationGraph.Get(phi1Hat), simulationGraph.Get(phi2Hat), obstacle_slab, simulationGraph.Get(field), simulationGraph.Get(temp), dissipation, timeStep);
+                });
+            };
+
+            /////////////////// STEP 1 - UPDATE OBSTACLES  //////////////////////////////////////////////////////////////////////////
 
             // we define the model matrix of the fluid volume
             cubeModelMatrix = glm::mat4(1.0f);
@@ -507,34 +680,48 @@ int main()
                 obj->modelMatrix = glm::translate(obj->modelMatrix, obj->position);
                 obj->modelMatrix = glm::rotate(obj->modelMatrix, glm::radians(orientationY), glm::vec3(0.0f, 1.0f, 0.0f));
                 obj->modelMatrix = glm::scale(obj->modelMatrix, obj->scale);
-
-                // we draw the obstacle in the obstacle buffers
-                DynamicObstacle(stencilObstacleShader, obstacleVelocityShader, obstacle_slab, obstacle_velocity_slab, temp_velocity_slab, obj, fluidTranslation, fluidScale, simulationFramerate);
             });
 
-            /////////////////// STEP 2 - UPDATE SIMULATION  //////////////////////////////////////////////////////////////////////////
+            // the obstacle position buffer is not tracked by the graph (it is used also by the fluid rendering),
+            // so the pass is declared with side effects
+            simulationGraph.AddPass("obstacles", {}, {obstacleVelocity}, [&]()
+            {
+                // we draw the active obstacles in the obstacle buffers, if they changed since the previous step
+                RigidObstacles(rigidObstacleShader, obstacle_slab, simulationGraph.Get(obstacleVelocity), obstacleObjects, fluidTranslation, fluidScale, simulationFramerate);
+
+                // the obstacle passes change the bound vao and the viewport, so we bind the full-screen
+                // quad VAO and set up rendering for the simulation passes after them
+                BeginSimulation(timeStep);
+            }, true);
 
-            // we bind the full-screen quad VAO and set up rendering
-            BeginSimulation();
+            /////////////////// STEP 2 - UPDATE SIMULATION  //////////////////////////////////////////////////////////////////////////
 
             // advect velocity
-            AdvectMacCormack(advectionShader, macCormackShader, velocity_slab, phi1_hat_slab, phi2_hat_slab, obstacle_slab, velocity_slab, temp_velocity_slab, velocityDissipation, timeStep);
-            
+            addAdvectionPass("velocity", velocity, vectorDesc, velocityDissipation);
+
             // advect gas density or liquid level set
-            AdvectMacCormack(advectionShader, macCormackShader, velocity_slab, phi1_hat_slab, phi2_hat_slab, obstacle_slab, density_slab, temp_pressure_divergence_slab, densityDissipation, timeStep);
-           
+            addAdvectionPass("density", density, scalarDesc, densityDissipation);
+
             if (currTarget == GAS)
             {
                 // advect temperature
-                AdvectMacCormack(advectionShader, macCormackShader, velocity_slab, phi1_hat_slab, phi2_hat_slab, obstacle_slab, temperature_slab, temp_pressure_divergence_slab, temperatureDissipation, timeStep);
+                addAdvectionPass("temperature", temperature, scalarDesc, temperatureDissipation);
 
                 // we apply the buoyancy force
-                Buoyancy(*buoyancyShader, velocity_slab, temperature_slab, density_slab, temp_velocity_slab, ambientTemperature, timeStep, dampingBuoyancy, ambientWeight);
+                SlabHandle temp = temporarySlab("buoyancy", vectorDesc);
+                simulationGraph.AddPass("buoyancy", {velocity, temperature, density}, {velocity, temp}, [&, temp]()
+                {
+                    Buoyancy(*buoyancyShader, simulationGraph.Get(velocity), simulationGraph.Get(temperature), simulationGraph.Get(density), simulationGraph.Get(temp), ambientTemperature, dampingBuoyancy, ambientWeight);
+                });
             }
             else
             {
                 // apply level set damping
-                ApplyLevelSetDamping(*dampingLevelSetShader, density_slab, obstacle_slab, temp_pressure_divergence_slab, levelSetDampingFactor, levelSetEquilibriumHeight);
+                SlabHandle temp = temporarySlab("level set damping", scalarDesc);
+                simulationGraph.AddPass("level set damping", {density}, {density, temp}, [&, temp]()
+                {
+                    ApplyLevelSetDamping(*dampingLevelSetShader, simulationGraph.Get(density), obstacle_slab, simulationGraph.Get(temp), levelSetDampingFactor, levelSetEquilibriumHeight);
+                });
             }
 
             // we splat density and temperature for each emitter
@@ -547,8 +734,12 @@ int main()
                 {
                     if (fluidQuantity->radius > 0.0f)
                     {
-                        AddDensity(dyeShader, density_slab, temp_pressure_divergence_slab, fluidQuantity->position, fluidQuantity->radius, dyeColor, GL_FALSE);
-                        AddTemperature(*temperatureShader, temperature_slab, temp_pressure_divergence_slab, fluidQuantity->position, fluidQuantity->radius, fluidQuantity->temperature);
+                        SlabHandle temp = temporarySlab("emitter", scalarDesc);
+                        simulationGraph.AddPass("emitter", {density, temperature}, {density, temperature, temp}, [&, temp, fluidQuantity, dyeColor]()
+                        {
+                            AddDensity(dyeShader, simulationGraph.Get(density), simulationGraph.Get(temp), fluidQuantity->position, fluidQuantity->radius, dyeColor, GL_FALSE);
+                            AddTemperature(*temperatureShader, simulationGraph.Get(temperature), simulationGraph.Get(temp), fluidQuantity->position, fluidQuantity->radius, fluidQuantity->temperature);
+                        });
                     }
                 });
             }
@@ -561,12 +752,20 @@ int main()
                     {
                         // we draw the level set as gaussian splat in the density buffer by adding a negative value equal to the radius
                         // this will create a level set consistent to its definition (negative inside and equal to surface distance, positive outside)
-                        AddDensity(dyeShader, density_slab, temp_pressure_divergence_slab, fluidQuantity->position, fluidQuantity->radius, -fluidQuantity->radius, GL_TRUE);
+                        SlabHandle temp = temporarySlab("emitter", scalarDesc);
+                        simulationGraph.AddPass("emitter", {density}, {density, temp}, [&, temp, fluidQuantity]()
+                        {
+                            AddDensity(dyeShader, simulationGraph.Get(density), simulationGraph.Get(temp), fluidQuantity->position, fluidQuantity->radius, -fluidQuantity->radius, GL_TRUE);
+                        });
                     }
                 });
 
                 // we apply the gravity force to the level set
-                ApplyGravity(*gravityShader, velocity_slab, density_slab, temp_velocity_slab, gravityAcceleration, timeStep, gravityLevelSetThreshold);
+                SlabHandle temp = temporarySlab("gravity", vectorDesc);
+                simulationGraph.AddPass("gravity", {velocity, density}, {velocity, temp}, [&, temp]()
+                {
+                    ApplyGravity(*gravityShader, simulationGraph.Get(velocity), simulationGraph.Get(density), simulationGraph.Get(temp), gravityAcceleration, gravityLevelSetThreshold);
+                });
             }
 
             // we apply the external forces to the fluid
@@ -574,18 +773,70 @@ int main()
             {
                 if (externalForce->radius > 0.0f && externalForce->strength > 0.0f)
                 {
-                    ApplyExternalForces(externalForcesShader, velocity_slab, temp_velocity_slab, timeStep, externalForce->direction * externalForce->strength, externalForce->position, externalForce->radius);
+                    SlabHandle temp = temporarySlab("external force", vectorDesc);
+                    simulationGraph.AddPass("external force", {velocity}, {velocity, temp}, [&, temp, externalForce]()
+                    {
+                        ApplyExternalForces(externalForcesShader, simulationGraph.Get(velocity), simulationGraph.Get(temp), externalForce->direction * externalForce->strength, externalForce->position, externalForce->radius);
+                    });
                 }
             });
 
             // we update the divergence texture
-            Divergence(divergenceShader, velocity_slab, divergence_slab, obstacle_slab, obstacle_velocity_slab, temp_pressure_divergence_slab);
+            SlabHandle divergenceTemp = temporarySlab("divergence", scalarDesc);
+            simulationGraph.AddPass("divergence", {velocity, obstacleVelocity}, {divergence, divergenceTemp}, [&]()
+            {
+                Divergence(divergenceShader, simulationGraph.Get(velocity), simulationGraph.Get(divergence), obstacle_slab, simulationGraph.Get(obstacleVelocity), simulationGraph.Get(divergenceTemp));
+            });
 
             // we update the pressure texture
-            Jacobi(jacobiShader, pressure_slab, divergence_slab, obstacle_slab, temp_pressure_divergence_slab, pressureIterations);
+            SlabHandle pressureTemp = temporarySlab("pressure", scalarDesc);
+            simulationGraph.AddPass("jacobi", {divergence}, {pressure, pressureTemp}, [&]()
+            {
+                Jacobi(jacobiShader, simulationGraph.Get(pressure), simulationGraph.Get(divergence), obstacle_slab, simulationGraph.Get(pressureTemp), pressureIterations);
+            });
 
             // we apply the pressure projection
-            ApplyPressure(pressureShader, velocity_slab, pressure_slab, obstacle_slab, obstacle_velocity_slab, temp_velocity_slab);
+            SlabHandle projectionTemp = temporarySlab("pressure projection", vectorDesc);
+            simulationGraph.AddPass("pressure projection", {velocity, pressure, obstacleVelocity}, {velocity, projectionTemp}, [&]()
+            {
+                ApplyPressure(pressureShader, simulationGraph.Get(velocity), simulationGraph.Get(pressure), obstacle_slab, simulationGraph.Get(obstacleVelocity), simulationGraph.Get(projectionTemp));
+            });
+
+            // we assign the transient slabs and run the step
+            SetMemorySubsystem(MEMORY_SIMULATION);
+            simulationGraph.Compile();
+            simulationGraph.Execute();
+
+            // we update the occupancy of the new density for the raymarching
+            BuildOccupancy(occupancyShader, density_slab, occupancy_slab);
+
+            // we update the packed gradient volume of the new level set for the shading of the liquid, if it's used
+            if (currTarget == LIQUID && (packedGradients || gradientBenchmarkRunning))
+            {
+                BeginGpuTimer(gradientTimer);
+                BuildLevelSetGradient(gradientShader, density_slab, obstacle_slab, gradient_slab);
+                EndGpuTimer(gradientTimer);
+            }
+
+            gradientValid = currTarget == LIQUID && (packedGradients || gradientBenchmarkRunning);
+
+            // we update the light transmittance for the self shadowing of the gas
+            if (currTarget == GAS && gasSelfShadowing)
+                LightTransmittance(transmittanceShader, density_slab, transmittance_slab, lightSlice_slab, temp_lightSlice_slab, lightDir0, cubeModelMatrix, textureToLight);
+
+            // we read back the occupancy in background, to bound the raymarching in the next frames
+            if (tightRayBounds)
+                RequestOccupancyReadback(occupancy_slab);
+
+            if (validateObstacles)
+            {
+                ValidateObstacleBuffers(obstacle_slab, obstacle_velocity_slab, obstacleObjects, fluidTranslation, fluidScale, simulationFramerate);
+                validateObstacles = GL_FALSE;
+            }
+
+            // after the first step, we print the memory with the transient slabs allocated
+            if (lastSimulationUpdate == 0.0f)
+                PrintMemoryReport();
 
             // reset the state
             EndSimulation();
@@ -614,21 +865,74 @@ int main()
         // transformation matrix for the light
         lightSpaceMatrix = lightProjection * lightView;
 
-        /// We "install" the  Shader Program for the shadow mapping creation
-        shadow_shader.Use();
+        // we collect the state of the dynamic objects, to check if they moved since the last shadow map
+        vector<ShadowCaster> casters;
+        for_each(obstacleObjects.begin(), obstacleObjects.end(), [&](ObstacleObject* obj)
+        {
+            if (obj->isActive)
+                casters.push_back({obj, obj->objectModel, obj->modelMatrix});
+        });
+
+        // the static layer depends only on the light, the dynamic layer also on the casters
+        bool staticShadowChanged = !staticShadowMapValid || lightSpaceMatrix != shadowLightSpaceMatrix;
+        bool shadowChanged = staticShadowChanged || casters.size() != shadowCasters.size();
+
+        for (size_t i = 0; i < casters.size() && !shadowChanged; i++)
+        {
+            shadowChanged = casters[i].obstacle != shadowCasters[i].obstacle || casters[i].model != shadowCasters[i].model ||
+                            casters[i].modelMatrix != shadowCasters[i].modelMatrix;
+        }
+
+        if (!shadowMapCaching || shadowChanged)
+        {
+            /// We "install" the  Shader Program for the shadow mapping creation
+            shadow_shader.Use();
 
-        // we pass the transformation matrix as uniform
-        glUniformMatrix4fv(glGetUniformLocation(shadow_shader.Program, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+            // we pass the transformation matrix as uniform
+            glUniformMatrix4fv(glGetUniformLocation(shadow_shader.Program, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
 
-        // we set the viewport for the first rendering step = dimensions of the depth texture
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+            // we set the viewport for the first rendering step = dimensions of the depth texture
+            glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 
-        // we activate the FBO for the depth map rendering
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
+            if (!shadowMapCaching)
+            {
+                // we activate the FBO for the depth map rendering
+                glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+                glClear(GL_DEPTH_BUFFER_BIT);
 
-        // we render the scene, using the shadow shader
-        RenderObjects(shadow_shader, planeModel, SHADOWMAP, depthMap);
+                // we render the scene, using the shadow shader
+                RenderObjects(shadow_shader, planeModel, SHADOWMAP, depthMap, ALL_LAYERS);
+
+                staticShadowMapValid = false;
+            }
+            else
+            {
+                // we render the static objects in their cached shadow map only when the light changes
+                if (staticShadowChanged)
+                {
+                    glBindFramebuffer(GL_FRAMEBUFFER, staticDepthMapFBO);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+
+                    RenderObjects(shadow_shader, planeModel, SHADOWMAP, staticDepthMap, STATIC_LAYER);
+
+                    staticShadowMapValid = true;
+                    shadowMapUpdates.x++;
+                }
+
+                // we copy the static shadow map and we render the dynamic objects over it
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, staticDepthMapFBO);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthMapFBO);
+                glBlitFramebuffer(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT, 0, 0, SHADOW_WIDTH, SHADOW_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+                glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+                RenderObjects(shadow_shader, planeModel, SHADOWMAP, depthMap, DYNAMIC_LAYER);
+
+                shadowMapUpdates.y++;
+            }
+
+            shadowLightSpaceMatrix = lightSpaceMatrix;
+            shadowCasters = casters;
+        }
 
         /////////////////// STEP 3.5 - SCENE RENDERING: RENDERING FROM CAMERA ////////////////////////////////////////////////////////
 
@@ -652,6 +956,25 @@ int main()
         // we set the viewport for the rendering step
         glViewport(0, 0, width, height);
 
+        BeginGpuTimer(sceneTimer);
+
+        // with the depth pre-pass, the depth of the scene is written first, and the shading pass only tests it:
+        // the hidden fragments are rejected by the early depth test, so each pixel is shaded once
+        if (depthPrePass)
+        {
+            depthPrePassShader.Use();
+
+            glUniformMatrix4fv(glGetUniformLocation(depthPrePassShader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
+            glUniformMatrix4fv(glGetUniformLocation(depthPrePassShader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            RenderObjects(depthPrePassShader, planeModel, DEPTH_PREPASS, depthMap, ALL_LAYERS);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+            glDepthFunc(GL_LEQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
         // We "install" the selected Shader Program as part of the current rendering process. We pass to the shader the light transformation matrix, and the depth map rendered in the first rendering step
         illumination_shader.Use();
 
@@ -679,7 +1002,15 @@ int main()
         glUniform1f(f0Location, F0);
 
         // we render the scene 
-        RenderObjects(illumination_shader, planeModel, RENDER, depthMap);
+        RenderObjects(illumination_shader, planeModel, RENDER, depthMap, ALL_LAYERS);
+
+        if (depthPrePass)
+        {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+
+        EndGpuTimer(sceneTimer);
 
         // we render fluid volume (back first to be included in the scene)
         fillShader.Use();
@@ -703,23 +1034,187 @@ int main()
 
         /////////////////// STEP 4 - RAYDATA: GENERATING DATA FOR RAYMARCHING ////////////////////////////////////////////////
 
-        // we calculate the inverse screen size
-        glm::vec2 inverseScreenSize = glm::vec2(1.0f / width, 1.0f / height);
+        // we recreate the buffers of the fluid rendering if the resolution of the raymarching has changed
+        if (fluidResolution != raymarchingResolution)
+        {
+            fluidResolution = raymarchingResolution;
+            fluidWidth = glm::max(width >> fluidResolution, 1);
+            fluidHeight = glm::max(height >> fluidResolution, 1);
+
+            DestroySlab(temp_screenSize_slab);
+            DestroySlab(rayDataBack);
+            DestroySlab(rayDataFront);
+            DestroySlab(raySteps_slab);
+            DestroySlab(stepsSum_slab);
+            DestroySlab(temp_stepsSum_slab);
+            DestroySlab(fluidHistory);
+            DestroySlab(temp_fluidHistory);
+            DestroyScene(fluidScene);
+
+            SetMemorySubsystem(MEMORY_RENDERING);
+            temp_screenSize_slab = Create2DSlab(fluidWidth, fluidHeight, 4, false);
+            rayDataBack = Create2DSlab(fluidWidth, fluidHeight, 4, false);
+            rayDataFront = Create2DSlab(fluidWidth, fluidHeight, 4, false);
+            raySteps_slab = Create2DSlab(fluidWidth, fluidHeight, 4, false);
+            stepsSumSize = StepsSumSize(fluidWidth, fluidHeight);
+            stepsSum_slab = Create2DSlab(stepsSumSize.x, stepsSumSize.y, 4, false);
+            temp_stepsSum_slab = Create2DSlab(stepsSumSize.x, stepsSumSize.y, 4, false);
+            fluidHistory = Create2DSlab(fluidWidth, fluidHeight, 4, true);
+            temp_fluidHistory = Create2DSlab(fluidWidth, fluidHeight, 4, true);
+            fluidHistoryValid = false;
+
+            SetMemorySubsystem(MEMORY_SCENE);
+            fluidScene = CreateScene(fluidWidth, fluidHeight);
+
+            std::cout << "Raymarching at " << fluidWidth << "x" << fluidHeight << std::endl;
+        }
+
+        // the raydata and the raymarching are drawn at the resolution of the fluid buffers
+        glViewport(0, 0, fluidWidth, fluidHeight);
+
+        // we calculate the inverse screen size of the fluid buffers
+        glm::vec2 inverseScreenSize = glm::vec2(1.0f / fluidWidth, 1.0f / fluidHeight);
+
+        // we restrict the rays to the blocks with fluid of the last completed occupancy readback
+        if (tightRayBounds)
+            ReadOccupiedBounds(currTarget == LIQUID, rayBoundsMin, rayBoundsMax);
+        else
+        {
+            rayBoundsMin = glm::vec3(-1.0f);
+            rayBoundsMax = glm::vec3(1.0f);
+        }
 
         // we create the raydata texture
-        RayData(raydataBackShader, raydataFrontShader, cubeModel, rayDataBack, rayDataFront, scene, cubeModelMatrix, view, projection, inverseScreenSize);
+        RayData(raydataBackShader, raydataFrontShader, cubeModel, rayBoundsMin, rayBoundsMax, rayDataBack, rayDataFront, scene, cubeModelMatrix, view, projection, inverseScreenSize);
 
         //////////////////////////////// STEP 5 - RAYMARCHING ////////////////////////////////////////////////
 
-        RenderFluid(renderShader, density_slab, obstacle_slab, rayDataFront, rayDataBack, scene, fluidScene, cubeModel, cubeModelMatrix, view, projection, inverseScreenSize, windowNearPlane, camera.Position, camera.Front, camera.Up, camera.Right, lightDir0, Kd, alpha, F0, currTarget == LIQUID);
+        // the jitter of the rays changes at each frame only if the frames are accumulated
+        GLfloat jitterOffset = temporalAccumulation ? BlueNoiseFrameOffset(fluidFrame++) : 0.0f;
+
+        // we start the gradient benchmark, which is meaningful only for the liquid
+        if (gradientBenchmarkRequested)
+        {
+            gradientBenchmarkRequested = false;
+
+            if (currTarget != LIQUID)
+                std::cout << "The gradient benchmark measures the liquid rendering: select the liquid simulation" << std::endl;
+            else if (!gradientBenchmarkRunning)
+            {
+                gradientBenchmarkFrames = 2 * GRADIENT_BENCHMARK_FRAMES;
+                gradientBenchmarkRunning = true;
+                gradientBenchmarkSum = glm::vec2(0.0f);
+                gradientBenchmarkCount = glm::vec2(0.0f);
+            }
+        }
+
+        // during the benchmark the first half of the frames uses the tricubic path, the second the packed gradients
+        GLboolean usePackedGradients = gradientBenchmarkFrames > 0 ? gradientBenchmarkFrames <= GRADIENT_BENCHMARK_FRAMES : packedGradients;
+        GpuTimer &raymarchingTimer = usePackedGradients ? packedRaymarchingTimer : tricubicRaymarchingTimer;
+
+        // the gradient volume is built once if the packed gradients are enabled (or the packed half of the benchmark
+        // starts) before the next step, outside the raymarching timer
+        if (currTarget == LIQUID && usePackedGradients && !gradientValid)
+        {
+            BeginGpuTimer(gradientTimer);
+            BuildLevelSetGradient(gradientShader, density_slab, obstacle_slab, gradient_slab);
+            EndGpuTimer(gradientTimer);
+
+            gradientValid = true;
+            glViewport(0, 0, fluidWidth, fluidHeight);
+        }
+
+        if (gradientBenchmarkFrames > 0)
+            BeginGpuTimer(raymarchingTimer);
+
+        // we gather the raymarching settings of the frame
+        RaymarchingSettings raymarching;
+        raymarching.boundsMin = rayBoundsMin;
+        raymarching.boundsMax = rayBoundsMax;
+        raymarching.emptySpaceSkipping = emptySpaceSkipping;
+        raymarching.stepQuality = raymarchingStepQuality;
+        raymarching.adaptiveStepping = adaptiveStepping;
+        raymarching.stepCountView = stepCountView;
+        raymarching.packedGradients = usePackedGradients;
+        raymarching.gradientTex = gradient_slab.tex;
+        raymarching.blueNoiseTex = blueNoiseTexture;
+        raymarching.jitterOffset = jitterOffset;
+        raymarching.transmittanceTex = transmittance_slab.tex;
+        raymarching.textureToLight = textureToLight;
+        raymarching.shadowExtinction = currTarget == GAS && gasSelfShadowing ? gasShadowExtinction : 0.0f;
+
+        RenderFluid(renderShader, density_slab, occupancy_slab, obstacle_slab, rayDataFront, rayDataBack, scene, fluidScene, cubeModel, cubeModelMatrix, view, projection, inverseScreenSize, windowNearPlane, camera.Position, camera.Front, camera.Up, camera.Right, lightDir0, Kd, alpha, F0, currTarget == LIQUID, raymarching, raymarchingStatistics ? &raySteps_slab : nullptr);
+
+        if (gradientBenchmarkFrames > 0)
+        {
+            EndGpuTimer(raymarchingTimer);
+            gradientBenchmarkFrames--;
+        }
+
+        // we read the measures of the previous frames, and at the end of the benchmark we show the averages
+        while (ReadGpuTimer(tricubicRaymarchingTimer))
+        {
+            gradientBenchmarkSum.x += tricubicRaymarchingTimer.milliseconds;
+            gradientBenchmarkCount.x++;
+        }
+
+        while (ReadGpuTimer(packedRaymarchingTimer))
+        {
+            gradientBenchmarkSum.y += packedRaymarchingTimer.milliseconds;
+            gradientBenchmarkCount.y++;
+        }
+
+        while (ReadGpuTimer(gradientTimer))
+            gradientTimes.z = gradientTimer.milliseconds;
+
+        if (gradientBenchmarkRunning && gradientBenchmarkFrames == 0 && tricubicRaymarchingTimer.pending == 0 && packedRaymarchingTimer.pending == 0)
+        {
+            gradientBenchmarkRunning = false;
+            gradientTimes.x = gradientBenchmarkSum.x / glm::max(gradientBenchmarkCount.x, 1.0f);
+            gradientTimes.y = gradientBenchmarkSum.y / glm::max(gradientBenchmarkCount.y, 1.0f);
+
+            std::cout << "Gradient benchmark: raymarching " << gradientTimes.x << " ms with the tricubic level set, " << gradientTimes.y << " ms with the packed gradients; gradient volume " << gradientTimes.z << " ms per step" << std::endl;
+        }
+
+        // we measure the steps of the rays, to show the saving of the empty space skipping. The steps of the
+        // previous frames are shown when their readback is complete
+        if (raymarchingStatistics)
+        {
+            RequestRaymarchingSteps(stepsSumShader, raySteps_slab, stepsSum_slab, temp_stepsSum_slab, fluidWidth, fluidHeight);
+            ReadRaymarchingSteps(raymarchingSteps);
+        }
 
         //////////////////////////////// STEP 6 - BLENDING AND FINAL SCENE COMPOSITING ////////////////////////////////////////////////
 
-        if (currTarget == LIQUID)
+        // we accumulate the fluid over the frames to remove the dithering of the jittered rays
+        glm::mat4 fluidMVP = projection * view * cubeModelMatrix;
+        Scene blendedFluidScene = fluidScene;
+
+        if (temporalAccumulation)
+        {
+            glm::mat4 reprojection = prevFluidMVP * glm::inverse(fluidMVP);
+            TemporalAccumulation(temporalShader, fluidScene, fluidHistory, temp_fluidHistory, reprojection, fluidHistoryValid ? temporalHistoryWeight : 0.0f, inverseScreenSize);
+
+            blendedFluidScene.colorTex = fluidHistory.tex;
+            fluidHistoryValid = true;
+        }
+        else
+            fluidHistoryValid = false;
+
+        prevFluidMVP = fluidMVP;
+
+        // the temporal accumulation replaces the spatial filters
+        if (currTarget == LIQUID && !temporalAccumulation)
         {
             // we apply the post-process effects in the fluid scene to solve the banding effect
             Slab fluidSceneSlab  = {fluidScene.fbo, fluidScene.colorTex};
 
+            // the filters run only in the rectangle covered by the fluid in the raymarching target
+            glm::ivec4 fluidRect = FluidScreenRect(rayBoundsMin, rayBoundsMax, cubeModelMatrix, view, projection, fluidWidth, fluidHeight);
+
+            if (liquidEffect != NONE)
+                BeginGpuTimer(liquidEffectTimers[liquidEffect]);
+
             switch (liquidEffect)
             {
                 case BLUR:
@@ -729,18 +1224,67 @@ int main()
                     DeNoise(deNoiseShader, fluidSceneSlab, temp_screenSize_slab, deNoiseSigma, deNoiseThreshold, deNoiseKSigma, inverseScreenSize);
                     fluidScene.colorTex = fluidSceneSlab.tex;
                     fluidScene.fbo = fluidSceneSlab.fbo;
+                    blendedFluidScene = fluidScene;
+                    break;
+                case SEPARABLE_BLUR:
+                    SeparableBlur(separableBlurShader, fluidSceneSlab, temp_screenSize_slab, (GLint) blurRadius, fluidRect);
+                    break;
+                case ATROUS_DENOISE:
+                    ATrousDeNoise(aTrousShader, fluidSceneSlab, temp_screenSize_slab, fluidScene.depthTex, aTrousIterations, aTrousColorSigma, aTrousDepthSigma, fluidRect);
                     break;
                 default:
                     break;
             }
+
+            if (liquidEffect != NONE)
+                EndGpuTimer(liquidEffectTimers[liquidEffect]);
         }
 
-        // we combine the fluid rendering with the scene rendering
-        BlendRendering(blendingShader, scene, fluidScene, rayDataBack, inverseScreenSize);
+        // we read the measures of the post-process effects taken in the previous frames
+        for (int i = 0; i < LIQUID_EFFECT_COUNT; i++)
+        {
+            while (ReadGpuTimer(liquidEffectTimers[i]))
+                liquidEffectTimes[i] = liquidEffectTimers[i].milliseconds;
+        }
+
+        // we combine the fluid rendering with the scene rendering, at the window resolution
+        glViewport(0, 0, width, height);
+        BeginGpuTimer(compositionTimer);
+
+        // the blending reads the fluid only in the pixels covered by the fluid volume, marked in the stencil buffer,
+        // and the scene is copied in the others. The faces of the volume clipped by the near plane wouldn't mark the
+        // pixels in front of the camera, so the whole screen is blended when the camera is close to the volume
+        glm::vec3 cameraInVolume = glm::vec3(glm::inverse(cubeModelMatrix) * glm::vec4(camera.Position, 1.0f));
+        bool cameraNearFluid = glm::all(glm::lessThan(glm::abs(cameraInVolume), glm::vec3(1.001f + 2.0f * windowNearPlane / fluidScale)));
+        bool stencilComposition = fluidStencil && !cameraNearFluid;
+
+        if (stencilComposition)
+        {
+            glm::mat4 stencilModel = glm::scale(cubeModelMatrix, glm::vec3(1.001f, 1.001f, 1.001f));
+            FluidStencil(fluidStencilShader, cubeModel, stencilModel, view, projection);
+            glStencilFunc(GL_EQUAL, 1, 0xFF);
+        }
+
+        BlendRendering(blendingShader, scene, blendedFluidScene, rayDataBack, projection, glm::vec2(1.0f / width, 1.0f / height));
+
+        if (stencilComposition)
+        {
+            glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
+            CopyScene(sceneCopyShader, scene, glm::vec2(1.0f / width, 1.0f / height));
+            glDisable(GL_STENCIL_TEST);
+        }
+
+        EndGpuTimer(compositionTimer);
+
+        while (ReadGpuTimer(sceneTimer))
+            scenePassTimes.x = sceneTimer.milliseconds;
+
+        while (ReadGpuTimer(compositionTimer))
+            scenePassTimes.y = compositionTimer.milliseconds;
 
         // we render the front faces of the fluid volume if the 
         // post process effect is not denoising due to flickering
-        if (liquidEffect != DENOISE)
+        if (liquidEffect != DENOISE || temporalAccumulation)
         {
             glEnable(GL_BLEND);
             glEnable(GL_CULL_FACE);
@@ -775,6 +1319,7 @@ int main()
     // when I exit from the graphics loop, it is because the application is closing
     // we delete the Shader Programs
     illumination_shader.Delete();
+    depthPrePassShader.Delete();
     shadow_shader.Delete();
 
     advectionShader.Delete();
@@ -786,17 +1331,11 @@ int main()
     dyeShader.Delete();
     fillShader.Delete();
 
-    if (currTarget == GAS)
-    {
-        temperatureShader->Delete();
-        buoyancyShader->Delete();
-    }
-    else
-    {
-        initLiquidShader->Delete();
-        dampingLevelSetShader->Delete();
-        gravityShader->Delete();
-    }
+    temperatureShader->Delete();
+    buoyancyShader->Delete();
+    initLiquidShader->Delete();
+    dampingLevelSetShader->Delete();
+    gravityShader->Delete();
 
     delete temperatureShader;
     delete buoyancyShader;
@@ -807,7 +1346,7 @@ int main()
     borderObstacleShaderLayered.Delete();
     borderObstacleShader.Delete();
     stencilObstacleShader.Delete();
-    obstacleVelocityShader.Delete();
+    rigidObstacleShader.Delete();
 
     raydataBackShader.Delete();
     raydataFrontShader.Delete();
@@ -815,10 +1354,37 @@ int main()
     blendingShader.Delete();
     blurShader.Delete();
     deNoiseShader.Delete();
+    separableBlurShader.Delete();
+    aTrousShader.Delete();
+    temporalShader.Delete();
+    fluidStencilShader.Delete();
+    sceneCopyShader.Delete();
+    transmittanceShader.Delete();
 
     renderShader.Delete();
+    gradientShader.Delete();
+    stepsSumShader.Delete();
+
+    DestroyGpuTimer(gradientTimer);
+    DestroyGpuTimer(tricubicRaymarchingTimer);
+    DestroyGpuTimer(packedRaymarchingTimer);
+    DestroyGpuTimer(sceneTimer);
+    DestroyGpuTimer(compositionTimer);
+
+    for (int i = 0; i < LIQUID_EFFECT_COUNT; i++)
+        DestroyGpuTimer(liquidEffectTimers[i]);
 
     // chiudo e cancello il contesto creato
+    // we give back the simulation slabs to the pool and we destroy it
+    ReleaseSlab(velocity_slab);
+    ReleaseSlab(density_slab);
+    ReleaseSlab(obstacle_velocity_slab);
+    if (currTarget == GAS)
+        ReleaseSlab(temperature_slab);
+
+    simulationGraph.Release();
+    ClearSlabPool();
+
     glfwTerminate();
     return 0;
 }
@@ -826,7 +1392,7 @@ int main()
 //////////////////////////////////////////
 
 // we render the objects. We pass also the current rendering step, and the depth map generated in the first step, which is used by the shaders of the second step
-void RenderObjects(Shader &shader, Model &planeModel, GLint render_pass, GLuint depthMap)
+void RenderObjects(Shader &shader, Model &planeModel, GLint render_pass, GLuint depthMap, GLint layers)
 {
     // For the second rendering step -> we pass the shadow map to the shaders
     if (render_pass==RENDER)
@@ -864,8 +1430,9 @@ void RenderObjects(Shader &shader, Model &planeModel, GLint render_pass, GLuint
     planeNormalMatrix = glm::inverseTranspose(glm::mat3(view*planeModelMatrix));
     glUniformMatrix4fv(glGetUniformLocation(shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(planeModelMatrix));
     glUniformMatrix3fv(glGetUniformLocation(shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(planeNormalMatrix));
-    // we render the plane
-    planeModel.Draw();
+    // we render the plane, if the static layer is requested
+    if (layers & STATIC_LAYER)
+        planeModel.Draw();
 
     // we activate the texture of the objects
     glActiveTexture(GL_TEXTURE0);
@@ -878,7 +1445,7 @@ void RenderObjects(Shader &shader, Model &planeModel, GLint render_pass, GLuint
     glm::mat3 normalMatrix;
     for_each(obstacleObjects.begin(), obstacleObjects.end(), [&](ObstacleObject* obj)
     {
-        if (!obj->isActive) return;
+        if (!obj->isActive || !(layers & DYNAMIC_LAYER)) return;
 
         // we create the normal matrix
         normalMatrix = glm::inverseTranspose(glm::mat3(view * obj->modelMatrix));
@@ -926,6 +1493,9 @@ GLint LoadTexture(const char* path)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST_MIPMAP_NEAREST);
 
+    SetMemorySubsystem(MEMORY_SCENE);
+    RegisterTexture(textureImage, channels == 4 ? GL_RGBA : GL_RGB, w, h, 1, true);
+
     // we free the memory once we have created an OpenGL texture
     stbi_image_free(image);
 
@@ -937,6 +1507,43 @@ GLint LoadTexture(const char* path)
 
 ///////////////////////////////////////////
 
+// we create the depth texture of a shadow map, and the framebuffer used to render it
+void CreateShadowMap(GLuint width, GLuint height, GLuint &fbo, GLuint &depthMap)
+{
+    // we create a Frame Buffer Object: the first rendering step will render to this buffer, and not to the real frame buffer
+    glGenFramebuffers(1, &fbo);
+    // we create a texture for the depth map
+    glGenTextures(1, &depthMap);
+    glBindTexture(GL_TEXTURE_2D, depthMap);
+    // in the texture, we will save only the depth data of the fragments. Thus, we specify that we need to render only depth in the first rendering step
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // we set to clamp the uv coordinates outside [0,1] to the color of the border
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+    // outside the area covered by the light frustum, everything is rendered in shadow (because we set GL_CLAMP_TO_BORDER)
+    // thus, we set the texture border to white, so to render correctly everything not involved by the shadow map
+    //*************
+    GLfloat borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+    // we bind the depth map FBO
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
+    // we set that we are not calculating nor saving color data
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    SetMemorySubsystem(MEMORY_SCENE);
+    RegisterTexture(depthMap, GL_DEPTH_COMPONENT, width, height, 1);
+    RegisterFramebuffer(fbo);
+}
+
+///////////////////////////////////////////
+
 // The function parses the content of the Shader Program, searches for the Subroutine type names,
 // the subroutines implemented for each type, print the names of the subroutines on the terminal, and add the names of
 // the subroutines to the shaders vector, which is used for the shaders swapping
@@ -1027,6 +1634,10 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if(key == GLFW_KEY_P && action == GLFW_PRESS)
         spinning=!spinning;
 
+    // if V is pressed, we compare the obstacle buffers with the CPU voxelization after the next simulation step
+    if(key == GLFW_KEY_V && action == GLFW_PRESS)
+        validateObstacles = true;
+
     // pressing a key number, we change the shader applied to the models
     // if the key is between 1 and 9, we proceed and check if the pressed key corresponds to
     // a valid subroutine
@@ -1121,20 +1732,16 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 
 //////////////////////////////////////////
 
-// instantiates the target fluid exclusive shaders for the simulation
-void CreateFluidShaders(TargetFluid target)
+// instantiates the target fluid exclusive shaders for the simulation. Both the sets are created at startup
+// and kept alive, so switching the target fluid doesn't stall the frame to compile them
+void CreateFluidShaders()
 {
-    if (target == GAS)
-    {
-        // we create the Shader Programs for only gas simulation
-        buoyancyShader = new Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom"  ,"src/shaders/simulation/gas/buoyancy.frag");
-        temperatureShader = new Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/gas/add_temperature.frag");
-    }
-    else
-    {
-        // we create the Shader Programs for only liquid simulation
-        initLiquidShader = new Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/liquid/fill_levelSet.frag");
-        dampingLevelSetShader = new Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/liquid/damp_levelSet.frag");
-        gravityShader = new Shader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/liquid/add_gravity.frag");
-    }
+    // we create the Shader Programs for only gas simulation
+    buoyancyShader = new PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom"  ,"src/shaders/simulation/gas/buoyancy.frag");
+    temperatureShader = new PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/gas/add_temperature.frag");
+
+    // we create the Shader Programs for only liquid simulation
+    initLiquidShader = new PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/liquid/fill_levelSet.frag");
+    dampingLevelSetShader = new PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/liquid/damp_levelSet.frag");
+    gravityShader = new PassShader("src/shaders/generic/load_vertices.vert", "src/shaders/generic/set_layer.geom","src/shaders/simulation/liquid/add_gravity.frag");
 }
@@ -0,0 +1,225 @@
+#include "memory-registry.h"
+
+// Std. Includes
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+//////////////////////////////////////
+// we define the registry data
+
+// allocations recorded in the registry, indexed by object type and name
+std::map<std::pair<GLenum, GLuint>, Allocation> allocations;
+
+// subsystem of the next registered allocations
+MemorySubsystem currentSubsystem = MEMORY_SIMULATION;
+
+// minimum size of a grid dimension when it is downscaled to fit the memory budget
+const GLuint MIN_GRID_SIZE = 16;
+
+//////////////////////////////////////
+// registry functions
+
+// set the subsystem of the next registered allocations
+void SetMemorySubsystem(MemorySubsystem subsystem)
+{
+    currentSubsystem = subsystem;
+}
+
+// add the allocation to the registry (an allocation with the same type and name is replaced)
+void Register(GLenum type, GLuint name, GLenum format, GLuint width, GLuint height, GLuint depth, GLuint64 bytes, MemorySubsystem subsystem)
+{
+    Allocation allocation = {type, name, format, width, height, depth, bytes, subsystem};
+    allocations[std::make_pair(type, name)] = allocation;
+}
+
+// record a texture. Each level of the mip chain halves the size of the previous one (rounding down,
+// at least 1 texel), until the last level of 1x1x1 texels
+void RegisterTexture(GLuint texture, GLenum internalFormat, GLuint width, GLuint height, GLuint depth, bool mipmapped)
+{
+    GLuint64 bytes = (GLuint64) width * height * depth * FormatBytes(internalFormat);
+
+    for (GLuint w = width, h = height, d = depth; mipmapped && (w > 1 || h > 1 || d > 1); )
+    {
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+        d = std::max(d / 2, 1u);
+
+        bytes += (GLuint64) w * h * d * FormatBytes(internalFormat);
+    }
+
+    Register(GL_TEXTURE, texture, internalFormat, width, height, depth, bytes, currentSubsystem);
+}
+
+// record a framebuffer
+void RegisterFramebuffer(GLuint fbo)
+{
+    Register(GL_FRAMEBUFFER, fbo, 0, 0, 0, 0, 0, currentSubsystem);
+}
+
+// record a buffer object
+void RegisterBuffer(GLuint buffer, GLuint64 bytes)
+{
+    Register(GL_BUFFER, buffer, 0, 0, 0, 0, bytes, currentSubsystem);
+}
+
+// record the model meshes: the vertex and index buffers of a mesh are recorded together with its VAO,
+// because the buffer names are private to the mesh. The models are always recorded in their subsystem
+void RegisterModel(Model* model)
+{
+    for (size_t i = 0; i < model->meshes.size(); i++)
+    {
+        Mesh &mesh = model->meshes[i];
+        GLuint64 bytes = mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(GLuint);
+
+        Register(GL_VERTEX_ARRAY, mesh.VAO, 0, 0, 0, 0, bytes, MEMORY_MODELS);
+    }
+}
+
+// remove the allocation from the registry
+void UnregisterAllocation(GLenum type, GLuint name)
+{
+    allocations.erase(std::make_pair(type, name));
+}
+
+// remove the model meshes from the registry
+void UnregisterModel(Model* model)
+{
+    for (size_t i = 0; i < model->meshes.size(); i++)
+        UnregisterAllocation(GL_VERTEX_ARRAY, model->meshes[i].VAO);
+}
+
+// memory recorded for the subsystem
+GLuint64 GetAllocatedBytes(MemorySubsystem subsystem)
+{
+    GLuint64 bytes = 0;
+
+    for (std::map<std::pair<GLenum, GLuint>, Allocation>::iterator it = allocations.begin(); it != allocations.end(); it++)
+    {
+        if (it->second.subsystem == subsystem)
+            bytes += it->second.bytes;
+    }
+
+    return bytes;
+}
+
+// number of allocations recorded for the subsystem
+GLuint GetAllocationCount(MemorySubsystem subsystem)
+{
+    GLuint count = 0;
+
+    for (std::map<std::pair<GLenum, GLuint>, Allocation>::iterator it = allocations.begin(); it != allocations.end(); it++)
+    {
+        if (it->second.subsystem == subsystem)
+            count++;
+    }
+
+    return count;
+}
+
+// memory recorded for all the subsystems
+GLuint64 GetTotalAllocatedBytes()
+{
+    GLuint64 bytes = 0;
+
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; i++)
+        bytes += GetAllocatedBytes((MemorySubsystem) i);
+
+    return bytes;
+}
+
+// print on console the memory of each subsystem
+void PrintMemoryReport()
+{
+    std::cout << "GPU memory allocated:" << std::endl;
+
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; i++)
+    {
+        MemorySubsystem subsystem = (MemorySubsystem) i;
+        std::cout << "\t" << MemorySubsystemNames[i] << ": " << ToMegabytes(GetAllocatedBytes(subsystem)) << " MB (" << GetAllocationCount(subsystem) << " objects)" << std::endl;
+    }
+
+    std::cout << "\tTotal: " << ToMegabytes(GetTotalAllocatedBytes()) << " MB" << std::endl;
+}
+
+//////////////////////////////////////
+// memory utility functions
+
+// size in bytes of a texel with the given internal format. The unsized formats are counted
+// with the size usually chosen by the drivers (8 bits per color channel, 24 bits depth)
+GLuint FormatBytes(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+        case GL_R16F: return 2;
+        case GL_RG16F: return 4;
+        case GL_RGB16F: return 6;
+        case GL_RGBA16F: return 8;
+        case GL_R32F: return 4;
+        case GL_RG32F: return 8;
+        case GL_RGB32F: return 12;
+        case GL_RGBA32F: return 16;
+        case GL_RGB: return 3;
+        case GL_RGB8: return 3;
+        case GL_RGBA: return 4;
+        case GL_RGBA8: return 4;
+        case GL_DEPTH_COMPONENT: return 4;
+        case GL_DEPTH24_STENCIL8: return 4;
+        default: std::cout << "Unknown size for texture format " << internalFormat << std::endl; return 0;
+    }
+}
+
+// convert a memory size in megabytes
+float ToMegabytes(GLuint64 bytes)
+{
+    return bytes / (1024.0f * 1024.0f);
+}
+
+// estimate of the grid memory for each cell:
+// - persistent slabs: velocity (RGB16F), density or level set (R16F), temperature for gas (R16F), and the
+//   obstacle velocity (RGB16F), which persists between the steps, and the packed gradient volume of the
+//   liquid (RGBA16F), allocated for both fluids because the target can be switched at runtime;
+// - obstacle buffers: position (R16F), its depth-stencil layers (DEPTH24_STENCIL8) and the signed distance (R16F);
+// - transient slabs at the peak of the simulation graph: predictor, corrector and destination of the
+//   velocity advection (3 x RGB16F), and divergence, pressure and its destination in the pressure
+//   solver (3 x R16F)
+GLuint64 EstimateGridBytesPerCell(bool gasSimulation)
+{
+    GLuint64 persistent = 2 * FormatBytes(GL_RGB16F) + FormatBytes(GL_R16F) + FormatBytes(GL_RGBA16F);
+    if (gasSimulation)
+        persistent += FormatBytes(GL_R16F);
+
+    GLuint64 obstacles = 2 * FormatBytes(GL_R16F) + FormatBytes(GL_DEPTH24_STENCIL8);
+
+    GLuint64 transient = 3 * FormatBytes(GL_RGB16F) + 3 * FormatBytes(GL_R16F);
+
+    return persistent + obstacles + transient;
+}
+
+// downscale the grid to fit the budget
+bool FitGridToBudget(GLuint &width, GLuint &height, GLuint &depth, GLuint64 bytesPerCell, GLuint64 budgetBytes)
+{
+    GLuint64 requested = (GLuint64) width * height * depth * bytesPerCell;
+
+    if (requested <= budgetBytes)
+        return true;
+
+    // we scale each dimension by the cube root of the ratio, then we shrink the grid
+    // by one cell per dimension until it fits (the rounding could leave it above the budget)
+    double scale = std::cbrt((double) budgetBytes / requested);
+
+    width = std::max((GLuint) (width * scale), MIN_GRID_SIZE);
+    height = std::max((GLuint) (height * scale), MIN_GRID_SIZE);
+    depth = std::max((GLuint) (depth * scale), MIN_GRID_SIZE);
+
+    while ((GLuint64) width * height * depth * bytesPerCell > budgetBytes &&
+           (width > MIN_GRID_SIZE || height > MIN_GRID_SIZE || depth > MIN_GRID_SIZE))
+    {
+        width = std::max(width - 1, MIN_GRID_SIZE);
+        height = std::max(height - 1, MIN_GRID_SIZE);
+        depth = std::max(depth - 1, MIN_GRID_SIZE);
+    }
+
+    return false;
+}
@@ -0,0 +1,96 @@
+#include <glad/glad.h>
+
+// classes developed during lab lectures to manage shaders and to load models
+#include <utils/shader.h>
+#include <utils/model.h>
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the structures for the GPU memory registry
+
+// subsystems owning the GPU allocations
+enum MemorySubsystem
+{
+    MEMORY_SIMULATION, // simulation grid slabs and buffers
+    MEMORY_OBSTACLES, // obstacle grid buffers
+    MEMORY_RENDERING, // screen size buffers for fluid rendering
+    MEMORY_SCENE, // scene framebuffers and shadow map
+    MEMORY_MODELS, // vertex and index buffers of the models
+    MEMORY_SUBSYSTEM_COUNT
+};
+
+// names of the subsystems, in the same order of the enum
+const char* const MemorySubsystemNames[MEMORY_SUBSYSTEM_COUNT] =
+{
+    "Simulation",
+    "Obstacles",
+    "Rendering",
+    "Scene",
+    "Models"
+};
+
+// GPU allocation recorded in the registry
+struct Allocation
+{
+    GLenum type; // GL_TEXTURE, GL_FRAMEBUFFER, GL_BUFFER or GL_VERTEX_ARRAY (for the model meshes)
+    GLuint name;
+    GLenum format; // internal format of textures (0 for the other objects)
+    GLuint width, height, depth;
+    GLuint64 bytes;
+    MemorySubsystem subsystem;
+};
+
+/////////////////////////////////////////////
+// we define the registry functions
+
+// set the subsystem of the next registered allocations
+void SetMemorySubsystem(MemorySubsystem subsystem);
+
+// record a texture with its internal format and size (depth = 1 for 2D textures). The levels of the mip chain
+// are counted if the texture is mipmapped
+void RegisterTexture(GLuint texture, GLenum internalFormat, GLuint width, GLuint height, GLuint depth, bool mipmapped = false);
+
+// record a framebuffer (it doesn't own memory, but it is counted)
+void RegisterFramebuffer(GLuint fbo);
+
+// record a buffer object with its size
+void RegisterBuffer(GLuint buffer, GLuint64 bytes);
+
+// record the vertex and index buffers of the model meshes
+void RegisterModel(Model* model);
+
+// remove the allocation from the registry
+void UnregisterAllocation(GLenum type, GLuint name);
+
+// remove the model meshes from the registry
+void UnregisterModel(Model* model);
+
+// memory recorded for the subsystem
+GLuint64 GetAllocatedBytes(MemorySubsystem subsystem);
+
+// number of allocations recorded for the subsystem
+GLuint GetAllocationCount(MemorySubsystem subsystem);
+
+// memory recorded for all the subsystems
+GLuint64 GetTotalAllocatedBytes();
+
+// print on console the memory of each subsystem
+void PrintMemoryReport();
+
+/////////////////////////////////////////////
+// we define the memory utility functions
+
+// size in bytes of a texel with the given internal format
+GLuint FormatBytes(GLenum internalFormat);
+
+// convert a memory size in megabytes
+float ToMegabytes(GLuint64 bytes);
+
+// estimate of the grid memory for each cell, given by the persistent slabs, the obstacle buffers
+// and the peak of the transient slabs of the simulation step
+GLuint64 EstimateGridBytesPerCell(bool gasSimulation);
+
+// downscale the grid size, keeping its proportions, until its estimated memory fits the budget.
+// Returns false if the requested grid exceeds the budget
+bool FitGridToBudget(GLuint &width, GLuint &height, GLuint &depth, GLuint64 bytesPerCell, GLuint64 budgetBytes);
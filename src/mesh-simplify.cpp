@@ -0,0 +1,434 @@
+#include "mesh-simplify.h"
+
+// Std. Includes
+#include <map>
+#include <set>
+#include <tuple>
+#include <queue>
+#include <algorithm>
+#include <iostream>
+
+// we load the GLM classes used in the simplification
+#include <glm/glm.hpp>
+
+//////////////////////////////////////
+// we define the simplification structures
+
+// weight of the quadrics of the boundary edges, to keep the open borders of the mesh in place
+const double BOUNDARY_WEIGHT = 10.0;
+
+// minimum cosine between the normals of a triangle before and after a collapse: collapses folding
+// the triangles over their neighbours are discarded
+const double MIN_NORMAL_COSINE = 0.2;
+
+// error quadric of a vertex: symmetric 4x4 matrix stored as its upper triangle
+struct Quadric
+{
+    double a[10];
+
+    Quadric()
+    {
+        std::fill(this->a, this->a + 10, 0.0);
+    }
+
+    // quadric of the plane n.p + d = 0, scaled by the weight
+    Quadric(glm::dvec3 n, double d, double weight)
+    {
+        this->a[0] = weight * n.x * n.x; this->a[1] = weight * n.x * n.y; this->a[2] = weight * n.x * n.z; this->a[3] = weight * n.x * d;
+        this->a[4] = weight * n.y * n.y; this->a[5] = weight * n.y * n.z; this->a[6] = weight * n.y * d;
+        this->a[7] = weight * n.z * n.z; this->a[8] = weight * n.z * d;
+        this->a[9] = weight * d * d;
+    }
+
+    Quadric& operator+=(const Quadric &other)
+    {
+        for (int i = 0; i < 10; i++)
+            this->a[i] += other.a[i];
+        return *this;
+    }
+
+    // squared distance of the point from the planes of the quadric
+    double Error(glm::dvec3 p) const
+    {
+        return this->a[0] * p.x * p.x + 2.0 * this->a[1] * p.x * p.y + 2.0 * this->a[2] * p.x * p.z + 2.0 * this->a[3] * p.x
+             + this->a[4] * p.y * p.y + 2.0 * this->a[5] * p.y * p.z + 2.0 * this->a[6] * p.y
+             + this->a[7] * p.z * p.z + 2.0 * this->a[8] * p.z + this->a[9];
+    }
+
+    // point with the minimum error. Returns false if the quadric is singular (e.g., flat regions)
+    bool Optimum(glm::dvec3 &p) const
+    {
+        glm::dmat3 A(this->a[0], this->a[1], this->a[2],
+                     this->a[1], this->a[4], this->a[5],
+                     this->a[2], this->a[5], this->a[7]);
+
+        double det = glm::determinant(A);
+        if (glm::abs(det) < 1e-12)
+            return false;
+
+        p = -(glm::inverse(A) * glm::dvec3(this->a[3], this->a[6], this->a[8]));
+        return true;
+    }
+};
+
+// candidate edge collapse, valid only if the versions of its vertices are unchanged since its creation
+struct Collapse
+{
+    double cost;
+    GLuint a, b; // vertex b is merged into vertex a
+    GLuint versionA, versionB;
+    glm::dvec3 position;
+
+    // the priority queue extracts the lowest cost first
+    bool operator<(const Collapse &other) const
+    {
+        return this->cost > other.cost;
+    }
+};
+
+// mesh used during the simplification, with welded positions
+struct SimplifyState
+{
+    vector<glm::dvec3> positions;
+    vector<Quadric> quadrics;
+    vector<GLuint> versions;
+    vector<glm::uvec3> triangles;
+    vector<bool> removedTriangles;
+    vector<vector<GLuint>> vertexTriangles; // triangles using each vertex (removed ones are skipped)
+    std::priority_queue<Collapse> queue;
+};
+
+//////////////////////////////////////
+// utility functions
+
+// normal of the triangle, with length equal to twice its area
+glm::dvec3 TriangleNormal(glm::dvec3 p0, glm::dvec3 p1, glm::dvec3 p2)
+{
+    return glm::cross(p1 - p0, p2 - p0);
+}
+
+// compute the best position and the cost of the collapse of the edge, and add it to the queue
+void PushCollapse(SimplifyState &state, GLuint a, GLuint b)
+{
+    Quadric q = state.quadrics[a];
+    q += state.quadrics[b];
+
+    Collapse collapse;
+    collapse.a = a;
+    collapse.b = b;
+    collapse.versionA = state.versions[a];
+    collapse.versionB = state.versions[b];
+
+    // if the quadric is singular, we choose the best among the endpoints and the midpoint
+    if (!q.Optimum(collapse.position))
+    {
+        glm::dvec3 candidates[3] = {state.positions[a], state.positions[b], (state.positions[a] + state.positions[b]) * 0.5};
+
+        collapse.position = candidates[0];
+        for (int i = 1; i < 3; i++)
+        {
+            if (q.Error(candidates[i]) < q.Error(collapse.position))
+                collapse.position = candidates[i];
+        }
+    }
+
+    collapse.cost = q.Error(collapse.position);
+    state.queue.push(collapse);
+}
+
+// check that moving the vertex to the new position doesn't flip the triangles kept by the collapse
+bool KeepsOrientation(SimplifyState &state, GLuint vertex, GLuint other, glm::dvec3 position)
+{
+    const vector<GLuint> &triangles = state.vertexTriangles[vertex];
+
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        GLuint t = triangles[i];
+        glm::uvec3 tri = state.triangles[t];
+
+        // the triangles with both the vertices are removed by the collapse
+        if (state.removedTriangles[t] || tri.x == other || tri.y == other || tri.z == other)
+            continue;
+
+        glm::dvec3 p[3], moved[3];
+        for (int k = 0; k < 3; k++)
+        {
+            p[k] = state.positions[tri[k]];
+            moved[k] = tri[k] == vertex ? position : p[k];
+        }
+
+        glm::dvec3 before = TriangleNormal(p[0], p[1], p[2]);
+        glm::dvec3 after = TriangleNormal(moved[0], moved[1], moved[2]);
+
+        double lengths = glm::length(before) * glm::length(after);
+        if (lengths < 1e-20 || glm::dot(before, after) < MIN_NORMAL_COSINE * lengths)
+            return false;
+    }
+
+    return true;
+}
+
+//////////////////////////////////////
+// simplification functions
+
+// triangle budget for the grid: PROXY_TRIANGLES_PER_FACE_CELL triangles for each cell of the largest face of the grid
+GLuint ProxyTriangleBudget(GLuint gridWidth, GLuint gridHeight, GLuint gridDepth)
+{
+    GLuint faceCells = glm::max(gridWidth * gridHeight, glm::max(gridWidth * gridDepth, gridHeight * gridDepth));
+
+    return glm::max(faceCells * PROXY_TRIANGLES_PER_FACE_CELL, PROXY_MIN_TRIANGLES);
+}
+
+// quadric error edge collapse (Garland and Heckbert): each vertex stores the sum of the quadrics of the planes of its
+// triangles, and the edge whose collapse moves the merged vertex the least from those planes is collapsed first
+void SimplifyMesh(MeshData& mesh, GLuint targetTriangles)
+{
+    SimplifyState state;
+
+    // we weld the vertices with the same position: the imported meshes split them along the seams of the
+    // attributes, which would open holes in the proxy
+    std::map<std::tuple<float, float, float>, GLuint> welded;
+    vector<GLuint> remap(mesh.vertices.size());
+
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        glm::vec3 p = mesh.vertices[i].Position;
+        std::tuple<float, float, float> key(p.x, p.y, p.z);
+
+        std::map<std::tuple<float, float, float>, GLuint>::iterator it = welded.find(key);
+        if (it == welded.end())
+        {
+            remap[i] = state.positions.size();
+            welded[key] = remap[i];
+            state.positions.push_back(glm::dvec3(p));
+        }
+        else
+            remap[i] = it->second;
+    }
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        glm::uvec3 tri(remap[mesh.indices[i]], remap[mesh.indices[i + 1]], remap[mesh.indices[i + 2]]);
+
+        if (tri.x != tri.y && tri.y != tri.z && tri.x != tri.z)
+            state.triangles.push_back(tri);
+    }
+
+    GLuint liveTriangles = state.triangles.size();
+
+    state.quadrics.resize(state.positions.size());
+    state.versions.resize(state.positions.size(), 0);
+    state.removedTriangles.resize(state.triangles.size(), false);
+    state.vertexTriangles.resize(state.positions.size());
+
+    // we accumulate the plane quadrics, and we count the triangles of each edge to find the boundaries
+    std::map<std::pair<GLuint, GLuint>, GLuint> edgeTriangles;
+
+    for (size_t t = 0; t < state.triangles.size(); t++)
+    {
+        glm::uvec3 tri = state.triangles[t];
+        glm::dvec3 normal = TriangleNormal(state.positions[tri.x], state.positions[tri.y], state.positions[tri.z]);
+
+        double length = glm::length(normal);
+        if (length > 0.0)
+        {
+            normal /= length;
+            Quadric q(normal, -glm::dot(normal, state.positions[tri.x]), 1.0);
+
+            for (int k = 0; k < 3; k++)
+                state.quadrics[tri[k]] += q;
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            state.vertexTriangles[tri[k]].push_back(t);
+
+            GLuint a = tri[k], b = tri[(k + 1) % 3];
+            edgeTriangles[std::make_pair(glm::min(a, b), glm::max(a, b))]++;
+        }
+    }
+
+    // the boundary edges add a plane orthogonal to their triangle, so the collapses don't shrink the border
+    for (size_t t = 0; t < state.triangles.size(); t++)
+    {
+        glm::uvec3 tri = state.triangles[t];
+        glm::dvec3 normal = TriangleNormal(state.positions[tri.x], state.positions[tri.y], state.positions[tri.z]);
+
+        for (int k = 0; k < 3; k++)
+        {
+            GLuint a = tri[k], b = tri[(k + 1) % 3];
+            if (edgeTriangles[std::make_pair(glm::min(a, b), glm::max(a, b))] != 1)
+                continue;
+
+            glm::dvec3 border = glm::cross(state.positions[b] - state.positions[a], normal);
+            double length = glm::length(border);
+            if (length <= 0.0)
+                continue;
+
+            border /= length;
+            Quadric q(border, -glm::dot(border, state.positions[a]), BOUNDARY_WEIGHT);
+
+            state.quadrics[a] += q;
+            state.quadrics[b] += q;
+        }
+    }
+
+    for (std::map<std::pair<GLuint, GLuint>, GLuint>::iterator it = edgeTriangles.begin(); it != edgeTriangles.end(); it++)
+        PushCollapse(state, it->first.first, it->first.second);
+
+    // we collapse the cheapest edges until the budget is reached
+    while (liveTriangles > targetTriangles && !state.queue.empty())
+    {
+        Collapse collapse = state.queue.top();
+        state.queue.pop();
+
+        GLuint a = collapse.a, b = collapse.b;
+
+        // the collapse is stale if one of its vertices changed after its creation
+        if (collapse.versionA != state.versions[a] || collapse.versionB != state.versions[b])
+            continue;
+
+        if (!KeepsOrientation(state, a, b, collapse.position) || !KeepsOrientation(state, b, a, collapse.position))
+            continue;
+
+        state.positions[a] = collapse.position;
+        state.quadrics[a] += state.quadrics[b];
+        state.versions[a]++;
+        state.versions[b]++;
+
+        // the triangles of b are moved to a, and the ones with both the vertices become degenerate
+        for (size_t i = 0; i < state.vertexTriangles[b].size(); i++)
+        {
+            GLuint t = state.vertexTriangles[b][i];
+            if (state.removedTriangles[t])
+                continue;
+
+            glm::uvec3 &tri = state.triangles[t];
+
+            if (tri.x == a || tri.y == a || tri.z == a)
+            {
+                state.removedTriangles[t] = true;
+                liveTriangles--;
+                continue;
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                if (tri[k] == b)
+                    tri[k] = a;
+            }
+
+            state.vertexTriangles[a].push_back(t);
+        }
+
+        state.vertexTriangles[b].clear();
+
+        // we update the collapses of the edges around the merged vertex
+        std::set<GLuint> neighbours;
+        vector<GLuint> &triangles = state.vertexTriangles[a];
+
+        triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [&](GLuint t) { return state.removedTriangles[t]; }), triangles.end());
+
+        for (size_t i = 0; i < triangles.size(); i++)
+        {
+            glm::uvec3 tri = state.triangles[triangles[i]];
+            for (int k = 0; k < 3; k++)
+            {
+                if (tri[k] != a)
+                    neighbours.insert(tri[k]);
+            }
+        }
+
+        for (std::set<GLuint>::iterator it = neighbours.begin(); it != neighbours.end(); it++)
+            PushCollapse(state, a, *it);
+    }
+
+    // we rebuild the mesh with the used vertices, and we compute the normals weighted by the triangle areas
+    vector<GLint> compact(state.positions.size(), -1);
+    MeshData simplified;
+
+    for (size_t t = 0; t < state.triangles.size(); t++)
+    {
+        if (state.removedTriangles[t])
+            continue;
+
+        glm::uvec3 tri = state.triangles[t];
+        glm::dvec3 normal = TriangleNormal(state.positions[tri.x], state.positions[tri.y], state.positions[tri.z]);
+
+        for (int k = 0; k < 3; k++)
+        {
+            if (compact[tri[k]] < 0)
+            {
+                compact[tri[k]] = simplified.vertices.size();
+
+                Vertex vertex = {};
+                vertex.Position = glm::vec3(state.positions[tri[k]]);
+                simplified.vertices.push_back(vertex);
+            }
+
+            simplified.vertices[compact[tri[k]]].Normal += glm::vec3(normal);
+            simplified.indices.push_back(compact[tri[k]]);
+        }
+    }
+
+    for (size_t i = 0; i < simplified.vertices.size(); i++)
+    {
+        glm::vec3 &normal = simplified.vertices[i].Normal;
+        if (glm::length(normal) > 0.0f)
+            normal = glm::normalize(normal);
+    }
+
+    mesh = std::move(simplified);
+}
+
+// import the model and simplify its meshes, sharing the budget among them in proportion to their triangles
+bool ImportProxyMeshData(const string& path, GLuint targetTriangles, vector<MeshData>& meshes)
+{
+    string cachePath = path + ".proxy" + std::to_string(targetTriangles) + ".meshcache";
+    GLuint64 sourceSize = 0, sourceTime = 0;
+
+    if (!GetFileStamp(path, sourceSize, sourceTime))
+    {
+        std::cout << "ERROR::MODEL:: file not found " << path << std::endl;
+        return false;
+    }
+
+    if (ReadMeshCache(cachePath, sourceSize, sourceTime, meshes))
+        return true;
+
+    if (!ImportMeshData(path, meshes))
+        return false;
+
+    GLuint64 triangles = 0;
+    for (size_t i = 0; i < meshes.size(); i++)
+        triangles += meshes[i].indices.size() / 3;
+
+    // the model is already within the budget: we cache the empty proxy, so the model itself is used
+    if (triangles <= targetTriangles)
+        meshes.clear();
+    else
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            GLuint meshTarget = (GLuint) ((GLuint64) targetTriangles * (meshes[i].indices.size() / 3) / triangles);
+            SimplifyMesh(meshes[i], meshTarget);
+        }
+
+        std::cout << "Created voxelization proxy of " << path << ": " << triangles << " -> " << targetTriangles << " triangles at most" << std::endl;
+    }
+
+    WriteMeshCache(cachePath, sourceSize, sourceTime, meshes);
+
+    return true;
+}
+
+// start the import of the proxy on a worker thread
+PendingModel* LoadProxyModelAsync(const string& path, GLuint targetTriangles)
+{
+    return LoadMeshesAsync([path, targetTriangles]()
+    {
+        vector<MeshData> meshes;
+        ImportProxyMeshData(path, targetTriangles, meshes);
+        return meshes;
+    });
+}
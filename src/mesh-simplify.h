@@ -0,0 +1,33 @@
+#include <glad/glad.h>
+
+// we load the mesh data structures
+#include "model-loader.h"
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the parameters of the proxy generation
+
+// triangles of the voxelization proxy for each cell on a face of the grid: triangles smaller than
+// a grid cell don't change the voxelization, so the budget grows with the grid resolution
+const GLuint PROXY_TRIANGLES_PER_FACE_CELL = 2;
+
+// minimum triangle budget of a proxy, to keep the shape of small objects on coarse grids
+const GLuint PROXY_MIN_TRIANGLES = 1024;
+
+/////////////////////////////////////////////
+// we define the mesh simplification functions
+
+// triangle budget of the voxelization proxies for the given grid
+GLuint ProxyTriangleBudget(GLuint gridWidth, GLuint gridHeight, GLuint gridDepth);
+
+// simplify the mesh with quadric error edge collapses until it has at most the target triangles.
+// Only the positions are kept: the normals are recomputed and the other attributes are set to 0
+void SimplifyMesh(MeshData& mesh, GLuint targetTriangles);
+
+// import the model meshes and simplify them to the triangle budget. The proxy is cached next to the
+// model file ("<path>.proxy<budget>.meshcache"). If the model is already within the budget, no mesh is returned
+bool ImportProxyMeshData(const string& path, GLuint targetTriangles, vector<MeshData>& meshes);
+
+// start the import of the voxelization proxy of the model on a worker thread
+PendingModel* LoadProxyModelAsync(const string& path, GLuint targetTriangles);
@@ -0,0 +1,270 @@
+#include "model-loader.h"
+
+// Std. Includes
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <thread>
+#include <sys/stat.h>
+
+// Assimp includes
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+//////////////////////////////////////
+// we define the cache file format
+
+// first bytes of a cache file, followed by the format version
+const GLuint MESH_CACHE_MAGIC = 0x4D534843;
+const GLuint MESH_CACHE_VERSION = 1;
+
+// the cache stores the size and modification time of the source file, to detect when the model changes
+struct MeshCacheHeader
+{
+    GLuint magic;
+    GLuint version;
+    GLuint64 sourceSize;
+    GLuint64 sourceTime;
+    GLuint meshCount;
+};
+
+//////////////////////////////////////
+// utility functions
+
+// size and modification time of the file. Returns false if the file doesn't exist
+bool GetFileStamp(const string& path, GLuint64& size, GLuint64& time)
+{
+    struct stat info;
+
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+
+    size = info.st_size;
+    time = info.st_mtime;
+
+    return true;
+}
+
+// read the meshes from the cache file, if it exists and it was created from the current source file
+bool ReadMeshCache(const string& cachePath, GLuint64 sourceSize, GLuint64 sourceTime, vector<MeshData>& meshes)
+{
+    std::ifstream file(cachePath.c_str(), std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    MeshCacheHeader header;
+    file.read((char*) &header, sizeof(header));
+
+    if (!file || header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+        header.sourceSize != sourceSize || header.sourceTime != sourceTime)
+        return false;
+
+    meshes.resize(header.meshCount);
+
+    for (GLuint i = 0; i < header.meshCount; i++)
+    {
+        GLuint counts[2];
+        file.read((char*) counts, sizeof(counts));
+
+        if (!file)
+            break;
+
+        meshes[i].vertices.resize(counts[0]);
+        meshes[i].indices.resize(counts[1]);
+
+        file.read((char*) meshes[i].vertices.data(), counts[0] * sizeof(Vertex));
+        file.read((char*) meshes[i].indices.data(), counts[1] * sizeof(GLuint));
+    }
+
+    if (!file)
+    {
+        meshes.clear();
+        return false;
+    }
+
+    return true;
+}
+
+// write the meshes in the cache file. The file is written with a temporary name and then renamed, because
+// several workers could write the cache of the same model at the same time (e.g., the model and its proxy)
+void WriteMeshCache(const string& cachePath, GLuint64 sourceSize, GLuint64 sourceTime, const vector<MeshData>& meshes)
+{
+    string tempPath = cachePath + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    std::ofstream file(tempPath.c_str(), std::ios::binary);
+
+    if (!file.is_open())
+    {
+        std::cout << "Mesh cache: cannot write " << cachePath << std::endl;
+        return;
+    }
+
+    MeshCacheHeader header = {MESH_CACHE_MAGIC, MESH_CACHE_VERSION, sourceSize, sourceTime, (GLuint) meshes.size()};
+    file.write((const char*) &header, sizeof(header));
+
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        GLuint counts[2] = {(GLuint) meshes[i].vertices.size(), (GLuint) meshes[i].indices.size()};
+
+        file.write((const char*) counts, sizeof(counts));
+        file.write((const char*) meshes[i].vertices.data(), counts[0] * sizeof(Vertex));
+        file.write((const char*) meshes[i].indices.data(), counts[1] * sizeof(GLuint));
+    }
+
+    file.close();
+
+    // the rename doesn't replace an existing file on Windows
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        std::remove(cachePath.c_str());
+        if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+            std::remove(tempPath.c_str());
+    }
+}
+
+// convert the Assimp mesh in the vertex and index data used by the Mesh class (same conversion of the Model class)
+MeshData ProcessMesh(const aiMesh* mesh)
+{
+    MeshData data;
+    data.vertices.resize(mesh->mNumVertices);
+
+    if (!mesh->mTextureCoords[0])
+        std::cout << "WARNING::ASSIMP:: MODEL WITHOUT UV COORDINATES -> TANGENT AND BITANGENT ARE = 0" << std::endl;
+
+    for (GLuint i = 0; i < mesh->mNumVertices; i++)
+    {
+        Vertex &vertex = data.vertices[i];
+
+        vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+
+        if (mesh->mTextureCoords[0])
+        {
+            vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+            vertex.Tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+            vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+        }
+        else
+        {
+            vertex.TexCoords = glm::vec2(0.0f);
+            vertex.Tangent = glm::vec3(0.0f);
+            vertex.Bitangent = glm::vec3(0.0f);
+        }
+    }
+
+    data.indices.reserve(mesh->mNumFaces * 3);
+
+    for (GLuint i = 0; i < mesh->mNumFaces; i++)
+    {
+        const aiFace &face = mesh->mFaces[i];
+        for (GLuint j = 0; j < face.mNumIndices; j++)
+            data.indices.push_back(face.mIndices[j]);
+    }
+
+    return data;
+}
+
+// visit the Assimp nodes in the same order of the Model class
+void ProcessNode(const aiNode* node, const aiScene* scene, vector<MeshData>& meshes)
+{
+    for (GLuint i = 0; i < node->mNumMeshes; i++)
+        meshes.push_back(ProcessMesh(scene->mMeshes[node->mMeshes[i]]));
+
+    for (GLuint i = 0; i < node->mNumChildren; i++)
+        ProcessNode(node->mChildren[i], scene, meshes);
+}
+
+//////////////////////////////////////
+// model loading functions
+
+// import the meshes, from the cache or from the model file
+bool ImportMeshData(const string& path, vector<MeshData>& meshes)
+{
+    string cachePath = path + ".meshcache";
+    GLuint64 sourceSize = 0, sourceTime = 0;
+
+    if (!GetFileStamp(path, sourceSize, sourceTime))
+    {
+        std::cout << "ERROR::MODEL:: file not found " << path << std::endl;
+        return false;
+    }
+
+    if (ReadMeshCache(cachePath, sourceSize, sourceTime, meshes))
+        return true;
+
+    // each thread uses its own importer, so the imports can run in parallel
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    ProcessNode(scene->mRootNode, scene, meshes);
+
+    WriteMeshCache(cachePath, sourceSize, sourceTime, meshes);
+
+    return true;
+}
+
+// start the import on a worker thread
+PendingModel* LoadModelAsync(const string& path)
+{
+    return LoadMeshesAsync([path]()
+    {
+        vector<MeshData> meshes;
+        ImportMeshData(path, meshes);
+        return meshes;
+    });
+}
+
+// start the import function on a worker thread
+PendingModel* LoadMeshesAsync(std::function<vector<MeshData>()> import)
+{
+    PendingModel* pending = new PendingModel();
+    pending->nextMesh = 0;
+    pending->imported = false;
+
+    pending->import = std::async(std::launch::async, import);
+
+    return pending;
+}
+
+// upload the meshes within the budget: the Mesh constructor creates the GPU buffers, so it must run on the render thread
+bool UploadPendingModel(PendingModel* pending, GLuint64& budgetBytes)
+{
+    if (!pending->imported)
+    {
+        if (pending->import.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+
+        pending->meshes = pending->import.get();
+        pending->imported = true;
+    }
+
+    while (pending->nextMesh < pending->meshes.size() && budgetBytes > 0)
+    {
+        MeshData &data = pending->meshes[pending->nextMesh++];
+        GLuint64 bytes = data.vertices.size() * sizeof(Vertex) + data.indices.size() * sizeof(GLuint);
+
+        // the Mesh class cannot handle meshes without data
+        if (!data.vertices.empty() && !data.indices.empty())
+            pending->uploaded.emplace_back(data.vertices, data.indices);
+
+        budgetBytes = bytes < budgetBytes ? budgetBytes - bytes : 0;
+    }
+
+    return pending->nextMesh == pending->meshes.size();
+}
+
+// create the model with the uploaded meshes
+Model* TakePendingModel(PendingModel* pending)
+{
+    Model* model = new Model(std::move(pending->uploaded));
+    delete pending;
+
+    return model;
+}
@@ -0,0 +1,69 @@
+#include <glad/glad.h>
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <future>
+#include <functional>
+
+// classes developed during lab lectures to manage shaders and to load models
+#include <utils/shader.h>
+#include <utils/model.h>
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the structures for the background model loading
+
+// memory uploaded to the GPU at most in a frame by the models loaded in background (at least a mesh is uploaded)
+const GLuint64 MODEL_UPLOAD_BYTES_PER_FRAME = 8 * 1024 * 1024;
+
+// mesh data processed on the CPU, ready to be uploaded to the GPU
+struct MeshData
+{
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+};
+
+// model loaded in background: the import runs on a worker thread, then its meshes are uploaded
+// to the GPU by the render thread, a few at each frame
+struct PendingModel
+{
+    std::future<vector<MeshData>> import; // import running on the worker thread
+    vector<MeshData> meshes; // imported meshes waiting for the upload
+    vector<Mesh> uploaded; // meshes already uploaded
+    size_t nextMesh; // first mesh not uploaded
+    bool imported;
+};
+
+/////////////////////////////////////////////
+// we define the mesh cache functions
+
+// size and modification time of the file, used to check if a cache is up to date. Returns false if the file doesn't exist
+bool GetFileStamp(const string& path, GLuint64& size, GLuint64& time);
+
+// read the meshes from the cache file, if it exists and it was created from the source file with the given stamp
+bool ReadMeshCache(const string& cachePath, GLuint64 sourceSize, GLuint64 sourceTime, vector<MeshData>& meshes);
+
+// write the meshes in the cache file, with the stamp of their source file
+void WriteMeshCache(const string& cachePath, GLuint64 sourceSize, GLuint64 sourceTime, const vector<MeshData>& meshes);
+
+/////////////////////////////////////////////
+// we define the model loading functions
+
+// import the meshes of the model file. The processed meshes are read from the binary cache next to the
+// file ("<path>.meshcache") if it is up to date, otherwise the file is imported with Assimp and the cache is written.
+// It doesn't use OpenGL, so it can be called by any thread
+bool ImportMeshData(const string& path, vector<MeshData>& meshes);
+
+// start the import of the model on a worker thread
+PendingModel* LoadModelAsync(const string& path);
+
+// start the given import function on a worker thread
+PendingModel* LoadMeshesAsync(std::function<vector<MeshData>()> import);
+
+// upload the imported meshes of the model, until the budget is spent. Returns true when all the meshes are uploaded
+bool UploadPendingModel(PendingModel* pending, GLuint64& budgetBytes);
+
+// create the model with the uploaded meshes, and delete the pending model
+Model* TakePendingModel(PendingModel* pending);
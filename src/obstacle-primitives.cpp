@@ -0,0 +1,147 @@
+#include "obstacle-primitives.h"
+
+// Std. Includes
+#include <cmath>
+
+//////////////////////////////////////
+// utility functions
+
+// add the vertex to the mesh, with the tangent space of the given normal and tangent
+void AddPrimitiveVertex(MeshData& mesh, glm::vec3 position, glm::vec3 normal, glm::vec3 tangent, glm::vec2 texCoords)
+{
+    Vertex vertex;
+    vertex.Position = position;
+    vertex.Normal = normal;
+    vertex.TexCoords = texCoords;
+    vertex.Tangent = tangent;
+    vertex.Bitangent = glm::cross(normal, tangent);
+
+    mesh.vertices.push_back(vertex);
+}
+
+// add the surface of revolution around the y axis of the profile. Each point of the profile stores the radius
+// and the height of a ring (xy) and the normal in the profile plane (zw). The profile goes from the top to the
+// bottom, so the triangles are counter-clockwise seen from outside. The rings with radius 0 are the poles
+void AddLathe(MeshData& mesh, const vector<glm::vec4>& profile)
+{
+    GLuint first = (GLuint) mesh.vertices.size();
+
+    for (GLuint i = 0; i < profile.size(); i++)
+    {
+        for (GLuint j = 0; j <= PRIMITIVE_MESH_SEGMENTS; j++)
+        {
+            GLfloat angle = 2.0f * glm::pi<float>() * j / PRIMITIVE_MESH_SEGMENTS;
+            glm::vec3 direction = glm::vec3(std::cos(angle), 0.0f, -std::sin(angle));
+            glm::vec3 tangent = glm::vec3(-std::sin(angle), 0.0f, -std::cos(angle));
+
+            glm::vec3 position = direction * profile[i].x + glm::vec3(0.0f, profile[i].y, 0.0f);
+            glm::vec3 normal = glm::normalize(direction * profile[i].z + glm::vec3(0.0f, profile[i].w, 0.0f));
+
+            AddPrimitiveVertex(mesh, position, normal, tangent, glm::vec2((GLfloat) j / PRIMITIVE_MESH_SEGMENTS, (GLfloat) i / (profile.size() - 1)));
+        }
+    }
+
+    // the triangles touching a pole would be degenerate, so only one triangle of their quads is added
+    for (GLuint i = 0; i + 1 < profile.size(); i++)
+    {
+        for (GLuint j = 0; j < PRIMITIVE_MESH_SEGMENTS; j++)
+        {
+            GLuint a = first + i * (PRIMITIVE_MESH_SEGMENTS + 1) + j;
+            GLuint b = a + PRIMITIVE_MESH_SEGMENTS + 1;
+            GLuint c = b + 1;
+            GLuint d = a + 1;
+
+            if (profile[i + 1].x > 0.0f)
+                mesh.indices.insert(mesh.indices.end(), {a, b, c});
+
+            if (profile[i].x > 0.0f)
+                mesh.indices.insert(mesh.indices.end(), {a, c, d});
+        }
+    }
+}
+
+// add a hemisphere profile, from the pole to the equator, with the given center height and direction of the pole (1 or -1)
+void AddHemisphereProfile(vector<glm::vec4>& profile, GLfloat radius, GLfloat height, GLfloat pole)
+{
+    for (GLuint i = 0; i <= PRIMITIVE_MESH_RINGS; i++)
+    {
+        // the bottom hemisphere is visited from the equator to the pole
+        GLuint ring = pole > 0.0f ? i : PRIMITIVE_MESH_RINGS - i;
+        GLfloat angle = 0.5f * glm::pi<float>() * ring / PRIMITIVE_MESH_RINGS;
+
+        glm::vec2 normal = glm::vec2(std::sin(angle), pole * std::cos(angle));
+
+        // the poles are exactly on the axis
+        if (ring == 0)
+            normal.x = 0.0f;
+
+        profile.push_back(glm::vec4(normal.x * radius, height + normal.y * radius, normal));
+    }
+}
+
+// add the box with half edge 1, with a quad for each face
+void AddBox(MeshData& mesh)
+{
+    const glm::vec3 normals[6] = {glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)};
+    const glm::vec3 tangents[6] = {glm::vec3(0, 0, -1), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(1, 0, 0), glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0)};
+
+    for (GLuint face = 0; face < 6; face++)
+    {
+        GLuint first = (GLuint) mesh.vertices.size();
+
+        // the bitangent completes the tangent space, so the corners are counter-clockwise seen from outside
+        glm::vec3 bitangent = glm::cross(normals[face], tangents[face]);
+
+        AddPrimitiveVertex(mesh, normals[face] - tangents[face] - bitangent, normals[face], tangents[face], glm::vec2(0.0f, 0.0f));
+        AddPrimitiveVertex(mesh, normals[face] + tangents[face] - bitangent, normals[face], tangents[face], glm::vec2(1.0f, 0.0f));
+        AddPrimitiveVertex(mesh, normals[face] + tangents[face] + bitangent, normals[face], tangents[face], glm::vec2(1.0f, 1.0f));
+        AddPrimitiveVertex(mesh, normals[face] - tangents[face] + bitangent, normals[face], tangents[face], glm::vec2(0.0f, 1.0f));
+
+        mesh.indices.insert(mesh.indices.end(), {first, first + 1, first + 2, first, first + 2, first + 3});
+    }
+}
+
+//////////////////////////////////////
+// primitive mesh functions
+
+// build the mesh of the unit primitive
+vector<MeshData> BuildPrimitiveMeshes(ObstacleShape shape)
+{
+    MeshData mesh;
+    vector<glm::vec4> profile;
+
+    switch (shape)
+    {
+        case OBSTACLE_SPHERE:
+            // the equator is shared by the two hemispheres
+            AddHemisphereProfile(profile, 1.0f, 0.0f, 1.0f);
+            profile.pop_back();
+            AddHemisphereProfile(profile, 1.0f, 0.0f, -1.0f);
+            AddLathe(mesh, profile);
+            break;
+
+        case OBSTACLE_BOX:
+            AddBox(mesh);
+            break;
+
+        case OBSTACLE_CAPSULE:
+            // the equators of the two caps are connected by the side of the capsule
+            AddHemisphereProfile(profile, 0.5f, 0.5f, 1.0f);
+            AddHemisphereProfile(profile, 0.5f, -0.5f, -1.0f);
+            AddLathe(mesh, profile);
+            break;
+
+        case OBSTACLE_CYLINDER:
+            // the caps and the side have different normals along their edges, so they are separate surfaces
+            AddLathe(mesh, {glm::vec4(0.0f, 1.0f, 0.0f, 1.0f), glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)});
+            AddLathe(mesh, {glm::vec4(1.0f, 1.0f, 1.0f, 0.0f), glm::vec4(1.0f, -1.0f, 1.0f, 0.0f)});
+            AddLathe(mesh, {glm::vec4(1.0f, -1.0f, 0.0f, -1.0f), glm::vec4(0.0f, -1.0f, 0.0f, -1.0f)});
+            break;
+
+        default:
+            std::cout << "Obstacle shape " << shape << " is not a primitive" << std::endl;
+            return vector<MeshData>();
+    }
+
+    return vector<MeshData>(1, mesh);
+}
@@ -0,0 +1,26 @@
+#include <glad/glad.h>
+
+// we load the mesh data structures
+#include "model-loader.h"
+
+// we load the structure for the dynamic objects
+#include "obstacle_object.h"
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the parameters of the primitive meshes
+
+// vertices around the axis of the round primitives
+const GLuint PRIMITIVE_MESH_SEGMENTS = 48;
+
+// rings from the pole to the equator of the spheres and of the capsule caps
+const GLuint PRIMITIVE_MESH_RINGS = 12;
+
+/////////////////////////////////////////////
+// we define the primitive mesh functions
+
+// build the meshes of the unit primitive shape (see ObstacleShape), used to render the primitive obstacles in the scene
+// and by the CPU voxelizer. The simulation doesn't use them, since it evaluates the primitives analytically.
+// It doesn't use OpenGL, so it can be called by any thread
+vector<MeshData> BuildPrimitiveMeshes(ObstacleShape shape);
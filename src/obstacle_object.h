@@ -7,8 +7,22 @@
 // we load the model class
 #include <utils/model.h>
 
+// we load the registry of the GPU allocations
+#include "memory-registry.h"
+
 #pragma once
 
+// shape of an obstacle in the simulation: a mesh voxelized in a volume, or an analytic primitive
+// evaluated directly in the grid. The primitives are unit shapes in model space, placed by the model matrix
+enum ObstacleShape
+{
+    OBSTACLE_MESH,
+    OBSTACLE_SPHERE, // radius 1
+    OBSTACLE_BOX, // half edge 1
+    OBSTACLE_CAPSULE, // radius 0.5, segment from y = -0.5 to y = 0.5
+    OBSTACLE_CYLINDER // radius 1, half height 1, along y
+};
+
 // we define the structure for the dynaic objects
 struct ObstacleObject
 {
@@ -23,16 +37,41 @@ struct ObstacleObject
     glm::vec3 scale; // scale of the object
     string name; // name of the object visualized in the ui
     bool isActive; // if the object is active or not
+    ObstacleShape shape; // shape used in the simulation
+
+    // for the simulation: the low poly model is voxelized once in model space as a signed distance volume,
+    // and the volume is resampled in the simulation grid with the model matrix
+
+    GLuint voxelVolume; // occupancy volume of the model (0 if not voxelized yet)
+    glm::mat4 voxelVolumeMatrix; // transform from model space to the texture coordinates of the volume
+    GLfloat voxelSize; // edge of the volume voxels in model space (the volume stores the signed distance in voxels)
+
+    // if the object can be drawn in the obstacle buffers: the primitives don't need a voxelized volume
+    bool IsSimulationReady() const
+    {
+        return shape != OBSTACLE_MESH || voxelVolume != 0;
+    }
 
     // destructor
     ~ObstacleObject()
     {
-        // we delete the models
+        if (voxelVolume != 0)
+        {
+            UnregisterAllocation(GL_TEXTURE, voxelVolume);
+            glDeleteTextures(1, &voxelVolume);
+        }
+
+        // we delete the models (and remove them from the memory registry)
         // if the models are the same, we delete only one
         if (objectModel == lowPolyModel)
+        {
+            UnregisterModel(lowPolyModel);
             delete lowPolyModel;
+        }
         else
         {
+            UnregisterModel(lowPolyModel);
+            UnregisterModel(objectModel);
             delete lowPolyModel;
             delete objectModel;
         }
@@ -0,0 +1,300 @@
+#include <glad/glad.h>
+
+// classes developed during lab lectures to manage shaders
+#include <utils/shader.h>
+
+// we load the cache of the Shader Programs
+#include "shader-cache.h"
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the uniforms and samplers used by the simulation and rendering passes
+
+// binding point of the uniform block with the parameters shared by all the passes of a simulation step
+const GLuint SIMULATION_PARAMS_BINDING = 0;
+
+// binding point of the uniform block with the parameters of the analytic primitive obstacles
+const GLuint OBSTACLE_PRIMITIVES_BINDING = 1;
+
+// uniforms set by the passes. Their locations are resolved once after linking
+// and accessed by index, instead of being searched by name at each pass call
+enum PassUniform
+{
+    U_TIME_STEP,
+    U_DISSIPATION,
+    U_AMBIENT_TEMPERATURE,
+    U_GAS_BUOYANCY,
+    U_GAS_WEIGHT,
+    U_FORCE,
+    U_CENTER,
+    U_RADIUS,
+    U_DYE_INTENSITY,
+    U_IS_LIQUID_SIMULATION,
+    U_TEMPERATURE,
+    U_INITIAL_HEIGHT,
+    U_DAMPING_FACTOR,
+    U_EQUILIBRIUM_HEIGHT,
+    U_GRAVITY_ACCELERATION,
+    U_LEVEL_SET_THRESHOLD,
+    U_COLOR,
+    U_MODEL,
+    U_VIEW,
+    U_PROJECTION,
+    U_SCALING_FACTOR,
+    U_DELTA_TIME,
+    U_WORLD_TO_VOLUME,
+    U_PREV_FROM_CURRENT,
+    U_OBSTACLE_COUNT,
+    U_FIRST_BATCH,
+    U_DISTANCE_SCALE,
+    U_PRIMITIVE_COUNT,
+    U_FIRST_LAYER,
+    U_EMPTY_SPACE_SKIPPING,
+    U_STEP_QUALITY,
+    U_ADAPTIVE_STEPPING,
+    U_STEP_COUNT_VIEW,
+    U_PACKED_GRADIENTS,
+    U_BOUNDS_MIN,
+    U_BOUNDS_MAX,
+    U_JITTER_OFFSET,
+    U_REPROJECTION,
+    U_HISTORY_WEIGHT,
+    U_LIGHT_TO_TEXTURE,
+    U_TEXTURE_TO_LIGHT,
+    U_SLICE_DEPTH,
+    U_SLICE_OFFSET,
+    U_SLICE_LENGTH,
+    U_SHADOW_EXTINCTION,
+    U_BLUR_WEIGHTS,
+    U_STEP_WIDTH,
+    U_COLOR_SIGMA,
+    U_DEPTH_SIGMA,
+    U_GRID_SIZE,
+    U_INVERSE_SCREEN_SIZE,
+    U_NEAR_PLANE,
+    U_EYE_POS,
+    U_CAMERA_FRONT,
+    U_CAMERA_UP,
+    U_CAMERA_RIGHT,
+    U_KD,
+    U_RUGOSITY,
+    U_F0,
+    U_LIGHT_VECTOR,
+    U_AXIS,
+    U_SIGMA,
+    U_THRESHOLD,
+    U_K_SIGMA,
+    U_SOURCE_SIZE,
+    PASS_UNIFORM_COUNT
+};
+
+// names of the uniforms in the shaders, in the same order of the enum
+const GLchar* const PassUniformNames[PASS_UNIFORM_COUNT] =
+{
+    "timeStep",
+    "dissipation",
+    "ambientTemperature",
+    "gasBuoyancy",
+    "gasWeight",
+    "force",
+    "center",
+    "radius",
+    "dyeIntensity",
+    "isLiquidSimulation",
+    "temperature",
+    "initialHeight",
+    "dampingFactor",
+    "equilibriumHeight",
+    "gravityAcceleration",
+    "levelSetThreshold",
+    "color",
+    "model",
+    "view",
+    "projection",
+    "scaling_factor",
+    "deltaTime",
+    "worldToVolume",
+    "prevFromCurrent",
+    "obstacleCount",
+    "firstBatch",
+    "distanceScale",
+    "primitiveCount",
+    "firstLayer",
+    "emptySpaceSkipping",
+    "stepQuality",
+    "adaptiveStepping",
+    "stepCountView",
+    "packedGradients",
+    "boundsMin",
+    "boundsMax",
+    "jitterOffset",
+    "reprojection",
+    "historyWeight",
+    "lightToTexture",
+    "textureToLight",
+    "sliceDepth",
+    "sliceOffset",
+    "sliceLength",
+    "shadowExtinction",
+    "blurWeights",
+    "stepWidth",
+    "colorSigma",
+    "depthSigma",
+    "grid_size",
+    "InverseScreenSize",
+    "nearPlane",
+    "eyePos",
+    "cameraFront",
+    "cameraUp",
+    "cameraRight",
+    "Kd",
+    "rugosity",
+    "F0",
+    "lightVector",
+    "axis",
+    "uSigma",
+    "uThreshold",
+    "uKSigma",
+    "sourceSize"
+};
+
+// samplers read by the passes. Each sampler is assigned to the texture unit equal to its
+// enum value in every program, so a texture read by consecutive passes stays bound to the same unit
+enum PassSampler
+{
+    S_VELOCITY,
+    S_SOURCE,
+    S_OBSTACLE,
+    S_PHI1_HAT,
+    S_PHI2_HAT,
+    S_TEMPERATURE,
+    S_DENSITY,
+    S_PRESSURE,
+    S_DIVERGENCE,
+    S_OBSTACLE_VELOCITY,
+    S_LEVEL_SET,
+    S_SCENE_DEPTH,
+    S_RAYDATA,
+    S_RAYDATA_FRONT,
+    S_RAYDATA_BACK,
+    S_BACKGROUND,
+    S_FLUID,
+    S_FLUID_DEPTH,
+    S_RAYDATA_DEPTH,
+    S_SCENE,
+    S_IMAGE_DATA,
+    S_OBSTACLE_DISTANCE,
+    S_OCCUPANCY,
+    S_HISTORY,
+    S_BLUE_NOISE,
+    S_TRANSMITTANCE,
+    S_GRADIENT,
+    S_VOXEL_VOLUMES, // array of OBSTACLE_BATCH_SIZE samplers, on consecutive units (it must be the last sampler)
+    PASS_SAMPLER_COUNT
+};
+
+// obstacles resampled in the grid by a single draw, limited by the texture units of the fragment stage
+const GLuint OBSTACLE_BATCH_SIZE = 8;
+
+// texture units used by the passes: the sampler arrays take a unit for each element
+const GLuint PASS_TEXTURE_UNIT_COUNT = PASS_SAMPLER_COUNT - 1 + OBSTACLE_BATCH_SIZE;
+
+// names of the samplers in the shaders, in the same order of the enum
+const GLchar* const PassSamplerNames[PASS_SAMPLER_COUNT] =
+{
+    "VelocityTexture",
+    "SourceTexture",
+    "ObstacleTexture",
+    "Phi1HatTexture",
+    "Phi2HatTexture",
+    "TemperatureTexture",
+    "DensityTexture",
+    "PressureTexture",
+    "DivergenceTexture",
+    "ObstacleVelocityTexture",
+    "LevelSetTexture",
+    "SceneDepthTexture",
+    "RayDataTexture",
+    "RayDataFront",
+    "RayDataBack",
+    "BackgroundTexture",
+    "FluidTexture",
+    "FluidDepth",
+    "RayDataDepth",
+    "SceneTexture",
+    "imageData",
+    "ObstacleDistanceTexture",
+    "OccupancyTexture",
+    "HistoryTexture",
+    "BlueNoiseTexture",
+    "TransmittanceTexture",
+    "GradientTexture",
+    "VoxelVolumeTextures"
+};
+
+/////////////////// PASS SHADER class ///////////////////////
+// Shader Program of a simulation or rendering pass: after linking, the uniform locations are
+// cached, the samplers are set to their fixed texture units and the uniform blocks (if used by the
+// program) are linked to their binding points.
+// The program is requested to the shader cache and finished at its first use, so the construction
+// doesn't wait for the compilation
+class PassShader : public Shader
+{
+public:
+    // locations of the pass uniforms (-1 if the uniform is not active in the program), valid after the first use
+    GLint Locations[PASS_UNIFORM_COUNT];
+
+    PassShader(const GLchar* vertexPath, const GLchar* fragmentPath) : Shader(RequestProgram(vertexPath, nullptr, fragmentPath)), resolved(false) {}
+
+    PassShader(const GLchar* vertexPath, const GLchar* geometryPath, const GLchar* fragmentPath) : Shader(RequestProgram(vertexPath, geometryPath, fragmentPath)), resolved(false) {}
+
+    // We activate the Shader Program, resolving its locations at the first use
+    void Use()
+    {
+        if (!this->resolved)
+            this->resolveLocations();
+
+        Shader::Use();
+    }
+
+private:
+    bool resolved;
+
+    void resolveLocations()
+    {
+        FinishProgram(this->Program);
+        this->resolved = true;
+
+        for (int i = 0; i < PASS_UNIFORM_COUNT; i++)
+            this->Locations[i] = glGetUniformLocation(this->Program, PassUniformNames[i]);
+
+        // the sampler values never change, so they are set only here. The elements of the
+        // voxel volumes array are set to the units following the one of the sampler
+        for (int i = 0; i < PASS_SAMPLER_COUNT; i++)
+        {
+            GLint location = glGetUniformLocation(this->Program, PassSamplerNames[i]);
+            if (location < 0)
+                continue;
+
+            if (i == S_VOXEL_VOLUMES)
+            {
+                GLint units[OBSTACLE_BATCH_SIZE];
+                for (GLuint j = 0; j < OBSTACLE_BATCH_SIZE; j++)
+                    units[j] = i + j;
+
+                glProgramUniform1iv(this->Program, location, OBSTACLE_BATCH_SIZE, units);
+            }
+            else
+                glProgramUniform1i(this->Program, location, i);
+        }
+
+        GLuint blockIndex = glGetUniformBlockIndex(this->Program, "SimulationParams");
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(this->Program, blockIndex, SIMULATION_PARAMS_BINDING);
+
+        blockIndex = glGetUniformBlockIndex(this->Program, "ObstaclePrimitives");
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(this->Program, blockIndex, OBSTACLE_PRIMITIVES_BINDING);
+    }
+};
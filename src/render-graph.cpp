@@ -0,0 +1,266 @@
+#include "render-graph.h"
+
+// Std. Includes
+#include <iostream>
+
+//////////////////////////////////////
+// utility functions
+
+// memory size of a slab with the given description. The simulation slabs store
+// half floats, so each component takes 2 bytes
+GLuint64 SlabBytes(SlabDesc desc)
+{
+    return (GLuint64) desc.width * desc.height * desc.depth * desc.dimensions * 2;
+}
+
+//////////////////////////////////////
+// graph declaration
+
+// remove the declared passes and slabs, and mark all the pool slabs as free
+void RenderGraph::Reset()
+{
+    this->resources.clear();
+    this->passes.clear();
+
+    for (size_t i = 0; i < this->pool.size(); i++)
+        this->pool[i].inUse = false;
+}
+
+// declare a persistent slab
+SlabHandle RenderGraph::Import(const std::string &name, Slab *slab, SlabDesc desc)
+{
+    Resource resource = {name, desc, slab, -1, -1, -1};
+    this->resources.push_back(resource);
+
+    return this->resources.size() - 1;
+}
+
+// declare a transient slab
+SlabHandle RenderGraph::Create(const std::string &name, SlabDesc desc)
+{
+    Resource resource = {name, desc, nullptr, -1, -1, -1};
+    this->resources.push_back(resource);
+
+    return this->resources.size() - 1;
+}
+
+// declare a pass
+void RenderGraph::AddPass(const std::string &name, const std::vector<SlabHandle> &reads, const std::vector<SlabHandle> &writes, std::function<void()> execute, bool hasSideEffects)
+{
+    Pass pass = {name, reads, writes, execute, hasSideEffects, false};
+    this->passes.push_back(pass);
+}
+
+// get the slab assigned to the handle
+Slab& RenderGraph::Get(SlabHandle handle)
+{
+    Resource &resource = this->resources[handle];
+
+    if (resource.imported != nullptr)
+        return *resource.imported;
+
+    if (resource.physical < 0)
+    {
+        // the slab is used by a pass not declared as its reader or writer
+        std::cout << "Render graph " << this->name << ": slab " << resource.name << " has no physical slab assigned" << std::endl;
+
+        static Slab invalidSlab = {0, 0};
+        return invalidSlab;
+    }
+
+    return this->pool[resource.physical].slab;
+}
+
+//////////////////////////////////////
+// graph compilation
+
+// a pass is kept if it has side effects, if it writes a persistent slab, or if it writes a transient
+// slab read by a kept pass declared after it. The passes are visited in reverse order, so the
+// readers are always visited before the writers
+void RenderGraph::cullPasses()
+{
+    std::vector<bool> needed(this->resources.size(), false);
+
+    for (GLint i = this->passes.size() - 1; i >= 0; i--)
+    {
+        Pass &pass = this->passes[i];
+
+        pass.culled = !pass.hasSideEffects;
+
+        for (size_t w = 0; w < pass.writes.size() && pass.culled; w++)
+        {
+            SlabHandle handle = pass.writes[w];
+            if (this->resources[handle].imported != nullptr || needed[handle])
+                pass.culled = false;
+        }
+
+        if (pass.culled)
+            continue;
+
+        for (size_t r = 0; r < pass.reads.size(); r++)
+            needed[pass.reads[r]] = true;
+    }
+}
+
+// the lifetime of a transient slab goes from the first to the last kept pass that reads or writes it
+void RenderGraph::computeLifetimes()
+{
+    for (size_t i = 0; i < this->passes.size(); i++)
+    {
+        Pass &pass = this->passes[i];
+
+        if (pass.culled)
+            continue;
+
+        // reads and writes are handled in the same way
+        for (int k = 0; k < 2; k++)
+        {
+            const std::vector<SlabHandle> &handles = k == 0 ? pass.reads : pass.writes;
+
+            for (size_t h = 0; h < handles.size(); h++)
+            {
+                Resource &resource = this->resources[handles[h]];
+
+                if (resource.imported != nullptr)
+                    continue;
+
+                if (resource.firstPass < 0)
+                    resource.firstPass = i;
+                resource.lastPass = i;
+            }
+        }
+    }
+}
+
+// assign the transient slabs to the pool following the passes order: before a pass, the slabs starting their
+// lifetime take a free pool slab with the same description (or a new one is created); after the pass, the
+// slabs ending their lifetime give back their pool slab
+void RenderGraph::assignPhysicalSlabs()
+{
+    for (size_t i = 0; i < this->passes.size(); i++)
+    {
+        if (this->passes[i].culled)
+            continue;
+
+        for (size_t r = 0; r < this->resources.size(); r++)
+        {
+            Resource &resource = this->resources[r];
+
+            if (resource.imported != nullptr || resource.firstPass != (GLint) i)
+                continue;
+
+            for (size_t p = 0; p < this->pool.size() && resource.physical < 0; p++)
+            {
+                if (!this->pool[p].inUse && this->pool[p].desc == resource.desc)
+                    resource.physical = p;
+            }
+
+            if (resource.physical < 0)
+            {
+                PooledSlab pooled = {AcquireSlab(resource.desc), resource.desc, false};
+                this->pool.push_back(pooled);
+
+                resource.physical = this->pool.size() - 1;
+            }
+
+            this->pool[resource.physical].inUse = true;
+        }
+
+        // we measure the memory of the transient slabs alive during the pass
+        GLuint64 aliveBytes = 0;
+        for (size_t p = 0; p < this->pool.size(); p++)
+        {
+            if (this->pool[p].inUse)
+                aliveBytes += SlabBytes(this->pool[p].desc);
+        }
+
+        this->stats.peakTransientBytes = glm::max(this->stats.peakTransientBytes, aliveBytes);
+
+        for (size_t r = 0; r < this->resources.size(); r++)
+        {
+            Resource &resource = this->resources[r];
+
+            if (resource.imported == nullptr && resource.lastPass == (GLint) i)
+                this->pool[resource.physical].inUse = false;
+        }
+    }
+}
+
+// compile the graph and update the statistics
+void RenderGraph::Compile()
+{
+    RenderGraphStats previous = this->stats;
+    this->stats = {};
+
+    this->cullPasses();
+    this->computeLifetimes();
+    this->assignPhysicalSlabs();
+
+    this->stats.passes = this->passes.size();
+
+    for (size_t i = 0; i < this->passes.size(); i++)
+    {
+        if (this->passes[i].culled)
+            this->stats.culledPasses++;
+    }
+
+    for (size_t r = 0; r < this->resources.size(); r++)
+    {
+        Resource &resource = this->resources[r];
+
+        if (resource.imported != nullptr)
+            this->stats.importedBytes += SlabBytes(resource.desc);
+        else if (resource.physical >= 0)
+        {
+            this->stats.transientSlabs++;
+            this->stats.transientBytes += SlabBytes(resource.desc);
+        }
+    }
+
+    this->stats.pooledSlabs = this->pool.size();
+
+    for (size_t p = 0; p < this->pool.size(); p++)
+        this->stats.pooledBytes += SlabBytes(this->pool[p].desc);
+
+    this->printStats(previous);
+}
+
+// print the statistics on console when the shape of the graph changes
+void RenderGraph::printStats(const RenderGraphStats &previous)
+{
+    if (previous.passes == this->stats.passes && previous.culledPasses == this->stats.culledPasses &&
+        previous.pooledSlabs == this->stats.pooledSlabs && previous.peakTransientBytes == this->stats.peakTransientBytes)
+        return;
+
+    std::cout << "Render graph " << this->name << ": " << this->stats.passes << " passes (" << this->stats.culledPasses << " culled), "
+              << this->stats.transientSlabs << " transient slabs in " << this->stats.pooledSlabs << " pooled slabs" << std::endl;
+
+    std::cout << "\tpersistent slabs: " << ToMegabytes(this->stats.importedBytes) << " MB, transient peak: " << ToMegabytes(this->stats.peakTransientBytes)
+              << " MB (" << ToMegabytes(this->stats.transientBytes) << " MB without aliasing), peak VRAM: "
+              << ToMegabytes(this->stats.importedBytes + this->stats.pooledBytes) << " MB" << std::endl;
+}
+
+//////////////////////////////////////
+// graph execution
+
+// execute the kept passes in declaration order
+void RenderGraph::Execute()
+{
+    for (size_t i = 0; i < this->passes.size(); i++)
+    {
+        if (!this->passes[i].culled)
+            this->passes[i].execute();
+    }
+}
+
+// give back the physical slabs of the graph to the slab pool
+void RenderGraph::Release()
+{
+    for (size_t p = 0; p < this->pool.size(); p++)
+        ReleaseSlab(this->pool[p].slab);
+
+    this->pool.clear();
+
+    for (size_t r = 0; r < this->resources.size(); r++)
+        this->resources[r].physical = -1;
+}
@@ -0,0 +1,128 @@
+#include <glad/glad.h>
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <functional>
+
+// we load the simulation structures and the slab creation functions
+#include "fluid-sim.h"
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the structures for the render graph
+
+// handle of a slab declared in the render graph
+typedef GLint SlabHandle;
+
+// statistics of the last compiled graph, in bytes for the memory values
+struct RenderGraphStats
+{
+    GLuint passes; // declared passes
+    GLuint culledPasses; // passes removed because their outputs are never used
+    GLuint transientSlabs; // declared transient slabs
+    GLuint pooledSlabs; // physical slabs allocated to host the transient ones
+    GLuint64 importedBytes; // memory of the persistent slabs
+    GLuint64 transientBytes; // memory needed by the transient slabs without aliasing
+    GLuint64 peakTransientBytes; // memory of the transient slabs alive at the same time (peak)
+    GLuint64 pooledBytes; // memory of the physical slabs in the pool
+};
+
+/////////////////// RENDER GRAPH class ///////////////////////
+// Frame graph for the simulation step: each pass declares the slabs it reads and writes, and the
+// graph is compiled before its execution to
+// - cull the passes whose outputs are not used by a later pass or by a persistent (imported) slab;
+// - compute the lifetime of each transient slab, from the first to the last pass using it;
+// - assign the transient slabs to a pool of physical slabs, so that transient slabs with
+//   the same description and non-overlapping lifetimes share the same textures.
+// The graph is declared again at each step, while the pool survives between steps, so no texture is
+// allocated once the pool has grown to the peak of the graph.
+// N.B.) the passes swap their destination with the slab they update (ping-pong), so the transient slab
+// used as destination must have the same description of the updated slab
+class RenderGraph
+{
+public:
+    RenderGraph(const std::string &name) : name(name)
+    {
+        this->stats = {};
+    }
+
+    // remove the declared passes and slabs. The physical pool is kept for the next declaration
+    void Reset();
+
+    // declare a persistent slab, whose content survives the graph execution. The passes swap it with the
+    // pool slabs, so it must be taken from the slab pool too (see AcquireSlab)
+    SlabHandle Import(const std::string &name, Slab *slab, SlabDesc desc);
+
+    // declare a transient slab, whose content is valid only between its first and last use in the graph
+    SlabHandle Create(const std::string &name, SlabDesc desc);
+
+    // declare a pass with the slabs it reads and writes. A pass with side effects (it writes resources
+    // not tracked by the graph) is never culled
+    void AddPass(const std::string &name, const std::vector<SlabHandle> &reads, const std::vector<SlabHandle> &writes, std::function<void()> execute, bool hasSideEffects = false);
+
+    // get the slab assigned to the handle (valid after the compilation)
+    Slab& Get(SlabHandle handle);
+
+    // cull the unused passes and assign the transient slabs to the physical pool
+    void Compile();
+
+    // execute the passes not culled, in declaration order
+    void Execute();
+
+    // give back the physical slabs to the slab pool (needed when the grid size changes)
+    void Release();
+
+    // statistics of the last compilation
+    const RenderGraphStats& GetStats() const
+    {
+        return this->stats;
+    }
+
+private:
+    // slab declared in the graph
+    struct Resource
+    {
+        std::string name;
+        SlabDesc desc;
+        Slab *imported; // persistent slab, or nullptr if transient
+        GLint physical; // index of the pool slab assigned to the transient slab
+        GLint firstPass, lastPass; // lifetime of the transient slab
+    };
+
+    // pass declared in the graph
+    struct Pass
+    {
+        std::string name;
+        std::vector<SlabHandle> reads;
+        std::vector<SlabHandle> writes;
+        std::function<void()> execute;
+        bool hasSideEffects;
+        bool culled;
+    };
+
+    // physical slab of the pool
+    struct PooledSlab
+    {
+        Slab slab;
+        SlabDesc desc;
+        bool inUse;
+    };
+
+    std::string name;
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<PooledSlab> pool;
+
+    RenderGraphStats stats;
+
+    void cullPasses();
+    void computeLifetimes();
+    void assignPhysicalSlabs();
+    void printStats(const RenderGraphStats &previous);
+};
+
+// memory size of a slab with the given description
+GLuint64 SlabBytes(SlabDesc desc);
@@ -0,0 +1,350 @@
+#include "shader-cache.h"
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+// directory creation is platform dependent
+#ifdef _WIN32
+    #include <direct.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+// the parallel compilation extension is not part of the loaded GL version, so its
+// constants and function are defined here
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+//////////////////////////////////////
+// we define the cache data
+
+// program requested but not finished yet
+struct PendingProgram
+{
+    std::string paths[3]; // vertex, geometry (empty if not used) and fragment shader paths
+    GLuint shaders[3]; // compiled shaders (0 if the program was loaded from the cache)
+    std::string cachePath; // file of the program binary
+};
+
+// requested programs, indexed by program name
+std::map<GLuint, PendingProgram> pendingPrograms;
+
+// directory of the program binaries
+std::string cacheDirectory;
+
+// driver string, part of the cache key because a binary is valid only for the driver that created it
+std::string driverString;
+
+// the program binaries are supported only if the driver exposes at least one binary format
+bool binaryCacheSupported = false;
+
+bool parallelCompileSupported = false;
+
+// statistics of the cache
+GLuint cachedPrograms = 0;
+GLuint compiledPrograms = 0;
+
+// first bytes of a cache file, to discard files not written by the cache
+const GLuint CACHE_FILE_MAGIC = 0x46535042;
+
+//////////////////////////////////////
+// utility functions
+
+// FNV-1a hash of the string, continuing from the given hash
+GLuint64 HashString(const std::string &text, GLuint64 hash)
+{
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        hash ^= (unsigned char) text[i];
+        hash *= 1099511628211ULL;
+    }
+
+    // we add a separator, so that the concatenation of different strings gives different hashes
+    hash ^= 0xFF;
+    hash *= 1099511628211ULL;
+
+    return hash;
+}
+
+// read the shader source code from file
+std::string ReadShaderSource(const std::string &path)
+{
+    std::ifstream file(path.c_str());
+
+    if (!file.is_open())
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return "";
+    }
+
+    std::stringstream stream;
+    stream << file.rdbuf();
+
+    return stream.str();
+}
+
+// check if the extension is supported by the driver
+bool HasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+    for (GLint i = 0; i < count; i++)
+    {
+        if (std::string((const char*) glGetStringi(GL_EXTENSIONS, i)) == name)
+            return true;
+    }
+
+    return false;
+}
+
+// compile a shader without waiting for the result
+GLuint StartShaderCompilation(GLenum type, const std::string &source)
+{
+    const GLchar* code = source.c_str();
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &code, NULL);
+    glCompileShader(shader);
+
+    return shader;
+}
+
+// load the program binary from the cache file. Returns false if the file is missing
+// or the driver refuses the binary (e.g., after a driver update)
+bool LoadProgramBinary(GLuint program, const std::string &cachePath)
+{
+    std::ifstream file(cachePath.c_str(), std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    GLuint magic = 0;
+    GLenum format = 0;
+    GLint length = 0;
+
+    file.read((char*) &magic, sizeof(magic));
+    file.read((char*) &format, sizeof(format));
+    file.read((char*) &length, sizeof(length));
+
+    if (!file || magic != CACHE_FILE_MAGIC || length <= 0)
+        return false;
+
+    std::vector<char> binary(length);
+    file.read(binary.data(), length);
+
+    if (!file)
+        return false;
+
+    glProgramBinary(program, format, binary.data(), length);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    return success == GL_TRUE;
+}
+
+// save the program binary in the cache file
+void SaveProgramBinary(GLuint program, const std::string &cachePath)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+    std::ofstream file(cachePath.c_str(), std::ios::binary);
+
+    if (!file.is_open())
+    {
+        std::cout << "Shader cache: cannot write " << cachePath << std::endl;
+        return;
+    }
+
+    file.write((const char*) &CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC));
+    file.write((const char*) &format, sizeof(format));
+    file.write((const char*) &length, sizeof(length));
+    file.write(binary.data(), length);
+}
+
+// check the compilation errors of the shader, printing its log
+bool CheckShader(GLuint shader, const std::string &path)
+{
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+
+    if (!success)
+    {
+        GLchar infoLog[1024];
+        glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+        std::cout << "| ERROR::::SHADER-COMPILATION-ERROR of " << path << "|\n" << infoLog << "\n| -- --------------------------------------------------- -- | " << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+//////////////////////////////////////
+// cache functions
+
+// initialize the cache
+void InitShaderCache(const char* directory, GLADloadproc loader)
+{
+    cacheDirectory = directory;
+
+#ifdef _WIN32
+    _mkdir(directory);
+#else
+    mkdir(directory, 0755);
+#endif
+
+    driverString = std::string((const char*) glGetString(GL_VENDOR)) + " " + (const char*) glGetString(GL_RENDERER) + " " + (const char*) glGetString(GL_VERSION);
+
+    GLint binaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    binaryCacheSupported = binaryFormats > 0;
+
+    // we let the driver choose the number of compiler threads
+    const char* parallelFunction = nullptr;
+    if (HasExtension("GL_KHR_parallel_shader_compile"))
+        parallelFunction = "glMaxShaderCompilerThreadsKHR";
+    else if (HasExtension("GL_ARB_parallel_shader_compile"))
+        parallelFunction = "glMaxShaderCompilerThreadsARB";
+
+    if (parallelFunction != nullptr)
+    {
+        PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) loader(parallelFunction);
+
+        if (maxShaderCompilerThreads != nullptr)
+        {
+            maxShaderCompilerThreads(0xFFFFFFFF);
+            parallelCompileSupported = true;
+        }
+    }
+
+    std::cout << "Shader cache: program binaries " << (binaryCacheSupported ? "enabled" : "not supported by the driver")
+              << ", parallel compilation " << (parallelCompileSupported ? "enabled" : "not supported") << std::endl;
+}
+
+// start the creation of the program: if its binary is in the cache, it is loaded; otherwise,
+// the shaders are compiled and linked without checking the results, which are read when the program is finished
+GLuint RequestProgram(const GLchar* vertexPath, const GLchar* geometryPath, const GLchar* fragmentPath)
+{
+    PendingProgram pending;
+    pending.paths[0] = vertexPath;
+    pending.paths[1] = geometryPath != nullptr ? geometryPath : "";
+    pending.paths[2] = fragmentPath;
+
+    std::string sources[3];
+    GLuint64 hash = HashString(driverString, 14695981039346656037ULL);
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (!pending.paths[i].empty())
+            sources[i] = ReadShaderSource(pending.paths[i]);
+
+        hash = HashString(sources[i], hash);
+    }
+
+    std::stringstream cachePath;
+    cachePath << cacheDirectory << "/" << std::hex << hash << ".bin";
+    pending.cachePath = cachePath.str();
+
+    GLuint program = glCreateProgram();
+
+    if (binaryCacheSupported && LoadProgramBinary(program, pending.cachePath))
+    {
+        pending.shaders[0] = pending.shaders[1] = pending.shaders[2] = 0;
+        cachedPrograms++;
+    }
+    else
+    {
+        const GLenum types[3] = {GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER};
+
+        for (int i = 0; i < 3; i++)
+        {
+            pending.shaders[i] = pending.paths[i].empty() ? 0 : StartShaderCompilation(types[i], sources[i]);
+
+            if (pending.shaders[i] != 0)
+                glAttachShader(program, pending.shaders[i]);
+        }
+
+        if (binaryCacheSupported)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+        glLinkProgram(program);
+        compiledPrograms++;
+    }
+
+    pendingPrograms[program] = pending;
+
+    return program;
+}
+
+// finish the program: the compilation results are checked only now, so the driver could have
+// compiled it in the meantime
+bool FinishProgram(GLuint program)
+{
+    std::map<GLuint, PendingProgram>::iterator it = pendingPrograms.find(program);
+
+    if (it == pendingPrograms.end())
+        return true;
+
+    PendingProgram &pending = it->second;
+    bool fromSource = false;
+    bool status = true;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (pending.shaders[i] == 0)
+            continue;
+
+        fromSource = true;
+        status = CheckShader(pending.shaders[i], pending.paths[i]) && status;
+
+        // the shaders are linked to the Shader Program, so we do not need them anymore
+        glDetachShader(program, pending.shaders[i]);
+        glDeleteShader(pending.shaders[i]);
+    }
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    if (!success)
+    {
+        GLchar infoLog[1024];
+        glGetProgramInfoLog(program, 1024, NULL, infoLog);
+        std::cout << "| ERROR::::PROGRAM-LINKING-ERROR of " << pending.paths[0] << " " << pending.paths[1] << " " << pending.paths[2]
+                  << "|\n" << infoLog << "\n| -- --------------------------------------------------- -- |" << std::endl;
+        status = false;
+    }
+
+    if (status && fromSource && binaryCacheSupported)
+        SaveProgramBinary(program, pending.cachePath);
+
+    pendingPrograms.erase(it);
+
+    return status;
+}
+
+// finish all the requested programs
+void FinishPendingPrograms()
+{
+    while (!pendingPrograms.empty())
+        FinishProgram(pendingPrograms.begin()->first);
+}
+
+// print on console the cache statistics
+void PrintShaderCacheStats()
+{
+    std::cout << "Shader cache: " << cachedPrograms << " programs loaded from binaries, " << compiledPrograms << " compiled from source" << std::endl;
+}
@@ -0,0 +1,30 @@
+#include <glad/glad.h>
+
+#pragma once
+
+/////////////////////////////////////////////
+// we define the Shader Program cache functions
+//
+// The Shader Programs are created in two steps: the request starts the compilation (or loads the
+// program binary saved by a previous run) without waiting for it, and the program is finished only
+// when it is needed. Requesting all the programs before loading the models lets the drivers supporting
+// parallel compilation build them in the background. Each program compiled from source is saved as a
+// binary in the cache directory, keyed by the hash of its sources and of the driver string, so the next
+// runs skip the compilation
+
+// initialize the cache in the given directory. The loader is used to get the parallel compilation
+// function, if the extension is supported
+void InitShaderCache(const char* directory, GLADloadproc loader);
+
+// start the creation of a Shader Program (geometryPath can be nullptr) and return its name
+GLuint RequestProgram(const GLchar* vertexPath, const GLchar* geometryPath, const GLchar* fragmentPath);
+
+// wait for the requested program, check its compilation and save its binary in the cache.
+// Returns false if the program has errors (it does nothing if the program is not pending)
+bool FinishProgram(GLuint program);
+
+// finish all the requested programs
+void FinishPendingPrograms();
+
+// print on console the number of programs loaded from the cache and compiled from source
+void PrintShaderCacheStats();
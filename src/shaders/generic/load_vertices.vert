@@ -6,16 +6,21 @@
     The vertex shader is responsible for setting the position of the vertex
     and passing the instance ID to the geometry shader, which will enable the
     layered rendering.
+
+    The instances start from the firstLayer uniform (0 if not set), so a pass
+    can draw only a range of layers without the base instance of OpenGL 4.2.
 */
 
 #version 410 core
 
 in vec4 position;
 
+uniform int firstLayer; // Layer of the first instance
+
 out int vInstance;
 
 void main()
 {
     gl_Position = position;
-    vInstance = gl_InstanceID;
+    vInstance = gl_InstanceID + firstLayer;
 }
\ No newline at end of file
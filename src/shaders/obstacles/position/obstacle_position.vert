@@ -31,7 +31,14 @@
 
 layout (location = 0) in vec3 position;
 
-uniform float grid_depth; // Number of slices
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
+
 uniform float scaling_factor; // Scale of the model
 
 uniform mat4 model;
@@ -50,7 +57,7 @@ void main()
     // range [0, 2 * scaling_factor], where scaling_factor is also equal to half
     // the edge of the fluid cube. The 1.0 value is added to compensate for the
     // camera position, which is set to (0, 0, 1) compared to the fluid cube front face.
-    float nearPlane = 2 * scaling_factor * ((gl_InstanceID + 1) / grid_depth) + 1.0;
+    float nearPlane = 2 * scaling_factor * ((gl_InstanceID + 1) / GridSize.z) + 1.0;
     float farPlane = 100;
 
     float newProj1 = -2.0 / (farPlane - nearPlane);
@@ -0,0 +1,209 @@
+/*
+    OpenGL 4.1 Core - Rigid Obstacle Resampling - Fragment Shader
+
+    This shader is used to draw a rigid obstacle in the obstacle buffers by
+    resampling its voxelized model. The obstacle model is voxelized only once, in
+    its model space, with the stencil voxelization algorithm, so the simulation
+    step doesn't need to render the mesh: each grid cell is transformed from the
+    world space to the texture space of the voxelized model, and the cells inside
+    the model are marked as obstacle.
+
+    Since the obstacle is rigid, its velocity is the same for the whole body and
+    it is defined by the model matrices: the position of the cell at the previous
+    step is obtained by transforming the cell with the previous model matrix, and
+    the velocity is the difference between the two positions in the clip space of
+    the grid projection, divided by the time elapsed between the two steps (the
+    same velocity space of the mesh based voxelization).
+
+    The obstacles are drawn in batches: a single draw resamples up to
+    OBSTACLE_BATCH_SIZE obstacles, whose volumes and transforms are stored in
+    arrays. When a cell is inside more obstacles, the last one is written.
+
+    The voxelized models store the signed distance from their surfaces, so the
+    cells inside an obstacle are the ones with a negative distance, and the
+    pass writes also the narrow band signed distance of the grid from the
+    obstacles and the borders, in cells, used by the simulation passes to find
+    the obstacle surfaces between the cells.
+
+    The analytic primitive obstacles (sphere, box, capsule and cylinder) are
+    evaluated by the same draws without any volume: each cell is transformed in
+    the unit space of the primitive, where the signed distance from the shape is
+    computed exactly. Their parameters are stored in a uniform block, so a batch
+    evaluates up to PRIMITIVE_BATCH_SIZE primitives besides the volumes, and
+    their cells are written after the ones of the volumes.
+
+    The first batch writes all the inner cells of the grid, clearing the cells
+    outside the obstacles, so the obstacle buffers don't need to be cleared
+    before the pass. The borders of the grid are never written: the first and
+    last layers are discarded here, the others are cut by the scissor test.
+
+    The Rigid Obstacle program is composed by the following shaders:
+    - Vertex Shader:   load_vertices.vert - load the vertices of the quad
+    - Geometry Shader: set_layer.geom - set the layer of the quad and enable
+      the layered rendering
+    - Fragment Shader: this shader
+*/
+
+#version 410 core
+
+layout (location = 0) out vec4 obstaclePosition; // Obstacle position buffer
+layout (location = 1) out vec4 obstacleVelocity; // Obstacle velocity buffer
+layout (location = 2) out float obstacleDistance; // Obstacle signed distance buffer
+
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
+
+// Maximum number of obstacles in a batch (OBSTACLE_BATCH_SIZE in the application)
+#define OBSTACLE_BATCH_SIZE 8
+
+// Cells from the surfaces where the distance is stored (OBSTACLE_DISTANCE_BAND in the application)
+#define OBSTACLE_DISTANCE_BAND 4.0
+
+// Maximum number of primitives in a batch (PRIMITIVE_BATCH_SIZE in the application)
+#define PRIMITIVE_BATCH_SIZE 64
+
+// Shapes of the primitives (ObstacleShape in the application)
+#define OBSTACLE_SPHERE 1
+#define OBSTACLE_BOX 2
+#define OBSTACLE_CAPSULE 3
+#define OBSTACLE_CYLINDER 4
+
+// Parameters of a primitive obstacle
+struct ObstaclePrimitive
+{
+    mat4 worldToPrimitive; // Transform from world space to the unit space of the primitive
+    mat4 prevFromCurrent; // Transform from the current to the previous position of the primitive
+    vec4 shape; // Shape of the primitive (x) and size of its unit in grid cells (y)
+};
+
+// Primitive obstacles of the batch
+layout (std140) uniform ObstaclePrimitives
+{
+    ObstaclePrimitive primitives[PRIMITIVE_BATCH_SIZE];
+};
+
+uniform sampler3D VoxelVolumeTextures[OBSTACLE_BATCH_SIZE]; // Signed distance volumes of the obstacles, in voxels
+
+uniform mat4 worldToVolume[OBSTACLE_BATCH_SIZE]; // Transforms from world space to the texture space of the voxelized models
+uniform mat4 prevFromCurrent[OBSTACLE_BATCH_SIZE]; // Transforms from the current to the previous position of the obstacles
+uniform float distanceScale[OBSTACLE_BATCH_SIZE]; // Size of the volume voxels in grid cells
+uniform int obstacleCount; // Number of obstacles in the batch
+uniform int primitiveCount; // Number of primitives in the batch
+uniform bool firstBatch; // Is the first batch of the pass
+
+uniform mat4 view;
+uniform mat4 projection; // Projection of the simulation grid
+
+uniform vec3 center; // Center of the simulation grid
+uniform float scaling_factor; // Half the edge of the simulation grid
+uniform float deltaTime; // Time elapsed between the current and the previous step
+
+in float layer; // Layer of the 3D texture
+
+// Signed distance of the point from the surface of the unit primitive (negative inside)
+float PrimitiveDistance(int shape, vec3 p)
+{
+    if (shape == OBSTACLE_SPHERE)
+        return length(p) - 1.0;
+
+    if (shape == OBSTACLE_BOX)
+    {
+        vec3 q = abs(p) - 1.0;
+        return length(max(q, 0.0)) + min(max(q.x, max(q.y, q.z)), 0.0);
+    }
+
+    if (shape == OBSTACLE_CAPSULE)
+    {
+        p.y -= clamp(p.y, -0.5, 0.5);
+        return length(p) - 0.5;
+    }
+
+    // Cylinder
+    vec2 d = abs(vec2(length(p.xz), p.y)) - 1.0;
+    return length(max(d, 0.0)) + min(max(d.x, d.y), 0.0);
+}
+
+void main()
+{
+    // Skip the border layers
+    if (layer < 1.0 || layer > GridSize.z - 1.0)
+        discard;
+
+    // Compute the world position of the cell: the layers go from the front face
+    // of the grid to the back face, with the same depth of the voxelization slices
+    vec2 xy = (gl_FragCoord.xy * InverseSize.xy * 2.0 - 1.0) * scaling_factor;
+    float z = scaling_factor - 2.0 * scaling_factor * (layer + 0.5) / GridSize.z;
+
+    vec4 worldPosition = vec4(center + vec3(xy, z), 1.0);
+
+    // Distance of the cell from the borders of the grid: the surface of the border
+    // cells is half a cell away from their centers
+    vec3 cell = vec3(gl_FragCoord.xy, layer) - 0.5;
+    vec3 borderDistance = min(cell, GridSize - 1.0 - cell);
+    float minDistance = min(min(borderDistance.x, borderDistance.y), borderDistance.z) - 0.5;
+
+    // Search the last obstacle of the batch that contains the cell, and the minimum
+    // distance from the obstacles. The loop index is uniform for all the fragments,
+    // so it can be used to index the sampler array
+    int obstacle = -1;
+    mat4 obstaclePrevFromCurrent;
+
+    for (int i = 0; i < obstacleCount; i++)
+    {
+        vec3 uvw = (worldToVolume[i] * worldPosition).xyz;
+
+        // Outside the volume, the distance is estimated from the nearest point of the volume
+        vec3 volumeUVW = clamp(uvw, vec3(0.0), vec3(1.0));
+        vec3 volumeSize = vec3(textureSize(VoxelVolumeTextures[i], 0));
+
+        float volumeDistance = texture(VoxelVolumeTextures[i], volumeUVW).r + length((uvw - volumeUVW) * volumeSize);
+        volumeDistance *= distanceScale[i];
+
+        minDistance = min(minDistance, volumeDistance);
+
+        if (volumeDistance < 0.0)
+        {
+            obstacle = i;
+            obstaclePrevFromCurrent = prevFromCurrent[i];
+        }
+    }
+
+    for (int i = 0; i < primitiveCount; i++)
+    {
+        vec3 p = (primitives[i].worldToPrimitive * worldPosition).xyz;
+        float primitiveDistance = PrimitiveDistance(int(primitives[i].shape.x), p) * primitives[i].shape.y;
+
+        minDistance = min(minDistance, primitiveDistance);
+
+        if (primitiveDistance < 0.0)
+        {
+            obstacle = obstacleCount + i;
+            obstaclePrevFromCurrent = primitives[i].prevFromCurrent;
+        }
+    }
+
+    obstacleDistance = clamp(minDistance, -OBSTACLE_DISTANCE_BAND, OBSTACLE_DISTANCE_BAND);
+
+    // Clear the cells outside the obstacles in the first batch, skip them in the next ones
+    if (obstacle < 0)
+    {
+        if (!firstBatch)
+            discard;
+
+        obstaclePosition = vec4(0.0);
+        obstacleVelocity = vec4(0.0);
+        return;
+    }
+
+    // Compute the velocity of the cell from its previous position
+    vec4 prevPosition = obstaclePrevFromCurrent * worldPosition;
+    vec3 velocity = (projection * view * (worldPosition - prevPosition)).xyz / deltaTime;
+
+    obstaclePosition = vec4(1.0);
+    obstacleVelocity = vec4(velocity, 1.0);
+}
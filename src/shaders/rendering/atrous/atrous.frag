@@ -0,0 +1,84 @@
+/*
+    OpenGL 4.1 Core - A-Trous Denoiser - Fragment Shader
+
+    This shader is part of the program that removes the dithering of the
+    liquid rendering with an edge-aware filter, as a cheaper alternative of
+    the glslSmartDeNoise one.
+
+    The filter is an "a-trous" (with holes) wavelet transform: at each
+    iteration the same 5 taps B3 spline kernel is applied with the taps
+    spaced by 2^iteration pixels, so a wide kernel is covered with few
+    samples. Each iteration is applied in two passes, one for the horizontal
+    direction and one for the vertical direction.
+
+    The taps are weighted by their similarity with the center pixel, to keep
+    the edges of the liquid sharp: the color weight decreases with the color
+    distance, and the depth weight with the depth distance relative to the
+    depth gradient of the pixel along the filter direction, so the slanted
+    surfaces are filtered but the silhouettes are not. The samples that are
+    not fluid pixels are excluded. The passes are drawn only in the screen
+    rectangle of the fluid volume (scissor test), and inside it the pixels
+    without fluid are discarded before the kernel.
+
+    The A-Trous Denoiser program is composed by the following shaders:
+    - Vertex Shader: load_vertices.vert - Load the vertices of the quad
+    - Fragment Shader: this shader
+*/
+
+#version 410 core
+
+out vec4 FragColor; // fragment output color
+
+uniform sampler2D SourceTexture; // texture to filter
+uniform sampler2D FluidDepth; // depth of the fluid, to keep its silhouettes
+
+uniform int axis; // 0 for horizontal pass, 1 for vertical pass
+uniform int stepWidth; // distance between the taps, in pixels
+uniform float colorSigma; // scale of the color distance in the weight of a tap
+uniform float depthSigma; // scale of the depth distance in the weight of a tap, relative to the depth gradient
+
+// B3 spline kernel of the a-trous transform
+const float kernel[3] = float[](0.375, 0.25, 0.0625);
+
+void main()
+{
+    ivec2 size = textureSize(SourceTexture, 0);
+    ivec2 p = ivec2(gl_FragCoord.xy);
+
+    // Read the color of the pixel and check if is actually a fluid pixel
+    vec4 pixel = texelFetch(SourceTexture, p, 0);
+    if (pixel.a == 0.0) discard;
+
+    ivec2 direction = axis == 0 ? ivec2(1, 0) : ivec2(0, 1);
+    float depth = texelFetch(FluidDepth, p, 0).x;
+
+    // Compute the depth gradient along the filter direction, scaled to the tap distance
+    float prevDepth = texelFetch(FluidDepth, clamp(p - direction, ivec2(0), size - 1), 0).x;
+    float nextDepth = texelFetch(FluidDepth, clamp(p + direction, ivec2(0), size - 1), 0).x;
+    float depthGradient = max(0.5 * abs(nextDepth - prevDepth), 1e-6);
+
+    vec4 col = pixel * kernel[0];
+    float tot = kernel[0];
+
+    for (int i = -2; i <= 2; i++)
+    {
+        if (i == 0) continue;
+
+        ivec2 q = clamp(p + direction * i * stepWidth, ivec2(0), size - 1);
+        vec4 sampleColor = texelFetch(SourceTexture, q, 0);
+        float sampleDepth = texelFetch(FluidDepth, q, 0).x;
+
+        // Weight the tap by its similarity with the center pixel
+        vec4 colorDistance = sampleColor - pixel;
+        float colorWeight = exp(-dot(colorDistance, colorDistance) / (colorSigma * colorSigma));
+        float depthWeight = exp(-abs(sampleDepth - depth) / (depthSigma * depthGradient * float(abs(i) * stepWidth)));
+
+        // The samples that are not fluid pixels are excluded
+        float w = sampleColor.a == 0.0 ? 0.0 : kernel[abs(i)] * colorWeight * depthWeight;
+
+        col += sampleColor * w;
+        tot += w;
+    }
+
+    FragColor = col / tot;
+}
@@ -13,6 +13,13 @@
     depth of the fluid volume front faces or the depth of points in the camera
     near plane, when the camera clips the fluid volume. 
 
+    The fluid can be rendered at a lower resolution than the scene: in this
+    case it is upsampled with a depth-aware filter, which weights the four
+    nearest fluid texels by their bilinear weight and by the similarity of
+    the scene depth under them with the scene depth of the fragment. In this
+    way the fluid of a texel behind an object edge doesn't leak over the
+    object, and vice versa.
+
     The Blending program is composed by the following shaders:
     - Vertex Shader: load_vertices.vert - generic shader used to load the
                      vertices of the full screen quads
@@ -25,7 +32,7 @@ out vec4 FragColor; // output color
 
 // Scene
 uniform sampler2D SceneTexture; 
-uniform sampler2D SceneDepth; 
+uniform sampler2D SceneDepthTexture; 
 
 // Fluid
 uniform sampler2D FluidTexture;
@@ -34,20 +41,86 @@ uniform sampler2D FluidDepth;
 // RayData
 uniform sampler2D RayDataDepth;
 
-uniform vec2 InverseSize; // inverse of the screen size
+uniform vec2 InverseScreenSize; // inverse of the screen size
+
+uniform mat4 projection; // used to linearize the depth
+
+// Relative depth difference that halves the weight of a fluid texel in the upsampling
+#define UPSAMPLING_DEPTH_TOLERANCE 0.02
+
+// Compute the distance from the camera of the given depth buffer value
+float LinearDepth(float depth)
+{
+    return projection[3][2] / (2.0 * depth - 1.0 + projection[2][2]);
+}
+
+// Upsample the low resolution fluid textures at the given position, weighting the
+// four nearest texels by the similarity of their scene depth with the fragment one.
+// The depths are taken from the texel with the largest weight, since they can't
+// be interpolated across the edges
+void UpsampleFluid(vec2 uv, float sceneDepth, out vec4 fluidColor, out float fluidDepth, out float rayDataDepth)
+{
+    vec2 fluidSize = vec2(textureSize(FluidTexture, 0));
+
+    // Position of the fragment in the fluid texels and bilinear weights
+    vec2 pos = uv * fluidSize - 0.5;
+    vec2 base = floor(pos);
+    vec2 f = pos - base;
+
+    float sceneDistance = LinearDepth(sceneDepth);
+
+    float totalWeight = 0.0;
+    float bestWeight = -1.0;
+
+    fluidColor = vec4(0.0);
+
+    for (int i = 0; i < 4; i++)
+    {
+        vec2 offset = vec2(i & 1, i >> 1);
+        ivec2 texel = clamp(ivec2(base + offset), ivec2(0), ivec2(fluidSize) - 1);
+
+        // The raydata of the texel has been computed with the scene depth at its center
+        float texelDistance = LinearDepth(texture(SceneDepthTexture, (vec2(texel) + 0.5) / fluidSize).x);
+
+        vec2 bilinear = mix(1.0 - f, f, offset);
+        float weight = bilinear.x * bilinear.y / (1.0 + abs(texelDistance - sceneDistance) / (sceneDistance * UPSAMPLING_DEPTH_TOLERANCE));
+
+        fluidColor += weight * texelFetch(FluidTexture, texel, 0);
+        totalWeight += weight;
+
+        if (weight > bestWeight)
+        {
+            bestWeight = weight;
+            fluidDepth = texelFetch(FluidDepth, texel, 0).x;
+            rayDataDepth = - texelFetch(RayDataDepth, texel, 0).w;
+        }
+    }
+
+    fluidColor /= totalWeight;
+}
 
 void main()
 {
     // get the color and depth of the scene and the fluid
-    vec4 sceneColor = texture(SceneTexture, gl_FragCoord.xy * InverseSize);
-    vec4 fluidColor = texture(FluidTexture, gl_FragCoord.xy * InverseSize);
+    vec4 sceneColor = texture(SceneTexture, gl_FragCoord.xy * InverseScreenSize);
+    float sceneDepth = texture(SceneDepthTexture, gl_FragCoord.xy * InverseScreenSize).x;
 
-    float sceneDepth = texture(SceneDepth, gl_FragCoord.xy * InverseSize).x;
-    float fluidDepth = texture(FluidDepth, gl_FragCoord.xy * InverseSize).x;
+    vec4 fluidColor;
+    float fluidDepth;
+    float rayDataDepth;
 
-    // get the depth of the raydata, which is the depth of the back faces of the fluid volume
-    // negate the value because the depth is stored as a negative value
-    float rayDataDepth = - texture(RayDataDepth, gl_FragCoord.xy * InverseSize).w;
+    // the fluid rendered at a lower resolution is upsampled
+    if (textureSize(FluidTexture, 0) != textureSize(SceneTexture, 0))
+        UpsampleFluid(gl_FragCoord.xy * InverseScreenSize, sceneDepth, fluidColor, fluidDepth, rayDataDepth);
+    else
+    {
+        fluidColor = texture(FluidTexture, gl_FragCoord.xy * InverseScreenSize);
+        fluidDepth = texture(FluidDepth, gl_FragCoord.xy * InverseScreenSize).x;
+
+        // get the depth of the raydata, which is the depth of the back faces of the fluid volume
+        // negate the value because the depth is stored as a negative value
+        rayDataDepth = - texture(RayDataDepth, gl_FragCoord.xy * InverseScreenSize).w;
+    }
 
     vec4 finalColor;
      
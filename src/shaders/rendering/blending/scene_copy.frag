@@ -0,0 +1,34 @@
+/*
+    OpenGL 4.1 Core - Scene Copy - Fragment Shader
+
+    This shader is part of the program that composes the final image where
+    the fluid volume doesn't cover the screen. The pixels covered by the
+    projected fluid volume are marked in the stencil buffer and composed by
+    the blending shader, while the other pixels are drawn by this shader,
+    with the same color and depth that the blending would write without the
+    fluid, but without reading the fluid and raydata textures.
+
+    The Scene Copy program is composed by the following shaders:
+    - Vertex Shader: load_vertices.vert - generic shader used to load the
+                     vertices of the full screen quads
+    - Fragment Shader: this shader
+*/
+
+#version 410 core
+
+out vec4 FragColor; // output color
+
+// Scene
+uniform sampler2D SceneTexture;
+uniform sampler2D SceneDepthTexture;
+
+uniform vec2 InverseScreenSize; // inverse of the screen size
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy * InverseScreenSize;
+
+    // Without fluid the scene is always in front, so the blending writes the scene texel
+    FragColor = texture(SceneTexture, uv);
+    gl_FragDepth = texture(SceneDepthTexture, uv).x;
+}
@@ -0,0 +1,65 @@
+/*
+    OpenGL 4.1 Core - Separable Blur filter - Fragment Shader
+
+    This shader is part of the program that applies a gaussian blur filter
+    to the liquid rendering, as a cheaper alternative of the blur.frag one.
+
+    The gaussian blur is applied in two passes, one for the horizontal
+    direction and one for the vertical direction. The weights of the kernel
+    are computed once on the CPU when the blur radius changes, normalized,
+    and passed as a uniform array: the taps read the weight of their offset
+    instead of computing it with an exponential, and the sum of the weights
+    is always 1.0, so the final color doesn't need to be adjusted.
+
+    The texels are read with texelFetch, without filtering, and the samples
+    that are not fluid pixels are replaced by the center pixel with a select
+    instead of a branch. The passes are drawn only in the screen rectangle
+    of the fluid volume (scissor test), and inside it the pixels without
+    fluid are discarded before the kernel.
+
+    This shaders is composed by the following shaders:
+    - Vertex Shader: load_vertices.vert - Load the vertices of the quad
+    - Fragment Shader: this shader
+*/
+
+#version 410 core
+
+// Largest blur radius, in pixels (MAX_BLUR_RADIUS in fluid-sim.h)
+#define MAX_BLUR_RADIUS 16
+
+out vec4 FragColor; // fragment output color
+
+uniform sampler2D SourceTexture; // texture to blur
+
+uniform int radius; // blur radius, in pixels
+uniform int axis; // 0 for horizontal blur, 1 for vertical blur
+uniform float blurWeights[MAX_BLUR_RADIUS + 1]; // normalized weights of the offsets from 0 to radius
+
+void main()
+{
+    ivec2 size = textureSize(SourceTexture, 0);
+    ivec2 p = ivec2(gl_FragCoord.xy);
+
+    // Read the color of the pixel and check if is actually a fluid pixel
+    vec4 pixel = texelFetch(SourceTexture, p, 0);
+    if (pixel.a == 0.0) discard;
+
+    ivec2 direction = axis == 0 ? ivec2(1, 0) : ivec2(0, 1);
+
+    // Accumulate the center and the pairs of symmetric taps
+    vec4 col = pixel * blurWeights[0];
+
+    for (int i = 1; i <= radius; i++)
+    {
+        vec4 a = texelFetch(SourceTexture, clamp(p - direction * i, ivec2(0), size - 1), 0);
+        vec4 b = texelFetch(SourceTexture, clamp(p + direction * i, ivec2(0), size - 1), 0);
+
+        // Replace the samples that are not fluid pixels with the center pixel
+        a = a.a == 0.0 ? pixel : a;
+        b = b.a == 0.0 ? pixel : b;
+
+        col += (a + b) * blurWeights[i];
+    }
+
+    FragColor = col;
+}
@@ -0,0 +1,63 @@
+/*
+    OpenGL 4.1 Core - Level Set Gradient - Fragment Shader
+
+    This shader is used to build the packed gradient volume of the liquid,
+    read by the raymarcher in place of the tricubic samples of the level set
+    and of the gradient computed at the surface.
+
+    Each voxel stores the gradient of the level set at the cell (xyz), with
+    the same central differences of the raymarcher, and the level set value
+    of the cell (w). The raymarcher reads both the value and the normal of a
+    sample with a single trilinear fetch.
+
+    As in the raymarcher, the neighbor cells inside an obstacle are replaced
+    by the center cell, so the normals near the obstacles aren't bent by the
+    level set stored inside them.
+
+    The Level Set Gradient program is composed by the following shaders:
+    - Vertex Shader:   load_vertices.vert - load the vertices of the quad
+    - Geometry Shader: set_layer.geom - set the layer of the quad and enable
+      the layered rendering
+    - Fragment Shader: this shader
+*/
+
+#version 410 core
+
+layout (location = 0) out vec4 gradientValue; // Gradient (xyz) and value (w) of the level set
+
+uniform sampler3D LevelSetTexture;
+uniform sampler3D ObstacleTexture;
+
+in float layer; // Layer of the 3D texture
+
+// Returns the level set of the neighbor cell, or the center value
+// if the neighbor is outside the grid or inside an obstacle
+float Neighbor(ivec3 cell, ivec3 offset, float center)
+{
+    ivec3 neighbor = cell + offset;
+    ivec3 size = textureSize(LevelSetTexture, 0);
+
+    if (any(lessThan(neighbor, ivec3(0))) || any(greaterThanEqual(neighbor, size)))
+        return center;
+
+    if (texelFetch(ObstacleTexture, neighbor, 0).r > 0.0)
+        return center;
+
+    return texelFetch(LevelSetTexture, neighbor, 0).r;
+}
+
+void main()
+{
+    ivec3 cell = ivec3(ivec2(gl_FragCoord.xy), int(layer));
+
+    float center = texelFetch(LevelSetTexture, cell, 0).r;
+
+    float left = Neighbor(cell, ivec3(-1, 0, 0), center);
+    float right = Neighbor(cell, ivec3(1, 0, 0), center);
+    float bottom = Neighbor(cell, ivec3(0, -1, 0), center);
+    float top = Neighbor(cell, ivec3(0, 1, 0), center);
+    float back = Neighbor(cell, ivec3(0, 0, -1), center);
+    float front = Neighbor(cell, ivec3(0, 0, 1), center);
+
+    gradientValue = vec4(0.5 * vec3(right - left, top - bottom, front - back), center);
+}
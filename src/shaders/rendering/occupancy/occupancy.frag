@@ -0,0 +1,68 @@
+/*
+    OpenGL 4.1 Core - Density Occupancy - Fragment Shader
+
+    This shader is used to build the occupancy volume of the density field,
+    used by the raymarcher to leap over the empty regions of the fluid volume.
+
+    Each voxel of the occupancy volume covers a block of OCCUPANCY_BLOCK_SIZE
+    cells along each axis of the simulation grid, and it stores the minimum and
+    the maximum value of the density (or level set) in the block. The block is
+    enlarged by OCCUPANCY_APRON cells on each side, since the filtered samples
+    of the raymarcher (trilinear, tricubic and the gradient differences) read
+    the cells around the sampled position: a sample inside the block depends
+    only on the cells considered here.
+
+    The meaning of the range depends on the target fluid, so the raymarcher
+    decides which blocks are empty: a gas block is empty if its maximum density
+    is almost zero, a liquid block if its minimum level set is positive (the
+    block is entirely outside the liquid and doesn't contain its surface).
+
+    The Occupancy program is composed by the following shaders:
+    - Vertex Shader:   load_vertices.vert - load the vertices of the quad
+    - Geometry Shader: set_layer.geom - set the layer of the quad and enable
+      the layered rendering
+    - Fragment Shader: this shader
+*/
+
+#version 410 core
+
+layout (location = 0) out vec2 occupancy; // Minimum and maximum density of the block
+
+// Cells of a block along each axis (OCCUPANCY_BLOCK_SIZE in the application)
+#define OCCUPANCY_BLOCK_SIZE 8
+
+// Cells added on each side of a block (OCCUPANCY_APRON in the application)
+#define OCCUPANCY_APRON 2
+
+uniform sampler3D DensityTexture; // Density or level set of the simulation grid
+
+in float layer; // Layer of the 3D texture
+
+void main()
+{
+    ivec3 block = ivec3(ivec2(gl_FragCoord.xy), int(layer));
+    ivec3 size = textureSize(DensityTexture, 0);
+
+    // Cells of the enlarged block inside the grid
+    ivec3 first = max(block * OCCUPANCY_BLOCK_SIZE - OCCUPANCY_APRON, ivec3(0));
+    ivec3 last = min((block + 1) * OCCUPANCY_BLOCK_SIZE - 1 + OCCUPANCY_APRON, size - 1);
+
+    float minValue = texelFetch(DensityTexture, first, 0).r;
+    float maxValue = minValue;
+
+    for (int z = first.z; z <= last.z; z++)
+    {
+        for (int y = first.y; y <= last.y; y++)
+        {
+            for (int x = first.x; x <= last.x; x++)
+            {
+                float value = texelFetch(DensityTexture, ivec3(x, y, z), 0).r;
+
+                minValue = min(minValue, value);
+                maxValue = max(maxValue, value);
+            }
+        }
+    }
+
+    occupancy = vec2(minValue, maxValue);
+}
@@ -13,6 +13,9 @@
     and the vector from the fragment to the camera, which are data used for 
     liquid raymarching to compute the GGX lighting on the surface of the 
     fluid.
+
+    The unit cube is scaled to the given bounds, that enclose the region of
+    the grid occupied by the fluid, so the rays start and end near the fluid.
 */
 
 #version 410 core
@@ -25,6 +28,9 @@ uniform mat4 projection;
 
 uniform vec3 lightVector; // light direction in world coords
 
+uniform vec3 boundsMin; // bounds of the rasterized box in cube local space
+uniform vec3 boundsMax;
+
 out vec3 texPos; // texture space coords
 out vec3 ogPos; // cube local space coords
 
@@ -34,8 +40,11 @@ out vec3 vViewPosition; // fragment-camera vector in view space
 // Main function 
 void main()
 {
+    // Place the vertex on the bounds of the occupied region
+    vec3 localPos = mix(boundsMin, boundsMax, (aPos + 1.0) / 2.0);
+
     // Compute the vertex position in view space
-    vec4 pos = view * model * vec4(aPos, 1.0);
+    vec4 pos = view * model * vec4(localPos, 1.0);
 
     // Calculate the fragment-view vector by negating the vertex
     // position in view space (camera is the origin: camera - vertex = - vertex)
@@ -46,11 +55,11 @@ void main()
 
     // Calculate the texture space coordinates from cube local
     // space coords
-    texPos = (aPos + 1) / 2.0;
+    texPos = (localPos + 1) / 2.0;
     texPos.z = 1 - texPos.z; // Invert the z axis
     texPos = clamp(texPos, 0, 1); // Avoid values outside range
 
-    ogPos = aPos; // Output the vertex position in local space
+    ogPos = localPos; // Output the vertex position in local space
 
     // Calculate the light direction in view space
     lightDir = vec3(view * vec4(lightVector, 0.0));
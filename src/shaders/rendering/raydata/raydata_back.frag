@@ -55,7 +55,7 @@ uniform vec3 grid_size; // Number of voxels in each dimension
 
 uniform sampler2D SceneDepthTexture; // Scene depth texture
 
-uniform vec2 InverseSize; // Inverse of the size of the viewport
+uniform vec2 InverseScreenSize; // Inverse of the size of the viewport
 
 in vec3 texPos; // Position of the vertex in the texture space
 
@@ -80,7 +80,7 @@ void main()
     vec3 end = TextureVoxelAlign(texPos);
 
     // Read the scene depth
-    float sceneDepth = texture(SceneDepthTexture, InverseSize * gl_FragCoord.xy).r;
+    float sceneDepth = texture(SceneDepthTexture, InverseScreenSize * gl_FragCoord.xy).r;
 
     // Check if some obstacle is in front of the fluid volume
     // back face, and if it is, use that depth to approximate
@@ -88,7 +88,7 @@ void main()
     if (sceneDepth < gl_FragCoord.z)
     {
         // Compute the obstacle position in screen space
-        vec3 scenePos = 2 * vec3(InverseSize * gl_FragCoord.xy, sceneDepth) - 1.0;
+        vec3 scenePos = 2 * vec3(InverseScreenSize * gl_FragCoord.xy, sceneDepth) - 1.0;
         
         // Compute the obstacle position in the world space
         vec4 localScenePos = inverse(projection * view) * vec4(scenePos, 1.0);
@@ -56,7 +56,7 @@ uniform sampler2D SceneDepthTexture; // Scene depth texture
 
 in vec3 texPos; // Position in texture space
 
-uniform vec2 InverseSize; // Inverse of the size of the viewport
+uniform vec2 InverseScreenSize; // Inverse of the size of the viewport
 
 // Apply the texture space alignment to the given position
 // in order to obtain the coordinates in the discrete space
@@ -72,10 +72,10 @@ vec3 TextureVoxelAlign(vec3 pos)
 void main()
 {
     // Get the ray data back value
-    vec4 raydata = texture(RayDataTexture, InverseSize * gl_FragCoord.xy);
+    vec4 raydata = texture(RayDataTexture, InverseScreenSize * gl_FragCoord.xy);
 
     // Get the depth of the scene
-    float sceneDepth = texture(SceneDepthTexture, InverseSize * gl_FragCoord.xy).r;
+    float sceneDepth = texture(SceneDepthTexture, InverseScreenSize * gl_FragCoord.xy).r;
 
     // Compute the position of the ray start in discrete texture space
     vec3 pos = TextureVoxelAlign(texPos);
@@ -83,6 +83,15 @@
     used in real-time applications due to high latency in the
     rendering pipeline.
 
+    To skip the empty regions of the volume, the marching loops
+    read the occupancy volume, which stores the range of the
+    density in blocks of OCCUPANCY_BLOCK_SIZE cells: when a step
+    falls in an empty block, the ray leaps to the first step after
+    the block, on the same sequence of steps of the uniform
+    marching, so the skipping doesn't change the sampled positions.
+    The number of sampled and skipped steps is written in a second
+    output, used to measure the saving of the skipping.
+
     In the end, to improve the quality of the liquid rendering,
     the sampling of the "DensityTexture" is performed using a
     tricubic interpolation, which is more accurate than the
@@ -98,7 +107,8 @@
 
 #version 410 core
 
-out vec4 FragColor; // output color
+layout (location = 0) out vec4 FragColor; // output color
+layout (location = 1) out vec4 RaySteps; // sampled and skipped steps, 1 for the marched pixels (alpha unused)
 
 uniform vec2 InverseScreenSize; // inverse of the screen size
 
@@ -120,6 +130,48 @@ uniform sampler2D RayDataFront;
 uniform sampler3D DensityTexture; // fluid texture
 uniform sampler3D ObstacleTexture;
 uniform sampler2D BackgroundTexture; 
+uniform sampler3D OccupancyTexture; // minimum and maximum density of the blocks of the grid
+
+// Cells of a block of the occupancy volume (OCCUPANCY_BLOCK_SIZE in the application)
+#define OCCUPANCY_BLOCK_SIZE 8.0
+
+// Maximum density of an empty block for the gas (OCCUPANCY_EMPTY_GAS_DENSITY in the application)
+#define EMPTY_GAS_DENSITY 0.0001
+
+uniform bool emptySpaceSkipping; // leap over the empty blocks
+
+uniform float stepQuality; // divides the marching step: higher values take more samples
+uniform bool adaptiveStepping; // adapt the step to the distance and to the content of the volume
+uniform bool stepCountView; // show the sampled steps of each pixel instead of the fluid
+
+uniform sampler3D GradientTexture; // gradient (xyz) and value (w) of the liquid level set
+uniform bool packedGradients; // read the level set and its gradient from the packed gradient volume
+
+// Largest growth of the adaptive step, in marching steps
+#define MAX_STEP_SCALE 4.0
+
+// Gas density under which the step grows, and growth of the step in the empty gas
+#define GAS_LOW_DENSITY 0.05
+#define GAS_LOW_DENSITY_STEP_SCALE 2.0
+
+// Shrink of the gas step for each unit of density change between two samples
+#define GAS_GRADIENT_SENSITIVITY 8.0
+
+// Growth of the liquid step for each cell of distance from the surface
+#define LIQUID_SURFACE_STEP_SCALE 0.5
+
+// Sampled steps shown as the hottest color in the step count view
+#define STEP_VIEW_MAX_STEPS 256.0
+
+uniform sampler3D TransmittanceTexture; // optical depth of the light through the gas, in light space
+uniform mat4 textureToLight; // from the texture space to the light transmittance volume coords
+uniform float shadowExtinction; // extinction of the light by the gas (0 without self shadowing)
+
+// Fraction of the light that reaches the gas in its own shadow
+#define GAS_AMBIENT_LIGHT 0.3
+
+uniform sampler2D BlueNoiseTexture; // tiled blue noise used to jitter the start of the rays
+uniform float jitterOffset; // rotation of the noise at each frame, for the temporal accumulation
 
 in vec3 ogPos; // cube local space position
 in vec3 texPos; // texture space position
@@ -134,6 +186,10 @@ uniform float Kd; // weight of diffuse reflection
 
 const float PI = 3.14159265359;
 
+// Steps sampled and skipped by the marching loop
+float sampledSteps = 0.0;
+float skippedSteps = 0.0;
+
 ///////////////////
 
 // Raymarching subroutine declarations
@@ -161,10 +217,79 @@ vec3 NearPlaneIntersection(vec3 eyePos, vec3 end)
     return p;
 }
 
-// Returns a random value in the range [0,1] using the fragment 
-// position as seed
-float rand(vec2 co){
-    return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453);
+// Returns the light that reaches the gas at the given position, attenuated
+// by the gas between the position and the light: the optical depth is read
+// from the transmittance volume, computed once for each simulation step
+float GasLight(vec3 pos)
+{
+    if (shadowExtinction <= 0.0)
+        return 1.0;
+
+    float opticalDepth = texture(TransmittanceTexture, (textureToLight * vec4(pos, 1.0)).xyz).x;
+    return mix(GAS_AMBIENT_LIGHT, 1.0, exp(- shadowExtinction * opticalDepth));
+}
+
+// Returns the growth of the marching step at the given position due to the
+// distance from the camera: the step grows where a pixel covers more than a
+// cell of the grid, since the details of the cells are not visible there
+float DistanceStepScale(vec3 pos)
+{
+    // Position in world space
+    vec3 local = pos * 2.0 - 1.0;
+    local.z = - local.z;
+    vec3 world = (model * vec4(local, 1.0)).xyz;
+
+    // Size of a pixel at the position and of a cell, in world space
+    float pixelSize = distance(world, eyePos) * 2.0 * InverseScreenSize.y / projection[1][1];
+    float cellSize = 2.0 * length(model[0].xyz) / grid_size.x;
+
+    return max(1.0, pixelSize / cellSize);
+}
+
+// Returns the scale of the gas step after a sample: the step grows in the
+// low density gas and shrinks where the density changes quickly
+float GasStepScale(vec3 pos, float density, float prevDensity)
+{
+    if (!adaptiveStepping)
+        return 1.0;
+
+    float scale = mix(GAS_LOW_DENSITY_STEP_SCALE, 1.0, smoothstep(0.0, GAS_LOW_DENSITY, density));
+    scale *= DistanceStepScale(pos);
+    scale /= 1.0 + GAS_GRADIENT_SENSITIVITY * abs(density - prevDensity);
+
+    return clamp(scale, 1.0 / MAX_STEP_SCALE, MAX_STEP_SCALE);
+}
+
+// Returns the scale of the liquid step after a sample: the level set is the
+// distance from the surface in cells, so the step grows far from the surface
+// and it's refined near the surface
+float LiquidStepScale(vec3 pos, float levelSet)
+{
+    if (!adaptiveStepping)
+        return 1.0;
+
+    float scale = max(1.0, abs(levelSet) * LIQUID_SURFACE_STEP_SCALE) * DistanceStepScale(pos);
+
+    return min(scale, MAX_STEP_SCALE);
+}
+
+// Returns the color of the step count view for the given sampled steps,
+// from blue (few steps) to green and red (STEP_VIEW_MAX_STEPS or more)
+vec3 StepCountColor(float steps)
+{
+    float x = clamp(steps / STEP_VIEW_MAX_STEPS, 0.0, 1.0);
+
+    return clamp(vec3(2.0 * x - 1.0, 1.0 - abs(2.0 * x - 1.0), 1.0 - 2.0 * x), 0.0, 1.0);
+}
+
+// Returns the jitter of the ray in the range [0,1): the blue noise tile
+// at the fragment, rotated by the offset of the current frame. The blue 
+// noise has no low frequencies, so the dithering is less visible and it's
+// removed by smaller filters than the one of white noise
+float Jitter()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy) % textureSize(BlueNoiseTexture, 0);
+    return fract(texelFetch(BlueNoiseTexture, texel, 0).r + jitterOffset);
 }
 
 // Apply the texture space alignment to the given position
@@ -217,6 +342,39 @@ float interpolate_tricubic_fast(sampler3D tex, vec3 coord)
 	return mix(tex001, tex000, g0.z);  //weigh along the z-direction
 }
 
+// Returns the minimum and maximum density of the occupancy block containing the
+// given position
+vec2 BlockOccupancy(vec3 pos)
+{
+    ivec3 blocks = textureSize(OccupancyTexture, 0);
+    ivec3 block = ivec3(floor(pos * grid_size / OCCUPANCY_BLOCK_SIZE));
+
+    return texelFetch(OccupancyTexture, clamp(block, ivec3(0), blocks - 1), 0).rg;
+}
+
+// Returns the number of marching steps to leap over the occupancy block that
+// contains the step i of the ray: the next step is the first one outside the block
+float SkipBlock(vec3 start, vec3 dir, float i, float t)
+{
+    vec3 blockSize = OCCUPANCY_BLOCK_SIZE / grid_size;
+    vec3 block = floor((start + dir * i) / blockSize);
+
+    // Avoid the division by zero for the rays parallel to a face of the block
+    vec3 safeDir = dir + vec3(equal(dir, vec3(0.0))) * 1e-6;
+
+    // The ray leaves the block through the first face it reaches
+    vec3 exitPlane = (block + step(0.0, safeDir)) * blockSize;
+    vec3 exitParams = (exitPlane - start) / safeDir;
+    float exitParam = min(min(exitParams.x, exitParams.y), exitParams.z);
+
+    float steps = max(ceil((exitParam - i) / t), 1.0);
+
+    // Count only the skipped steps inside the ray
+    skippedSteps += min(steps, floor((1.0 - i) / t) + 1.0);
+
+    return steps;
+}
+
 ///////////////////
 
 // Raymarching for gas 
@@ -233,27 +391,46 @@ vec4 RaymarchingGas(vec3 start, vec3 dir)
     vec3 sampleInterval = 0.5 / grid_size;
     float t = dot(sampleInterval, abs(dir)) / (length(dir) * length(dir));
     t /= 2.0; // Half the step size thanks to easier computation
+    t /= stepQuality;
 
     // Raymarching; exit if the color is opaque; randomize the start position
     // along the ray to avoid banding artifacts
     float sampledDensity = 0;
-    for(float i = 0.5 * t * rand(gl_FragCoord.xy); i <= 1.0; i += t)
+    float prevDensity = 0;
+    for(float i = 0.5 * t * Jitter(); i <= 1.0; )
     {
         // Compute the current position
         vec3 p = start + dir * i;
 
+        // Leap over the blocks without gas
+        if (emptySpaceSkipping && BlockOccupancy(p).y <= EMPTY_GAS_DENSITY)
+        {
+            i += SkipBlock(start, dir, i, t) * t;
+            prevDensity = 0;
+            continue;
+        }
+
         // Sample the density
         sampledDensity = texture(DensityTexture, p).x;
+        sampledSteps += 1.0;
+
+        // Compute the length of the step, and the opacity of the gas along it
+        // (the density is the opacity of a step of length t)
+        float stepScale = GasStepScale(p, sampledDensity, prevDensity);
+        float opacity = 1.0 - pow(1.0 - clamp(sampledDensity, 0.0, 1.0), stepScale);
 
         // Compute the color
-        finalColor.xyz += fluidColor * sampledDensity * (1.0 - finalColor.w);
+        finalColor.xyz += fluidColor * GasLight(p) * opacity * (1.0 - finalColor.w);
 
         // Update the opacity
-        finalColor.w += sampledDensity * (1.0 - finalColor.w);
+        finalColor.w += opacity * (1.0 - finalColor.w);
 
         // Exit if the color is opaque
         if (finalColor.w > 0.99)
             break;
+
+        prevDensity = sampledDensity;
+        i += t * stepScale;
     }
 
     // Return the final color
@@ -302,6 +479,26 @@ vec3 ComputeGradient(vec3 pos)
     return gradient;
 }
 
+// Returns the level set at the given position: a single fetch of the
+// packed gradient volume, or the tricubic filter of the level set
+float SampleLevelSet(vec3 pos)
+{
+    if (packedGradients)
+        return texture(GradientTexture, pos).w;
+
+    return interpolate_tricubic_fast(DensityTexture, pos);
+}
+
+// Returns the gradient of the level set at the given position, from the
+// packed gradient volume or with the differences of the level set
+vec3 LevelSetGradient(vec3 pos)
+{
+    if (packedGradients)
+        return texture(GradientTexture, pos).xyz;
+
+    return ComputeGradient(pos);
+}
+
 // Schlick-GGX method for geometry obstruction (used by GGX model)
 float G1(float angle, float alpha)
 {
@@ -372,32 +569,47 @@ vec4 RaymarchingLiquid(vec3 start, vec3 dir)
     // Compute the marching step
     vec3 sampleInterval = 0.5 / grid_size;
     float t = dot(sampleInterval, abs(dir)) / (length(dir) * length(dir));
+    t /= stepQuality;
 
     // Randomize the starting point
-    float i = t + t * rand(gl_FragCoord.xy);
+    float i = t + t * Jitter();
     vec3 p = start + dir * i;
 
     // Sample the texture to get initial density
     float curr = texture(DensityTexture, p).x;
     float prev = curr; 
     i += t;
+    sampledSteps += 1.0;
 
     // Keep track of the surface
     bool surfaceFound = false;
     vec3 surface;
 
     // Raymarching loop; stop when alpha is 0.8 and surface is found
-    for(; i <= 1.0 && length(p - start) <= length(dir); i += t)
+    for(float stepScale = 1.0; i <= 1.0 && length(p - start) <= length(dir); i += t * stepScale)
     {
         // Get the current position
         p = start + dir * i;
 
+        // Leap over the blocks outside the liquid. If the ray starts inside the
+        // liquid, the first block outside contains the surface, so it isn't skipped
+        if (emptySpaceSkipping && (surfaceFound || prev > 0.0) && BlockOccupancy(p).x > 0.0)
+        {
+            i += (SkipBlock(start, dir, i, t) - 1.0) * t;
+            stepScale = 1.0;
+            continue;
+        }
+
         // Sample the level set
-        curr = interpolate_tricubic_fast(DensityTexture, p);
+        curr = SampleLevelSet(p);
+        sampledSteps += 1.0;
 
-        // Increase the alpha if we are inside the fluid
+        // Compute the length of the next step
+        stepScale = LiquidStepScale(p, curr);
+
+        // Increase the alpha if we are inside the fluid, in proportion to the step
         if (curr < 0.0)
-            alpha += stepSize;
+            alpha += stepSize * stepScale;
 
         // If the sign changes, we found the surface
         if (curr * prev < 0.0 && !surfaceFound)
@@ -424,12 +636,12 @@ vec4 RaymarchingLiquid(vec3 start, vec3 dir)
         vec3 surfaceNormal;
 
         if (surfaceFound) // If we found the surface, use the gradient at the surface
-            surfaceNormal = ComputeGradient(surface);
+            surfaceNormal = LevelSetGradient(surface);
         else
         {
             // Otherwise, use the gradient at the last sampled point,
             // which is a point on a fluid volume face
-            surfaceNormal = - ComputeGradient(p);
+            surfaceNormal = - LevelSetGradient(p);
 
             // Increase the lighting factor to enhance the color 
             // for those pixels that are under the fluid surface
@@ -530,4 +742,9 @@ void main()
 
     // Compute the raymarching
     FragColor = raymarch_func(start, dir);
+    RaySteps = vec4(sampledSteps, skippedSteps, 1.0, 0.0);
+
+    // Show the cost of the ray in the step count view
+    if (stepCountView)
+        FragColor = vec4(StepCountColor(sampledSteps), 1.0);
 }
\ No newline at end of file
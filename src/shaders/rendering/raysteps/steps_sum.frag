@@ -0,0 +1,47 @@
+/*
+    OpenGL 4.1 Core - Ray Steps Sum - Fragment Shader
+
+    This shader is part of the program that sums the steps of the marched
+    rays, written by the raymarching shader in the ray steps texture, to
+    show the saving of the empty space skipping.
+
+    Each fragment sums a block of STEPS_SUM_BLOCK_SIZE x STEPS_SUM_BLOCK_SIZE
+    texels of the source, so the texture is reduced to a single texel by a
+    few passes. The texels are summed and not averaged, so the blocks on the
+    borders, which are cut by the size of the source, don't bias the result:
+    the mean is computed by the application dividing by the pixel count.
+
+    The source region can be smaller than the source texture, since the
+    passes ping-pong between two textures with the size of the first pass.
+
+    The Ray Steps Sum program is composed by the following shaders:
+    - Vertex Shader: load_vertices.vert - Load the vertices of the quad
+    - Fragment Shader: this shader
+*/
+
+#version 410 core
+
+out vec4 FragColor; // sum of the block
+
+// Texels of a block along each axis (STEPS_SUM_BLOCK_SIZE in the application)
+#define STEPS_SUM_BLOCK_SIZE 8
+
+uniform sampler2D SourceTexture; // ray steps, or the sums of the previous pass
+
+uniform ivec2 sourceSize; // texels of the source region
+
+void main()
+{
+    ivec2 first = ivec2(gl_FragCoord.xy) * STEPS_SUM_BLOCK_SIZE;
+    ivec2 last = min(first + STEPS_SUM_BLOCK_SIZE, sourceSize);
+
+    vec4 sum = vec4(0.0);
+
+    for (int y = first.y; y < last.y; y++)
+    {
+        for (int x = first.x; x < last.x; x++)
+            sum += texelFetch(SourceTexture, ivec2(x, y), 0);
+    }
+
+    FragColor = sum;
+}
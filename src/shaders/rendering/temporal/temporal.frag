@@ -0,0 +1,75 @@
+/*
+    OpenGL 4.1 Core - Temporal Accumulation - Fragment Shader
+
+    This shader is part of the program that accumulates the raymarched fluid
+    over the frames. The raymarcher randomizes the start of each ray to avoid
+    banding, and the random offset changes at each frame, so averaging the
+    frames removes the dithering without a spatial filter.
+
+    The color of the previous frames (history) is reprojected on the current
+    frame: the fragment is moved back from the clip space of the current frame
+    to the clip space of the previous one, using the depth of the fluid and the
+    reprojection matrix (previous model-view-projection by the inverse of the
+    current one), so the camera and fluid cube motions are followed. Then the
+    history is clamped to the colors of the current fragment neighborhood, to
+    reject the history of the fluid that has moved or is disoccluded, and it
+    is blended with the current color.
+
+    The Temporal Accumulation program is composed by the following shaders:
+    - Vertex Shader: load_vertices.vert - generic shader used to load the
+                     vertices of the full screen quads
+    - Fragment Shader: this shader
+*/
+
+#version 410 core
+
+out vec4 FragColor; // output color
+
+// Current frame
+uniform sampler2D FluidTexture;
+uniform sampler2D FluidDepth;
+
+// Accumulated color of the previous frames
+uniform sampler2D HistoryTexture;
+
+uniform mat4 reprojection; // from the current to the previous clip space
+uniform float historyWeight; // weight of the history in the blending (0 to discard the history)
+
+uniform vec2 InverseScreenSize; // inverse of the screen size
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy * InverseScreenSize;
+    vec4 current = texture(FluidTexture, uv);
+
+    // Reproject the fragment in the previous frame
+    float depth = texture(FluidDepth, uv).x;
+    vec4 prevPos = reprojection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec2 prevUV = (prevPos.xy / prevPos.w) * 0.5 + 0.5;
+
+    // Without history (first frame or disoccluded by the screen borders) the current color is used
+    if (historyWeight <= 0.0 || any(lessThan(prevUV, vec2(0.0))) || any(greaterThan(prevUV, vec2(1.0))))
+    {
+        FragColor = current;
+        return;
+    }
+
+    // Compute the color range of the current neighborhood
+    vec4 minColor = current;
+    vec4 maxColor = current;
+
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            vec4 neighbor = texture(FluidTexture, uv + vec2(x, y) * InverseScreenSize);
+            minColor = min(minColor, neighbor);
+            maxColor = max(maxColor, neighbor);
+        }
+    }
+
+    // Clamp the history in the range and blend it with the current color
+    vec4 history = clamp(texture(HistoryTexture, prevUV), minColor, maxColor);
+
+    FragColor = mix(current, history, historyWeight);
+}
@@ -0,0 +1,60 @@
+/*
+    OpenGL 4.1 Core - Light Transmittance - Fragment Shader
+
+    This shader is part of the program that computes the light transmittance
+    volume, used by the gas raymarching to shade the gas with its own shadow.
+
+    The volume is stored in light space: its z axis is the axis of the fluid
+    grid closest to the light direction, pointing away from the light, so the
+    light crosses its layers in order. The layers are computed one at a time
+    by a sweep from the light: each fragment of a layer adds the density of
+    the gas crossed by the light from the previous layer to the optical depth
+    of the previous layer, read where the light ray enters it.
+    The optical depth (density integral along the light ray, in cells) is
+    stored instead of the transmittance, so the positions outside the volume
+    read 0 from the border (no gas between them and the light), and the
+    extinction of the gas can be changed without a new sweep.
+
+    Each fragment writes the optical depth both in the 2D texture read by the
+    next layer and in the layer of the volume, so the volume is never read
+    while it's drawn.
+
+    The Light Transmittance program is composed by the following shaders:
+    - Vertex Shader: load_vertices.vert - generic shader used to load the
+                     vertices of the full screen quads
+    - Fragment Shader: this shader
+*/
+
+#version 410 core
+
+layout (location = 0) out float OpticalDepth; // read by the next layer
+layout (location = 1) out float LayerOpticalDepth; // layer of the volume
+
+uniform sampler3D DensityTexture;
+uniform sampler2D SourceTexture; // optical depth of the previous layer
+
+uniform mat4 lightToTexture; // from the light volume coords to the grid texture coords
+uniform float sliceDepth; // light volume z coord of the layer
+uniform vec2 sliceOffset; // offset towards the light of the previous layer position
+uniform float sliceLength; // length of the light path between two layers, in cells
+
+uniform vec2 InverseScreenSize; // inverse of the layer size
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy * InverseScreenSize;
+
+    // Read the density of the gas at the position of the fragment in the grid
+    vec3 pos = (lightToTexture * vec4(uv, sliceDepth, 1.0)).xyz;
+    float density = texture(DensityTexture, pos).x;
+
+    // Read the optical depth where the light enters from the previous layer:
+    // outside the layer the light comes directly from the outside of the grid
+    vec2 prevUV = uv + sliceOffset;
+    float prevDepth = 0.0;
+    if (all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0))))
+        prevDepth = texture(SourceTexture, prevUV).x;
+
+    OpticalDepth = prevDepth + density * sliceLength;
+    LayerOpticalDepth = OpticalDepth;
+}
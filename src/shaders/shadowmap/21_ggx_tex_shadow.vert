@@ -52,6 +52,9 @@ out vec2 interp_UV;
 // for the correct rendering of the shadows, we need to calculate the vertex coordinates also in "light coordinates" (= using light as a camera)
 out vec4 posLightSpace;
 
+// the position must match the one of the depth pre-pass (depth_prepass.vert)
+invariant gl_Position;
+
 
 void main(){
 
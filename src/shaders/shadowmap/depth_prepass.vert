@@ -0,0 +1,42 @@
+/*
+    OpenGL 4.1 Core - Scene Depth Pre-Pass - Vertex Shader
+
+    This shader is part of the program that renders the depth of the scene
+    before its shading, so the GGX pass shades each pixel only once: the
+    shading pass tests the depth with GL_LEQUAL, without writing it, and the
+    hidden fragments are rejected by the early depth test.
+
+    The position is computed with the same operations of the vertex shader
+    of the shading pass (21_ggx_tex_shadow.vert), and both declare the
+    position invariant, so the two passes write the same depth.
+
+    The Depth Pre-Pass program is composed by the following shaders:
+    - Vertex Shader: this shader
+    - Fragment Shader: 20_shadowmap.frag - empty shader, only the depth is written
+*/
+
+#version 410 core
+
+// vertex position in world coordinates
+layout (location = 0) in vec3 position;
+
+// model matrix
+uniform mat4 modelMatrix;
+// view matrix
+uniform mat4 viewMatrix;
+// Projection matrix
+uniform mat4 projectionMatrix;
+
+// the position must match the one of the shading pass
+invariant gl_Position;
+
+void main()
+{
+    // vertex position in world coordinates
+    vec4 mPosition = modelMatrix * vec4( position, 1.0 );
+    // vertex position in camera coordinates
+    vec4 mvPosition = viewMatrix * mPosition;
+
+    // we apply the projection transformation
+    gl_Position = projectionMatrix * mvPosition;
+}
@@ -40,13 +40,49 @@ out vec4 FragColor; // Output data
 uniform sampler3D VelocityTexture; 
 uniform sampler3D SourceTexture;
 uniform sampler3D ObstacleTexture;
+uniform sampler3D ObstacleDistanceTexture; // Signed distance from the obstacles, in cells
 
 uniform float timeStep; // Time step
-uniform vec3 InverseSize; // Inverse size of the simulation grid
+
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
+
 uniform float dissipation; // Dissipation factor
 
 in float layer; // Layer of the 3D texture
 
+// Compute the normal of the obstacle surfaces at the given position (in cells), as
+// the normalized gradient of the signed distance with centered differences
+vec3 ObstacleNormal(vec3 position)
+{
+    vec3 gradient = vec3(
+        texture(ObstacleDistanceTexture, InverseSize * (position + vec3(1, 0, 0))).r - texture(ObstacleDistanceTexture, InverseSize * (position - vec3(1, 0, 0))).r,
+        texture(ObstacleDistanceTexture, InverseSize * (position + vec3(0, 1, 0))).r - texture(ObstacleDistanceTexture, InverseSize * (position - vec3(0, 1, 0))).r,
+        texture(ObstacleDistanceTexture, InverseSize * (position + vec3(0, 0, 1))).r - texture(ObstacleDistanceTexture, InverseSize * (position - vec3(0, 0, 1))).r);
+
+    float gradientLength = length(gradient);
+
+    return gradientLength > 0.0001 ? gradient / gradientLength : vec3(0.0);
+}
+
+// Move the position (in cells) out of the obstacles: the back-traced positions inside an
+// obstacle, or closer than half a cell to its surface, are moved along the surface normal
+// half a cell outside the surface, so the advection doesn't sample the obstacle cells
+vec3 ExitObstacles(vec3 position)
+{
+    float obstacleDistance = texture(ObstacleDistanceTexture, InverseSize * position).r;
+
+    if (obstacleDistance < 0.5)
+        position += (0.5 - obstacleDistance) * ObstacleNormal(position);
+
+    return position;
+}
+
 // Main function
 void main()
 {
@@ -65,8 +101,8 @@ void main()
         // Sample the velocity field at the current position
         vec3 u = texture(VelocityTexture, InverseSize * fragCoord).xyz;
 
-        // Calculate the new position using the semi-Lagrangian method
-        vec3 coord = InverseSize * (fragCoord - timeStep * u);
+        // Calculate the new position using the semi-Lagrangian method, outside the obstacles
+        vec3 coord = InverseSize * ExitObstacles(fragCoord - timeStep * u);
 
         // Sample the source field at the new position 
         finalColor = dissipation * texture(SourceTexture, coord);
@@ -30,7 +30,13 @@ uniform sampler3D VelocityTexture;
 uniform sampler3D ObstacleTexture;
 uniform sampler3D ObstacleVelocityTexture;
 
-uniform vec3 InverseSize; // Inverse size of the simulation grid
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
 
 in float layer; // Layer of the 3D texture
 
@@ -19,7 +19,13 @@
 
 out vec4 FragColor; // Output data
 
-uniform vec3 InverseSize; // Inverse size of the simulation grid
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
 
 uniform sampler3D TemperatureTexture; // Temperature texture
 
@@ -7,7 +7,7 @@
     temperature is higher than the ambient temperature, the buoyancy force
     is calculated by the formula:
 
-    buoyancy = (temperature - ambientTemperature) * gasBuoyancy * timeStep - density * gasWeight;
+    buoyancy = (temperature - ambientTemperature) * gasBuoyancy * TimeStep - density * gasWeight;
 
     The buoyancy force is then added to the current velocity of the cell.
     This physics force represents the ability of the gas to rise up in
@@ -34,11 +34,16 @@ uniform sampler3D DensityTexture;
 uniform sampler3D TemperatureTexture;
 
 uniform float ambientTemperature; // Ambient temperature
-uniform float timeStep; // Time step
 uniform float gasBuoyancy; // Damping factor
 uniform float gasWeight; // Weight of the gas
 
-uniform vec3 InverseSize; // Inverse size of the simulation grid
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
 
 in float layer; // Current layer of the 3D texture
 
@@ -57,7 +62,7 @@ void main()
     {
         // Calculate the buoyancy force
         float dens = texture(DensityTexture, FragCoord * InverseSize).x;
-        float buoyancy = (temp - ambientTemperature) * gasBuoyancy * timeStep - dens * gasWeight;
+        float buoyancy = (temp - ambientTemperature) * gasBuoyancy * TimeStep - dens * gasWeight;
         vec3 bForce = vec3(0, 1, 0) * buoyancy;
 
         // Add the buoyancy force to the current velocity
@@ -27,11 +27,17 @@
 out vec4 FragColor; // Output data
 
 // Input texture samplers
-uniform sampler3D Divergence;
-uniform sampler3D Pressure;
-uniform sampler3D Obstacle;
+uniform sampler3D DivergenceTexture;
+uniform sampler3D PressureTexture;
+uniform sampler3D ObstacleTexture;
 
-uniform vec3 InverseSize; // Inverse size of the simulation grid
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
 
 in float layer; // Layer of the 3D texture
 
@@ -42,24 +48,24 @@ void main()
     vec3 fragCoord = vec3(gl_FragCoord.xy, layer);
 
     // Sample the divergence and pressure value of the previous iteration
-    float divergence = texture(Divergence, fragCoord * InverseSize).r;
-    float pressure = texture(Pressure, fragCoord * InverseSize).r;
+    float divergence = texture(DivergenceTexture, fragCoord * InverseSize).r;
+    float pressure = texture(PressureTexture, fragCoord * InverseSize).r;
 
     // Sample the pressure values of the six neighboring cells
-    float pLeft = texture(Pressure, (fragCoord + vec3(-1.0, 0.0, 0.0)) * InverseSize).r;
-    float pRight = texture(Pressure, (fragCoord + vec3(1.0, 0.0, 0.0)) * InverseSize).r;
-    float pDown = texture(Pressure, (fragCoord + vec3(0.0, -1.0, 0.0)) * InverseSize).r;
-    float pUp = texture(Pressure, (fragCoord + vec3(0.0, 1.0, 0.0)) * InverseSize).r;
-    float pBottom = texture(Pressure, (fragCoord + vec3(0.0, 0.0, -1.0)) * InverseSize).r;
-    float pTop = texture(Pressure, (fragCoord + vec3(0.0, 0.0, 1.0)) * InverseSize).r;
+    float pLeft = texture(PressureTexture, (fragCoord + vec3(-1.0, 0.0, 0.0)) * InverseSize).r;
+    float pRight = texture(PressureTexture, (fragCoord + vec3(1.0, 0.0, 0.0)) * InverseSize).r;
+    float pDown = texture(PressureTexture, (fragCoord + vec3(0.0, -1.0, 0.0)) * InverseSize).r;
+    float pUp = texture(PressureTexture, (fragCoord + vec3(0.0, 1.0, 0.0)) * InverseSize).r;
+    float pBottom = texture(PressureTexture, (fragCoord + vec3(0.0, 0.0, -1.0)) * InverseSize).r;
+    float pTop = texture(PressureTexture, (fragCoord + vec3(0.0, 0.0, 1.0)) * InverseSize).r;
 
     // Sample the obstacle texture 
-    float obsLeft = texture(Obstacle, (fragCoord + vec3(-1.0, 0.0, 0.0)) * InverseSize).r;
-    float obsRight = texture(Obstacle, (fragCoord + vec3(1.0, 0.0, 0.0)) * InverseSize).r;
-    float obsDown = texture(Obstacle, (fragCoord + vec3(0.0, -1.0, 0.0)) * InverseSize).r;
-    float obsUp = texture(Obstacle, (fragCoord + vec3(0.0, 1.0, 0.0)) * InverseSize).r;
-    float obsBottom = texture(Obstacle, (fragCoord + vec3(0.0, 0.0, -1.0)) * InverseSize).r;
-    float obsTop = texture(Obstacle, (fragCoord + vec3(0.0, 0.0, 1.0)) * InverseSize).r;
+    float obsLeft = texture(ObstacleTexture, (fragCoord + vec3(-1.0, 0.0, 0.0)) * InverseSize).r;
+    float obsRight = texture(ObstacleTexture, (fragCoord + vec3(1.0, 0.0, 0.0)) * InverseSize).r;
+    float obsDown = texture(ObstacleTexture, (fragCoord + vec3(0.0, -1.0, 0.0)) * InverseSize).r;
+    float obsUp = texture(ObstacleTexture, (fragCoord + vec3(0.0, 1.0, 0.0)) * InverseSize).r;
+    float obsBottom = texture(ObstacleTexture, (fragCoord + vec3(0.0, 0.0, -1.0)) * InverseSize).r;
+    float obsTop = texture(ObstacleTexture, (fragCoord + vec3(0.0, 0.0, 1.0)) * InverseSize).r;
 
     // If a neighboring cell is inside an obstacle, set its pressure value 
     // to the pressure value of the current cell
@@ -22,9 +22,14 @@ out vec4 FragColor; // Output data
 uniform sampler3D VelocityTexture;
 uniform sampler3D LevelSetTexture;
 
-uniform vec3 InverseSize; // Inverse size of the simulation grid
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
 
-uniform float timeStep; // Time step of the simulation
 uniform float gravityAcceleration; // Acceleration due to gravity
 uniform float levelSetThreshold; // Threshold for the level set
 
@@ -42,7 +47,7 @@ void main()
     // Apply gravity to the velocity field if the fragment is below the level
     // set surface
     if (levelSet < levelSetThreshold)
-        velocity.y -= gravityAcceleration * timeStep;
+        velocity.y -= gravityAcceleration * TimeStep;
 
     // Output the new velocity value
     FragColor = vec4(velocity, 0.0);
@@ -27,11 +27,17 @@ out vec4 FragColor; // Output data
 
 uniform sampler3D LevelSetTexture;
 uniform sampler3D ObstacleTexture;
-uniform vec3 InverseSize; // Inverse size of the volume
+
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
 
 uniform float dampingFactor; // Damping factor [0, 1]
 uniform float equilibriumHeight; // Equilibrium height percentage [0, 1]
-uniform float grid_height; // Height of the grid
 
 in float layer; // Layer of the 3D texture
 
@@ -54,7 +60,7 @@ void main()
         float currLevelSet = texture(LevelSetTexture, fragCoord * InverseSize).r;
 
         // Calculate the equilibrium level set value
-        float equilibriumLevelSet = fragCoord.y - grid_height * equilibriumHeight;
+        float equilibriumLevelSet = fragCoord.y - GridSize.y * equilibriumHeight;
 
         // Damp the level set value if it is below the equilibrium surface
         if (equilibriumLevelSet < 0.0)
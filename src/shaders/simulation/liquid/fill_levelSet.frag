@@ -24,7 +24,14 @@
 out vec4 FragColor; // Output data
 
 uniform float initialHeight; // Initial height of the liquid [0, 1]
-uniform float grid_height; // Height of the grid
+
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
 
 in float layer; // Layer of the 3D texture
 
@@ -32,7 +39,7 @@ in float layer; // Layer of the 3D texture
 void main()
 {
     // Set the initial level set value
-    float levelSet = floor(gl_FragCoord.y - initialHeight * grid_height);
+    float levelSet = floor(gl_FragCoord.y - initialHeight * GridSize.y);
 
     // Set the output color
     FragColor = vec4(levelSet, 0.0, 0.0, 1.0);
@@ -43,13 +43,49 @@ uniform sampler3D Phi1HatTexture;
 uniform sampler3D Phi2HatTexture;
 
 uniform sampler3D ObstacleTexture;
+uniform sampler3D ObstacleDistanceTexture; // Signed distance from the obstacles, in cells
 
 uniform float timeStep; // Time step
-uniform vec3 InverseSize; // Inverse of the size of the simulation grid
+
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
+
 uniform float dissipation; // Dissipation factor
 
 in float layer; // Layer of the 3D texture
 
+// Compute the normal of the obstacle surfaces at the given position (in cells), as
+// the normalized gradient of the signed distance with centered differences
+vec3 ObstacleNormal(vec3 position)
+{
+    vec3 gradient = vec3(
+        texture(ObstacleDistanceTexture, InverseSize * (position + vec3(1, 0, 0))).r - texture(ObstacleDistanceTexture, InverseSize * (position - vec3(1, 0, 0))).r,
+        texture(ObstacleDistanceTexture, InverseSize * (position + vec3(0, 1, 0))).r - texture(ObstacleDistanceTexture, InverseSize * (position - vec3(0, 1, 0))).r,
+        texture(ObstacleDistanceTexture, InverseSize * (position + vec3(0, 0, 1))).r - texture(ObstacleDistanceTexture, InverseSize * (position - vec3(0, 0, 1))).r);
+
+    float gradientLength = length(gradient);
+
+    return gradientLength > 0.0001 ? gradient / gradientLength : vec3(0.0);
+}
+
+// Move the position (in cells) out of the obstacles: the back-traced positions inside an
+// obstacle, or closer than half a cell to its surface, are moved along the surface normal
+// half a cell outside the surface, so the advection doesn't sample the obstacle cells
+vec3 ExitObstacles(vec3 position)
+{
+    float obstacleDistance = texture(ObstacleDistanceTexture, InverseSize * position).r;
+
+    if (obstacleDistance < 0.5)
+        position += (0.5 - obstacleDistance) * ObstacleNormal(position);
+
+    return position;
+}
+
 void main()
 {
     // Compute the coordinates of the current fragment in the 3D texture
@@ -67,8 +103,9 @@ void main()
         // Sample the velocity field at the current fragment coordinates
         vec3 u = texture(VelocityTexture, InverseSize * fragCoord).xyz;
 
-        // Compute the coordinates of the fragment in the previous time step
-        vec3 coord = (fragCoord - timeStep * u);
+        // Compute the coordinates of the fragment in the previous time step, outside
+        // the obstacles as in the advection passes
+        vec3 coord = ExitObstacles(fragCoord - timeStep * u);
 
         // Find the corner of the cell containing the fragment
         coord = floor(coord + vec3(0.5));
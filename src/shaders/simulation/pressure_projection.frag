@@ -20,6 +20,12 @@
     by setting the mask to 0 for the obstacle cells direction. This way, the
     fluid will not be able to flow through the obstacle cells.
 
+    The cells close to the obstacle surfaces use also the signed distance from
+    the obstacles: the surface between the cells is found with the distance,
+    and the velocity component against the surface normal, relative to the
+    obstacle velocity, is removed. This way, the boundary condition follows
+    the obstacle shape instead of the faces of the obstacle cells.
+
     The Pressure Projection program is composed by the following shaders:
     - Vertex Shader:   load_vertices.vert - load the vertices of the quad
     - Geometry Shader: set_layer.geom - set the layer of the quad and enable
@@ -36,11 +42,32 @@ uniform sampler3D VelocityTexture;
 uniform sampler3D PressureTexture;
 uniform sampler3D ObstacleTexture;
 uniform sampler3D ObstacleVelocityTexture;
+uniform sampler3D ObstacleDistanceTexture; // Signed distance from the obstacles, in cells
 
-uniform vec3 InverseSize; // Inverse size of the simulation grid
+// Simulation parameters shared by all the passes of a simulation step
+layout (std140) uniform SimulationParams
+{
+    vec3 GridSize; // Size of the simulation grid
+    float TimeStep; // Time step of the simulation
+    vec3 InverseSize; // Inverse size of the simulation grid
+};
 
 in float layer; // Layer of the 3D texture
 
+// Compute the normal of the obstacle surfaces at the given position (in cells), as
+// the normalized gradient of the signed distance with centered differences
+vec3 ObstacleNormal(vec3 position)
+{
+    vec3 gradient = vec3(
+        texture(ObstacleDistanceTexture, InverseSize * (position + vec3(1, 0, 0))).r - texture(ObstacleDistanceTexture, InverseSize * (position - vec3(1, 0, 0))).r,
+        texture(ObstacleDistanceTexture, InverseSize * (position + vec3(0, 1, 0))).r - texture(ObstacleDistanceTexture, InverseSize * (position - vec3(0, 1, 0))).r,
+        texture(ObstacleDistanceTexture, InverseSize * (position + vec3(0, 0, 1))).r - texture(ObstacleDistanceTexture, InverseSize * (position - vec3(0, 0, 1))).r);
+
+    float gradientLength = length(gradient);
+
+    return gradientLength > 0.0001 ? gradient / gradientLength : vec3(0.0);
+}
+
 // Main function
 void main()
 {
@@ -142,6 +169,20 @@ void main()
         // Merge the obstacle velocity
         newVelocity = (obsMask * newVelocity) + obsVelocity;
 
+        // Close to the obstacle surfaces, remove the velocity that moves the fluid
+        // inside the obstacles, relative to the velocity of the nearest obstacle cell
+        float obsDistance = texture(ObstacleDistanceTexture, fragCoord * InverseSize).r;
+
+        if (obsDistance < 1.0)
+        {
+            vec3 normal = ObstacleNormal(fragCoord);
+            vec3 surfaceVelocity = texture(ObstacleVelocityTexture, (fragCoord - normal * (obsDistance + 0.5)) * InverseSize).xyz;
+
+            float normalVelocity = dot(newVelocity - surfaceVelocity, normal);
+            if (normalVelocity < 0.0)
+                newVelocity -= normalVelocity * normal;
+        }
+
         // If the new velocity is very small, set it to zero
         if (length(newVelocity) < 0.0001)
             newVelocity = vec3(0.0);